@@ -0,0 +1,262 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the options, statistics, and prototypes of the
+* image_operations and image_client programs, which are not part of the
+* library
+******************************************************************************/
+
+#include <thread>
+#ifndef NO_STATS
+#include <chrono>
+#endif
+#include "netPBM.h"
+#ifndef __IMAGEPROGRAM__H__
+/** ***************************************************************************
+ * @brief variable to stop redefinition errors
+ *****************************************************************************/
+#define __IMAGEPROGRAM__H__
+
+/** ***************************************************************************
+ * @brief the enumerated type referered to as statsFormat holds the ways the
+ * statistics of a run of image_operations may be reported.
+ *****************************************************************************/
+enum statsFormat
+{
+    NoStats, /**< the statistics are not reported */
+    TextStats, /**< one line per statistic */
+    JsonStats /**< a JSON object */
+};
+
+/** ***************************************************************************
+ * @brief the enumerated type referered to as ioMode holds the ways the files
+ * of a batch are read and written.
+ *****************************************************************************/
+enum ioMode
+{
+    UringIO, /**< io_uring, or a helper thread where it is not available */
+    ThreadIO, /**< a helper thread for each transfer */
+    BlockingIO /**< mapped and written while each image is handled */
+};
+
+/** ***************************************************************************
+ * @brief the options of a run of image_operations given on its command
+ * line, apart from the operations and files.
+ *****************************************************************************/
+struct runOptions
+{
+    borderMode border = Zero; /*!< how sharpen and smooth treat the pixels
+                              near the edges of the image */
+    bool poolReport = false; /*!< true to report the counts of the pool of
+                             planes when the program ends */
+    bool streaming = false; /*!< true to pass the image through one row at a
+                            time instead of reading it whole */
+    bool batch = false; /*!< true to handle every image named by a manifest,
+                        directory, or pattern instead of a single image */
+    bool frames = false; /*!< true to handle a stream of images from
+                         standard input instead of a single image */
+    ioMode io = UringIO; /*!< how the files of a batch are read and
+                         written */
+    string serverPath; /*!< the Unix socket to serve requests on, or empty
+                       to handle the images on the command line */
+    statsFormat statsReport = NoStats; /*!< how the statistics of the run
+                                       are reported */
+    string statsPath; /*!< the file receiving the statistics, standard
+                      error when empty */
+};
+
+/** ***************************************************************************
+ * @brief the time spent in each stage of a run of image_operations, in
+ * seconds, and the amount of data it handled.
+ *****************************************************************************/
+struct runStats
+{
+    double open = 0; /*!< opening or mapping the files and reading the
+                     header */
+    double read = 0; /*!< reading the pixel data */
+    double operate = 0; /*!< performing the operations */
+    double write = 0; /*!< writing the output file */
+    double stream = 0; /*!< passing the image through row by row, when
+                       streamed instead of read, operated on, and written */
+    double total = 0; /*!< the whole run */
+    size_t bytesRead = 0; /*!< the bytes of the input files */
+    size_t bytesWritten = 0; /*!< the bytes of the output files */
+    size_t pixels = 0; /*!< the pixels of the images */
+    size_t images = 0; /*!< the images handled */
+    size_t failures = 0; /*!< the images which could not be handled */
+    poolStats planes; /*!< the counts of the pool of planes */
+    long peakRss = 0; /*!< the most memory resident at once, in kilobytes */
+};
+
+/** ***************************************************************************
+ * @brief a stream buffer adding whatever is written to the end of a vector
+ * of bytes, so write can encode an image in memory before it is written in
+ * one piece.
+ *****************************************************************************/
+class byteSink : public streambuf
+{
+    vector<pixel> &bytes; /*!< the bytes written */
+
+public:
+    /** ***********************************************************************
+     * @brief writes to the end of a vector.
+     *
+     * @param[in, out] target - the vector receiving the bytes
+     *************************************************************************/
+    explicit byteSink( vector<pixel> &target ) : bytes( target )
+    {
+    }
+
+protected:
+    /** ***********************************************************************
+     * @brief adds a run of bytes.
+     *
+     * @param[in] data - the bytes
+     * @param[in] count - the number of bytes
+     *
+     * @returns the number of bytes added
+     *************************************************************************/
+    streamsize xsputn( const char *data, streamsize count ) override
+    {
+        bytes.insert( bytes.end( ), data, data + count );
+        return count;
+    }
+
+    /** ***********************************************************************
+     * @brief adds a single byte.
+     *
+     * @param[in] value - the byte, or the end of file
+     *
+     * @returns the byte added
+     *************************************************************************/
+    int_type overflow( int_type value ) override
+    {
+        if( value != traits_type::eof( ) )
+        {
+            bytes.push_back( (pixel) value );
+        }
+        return value;
+    }
+};
+
+#ifndef NO_STATS
+/** ***************************************************************************
+ * @brief adds the time from its construction to its destruction to a stage
+ * of runStats.
+ *****************************************************************************/
+class stageTimer
+{
+    double &seconds; /*!< the stage the time is added to */
+    chrono::steady_clock::time_point start; /*!< when the stage began */
+
+public:
+    /** ***********************************************************************
+     * @brief starts timing a stage.
+     *
+     * @param[in, out] stage - the stage the time is added to
+     *************************************************************************/
+    explicit stageTimer( double &stage ) : seconds( stage ),
+        start( chrono::steady_clock::now( ) )
+    {
+    }
+
+    /** ***********************************************************************
+     * @brief adds the time since the stage began to it.
+     *************************************************************************/
+    ~stageTimer( )
+    {
+        seconds += chrono::duration<double>( chrono::steady_clock::now( ) -
+                                             start ).count( );
+    }
+};
+
+/** ***************************************************************************
+ * @brief times the rest of the enclosing block as a stage of runStats.
+ * Builds made with NO_STATS defined have no timers at all.
+ *****************************************************************************/
+#define TIME_STAGE( stage ) stageTimer stageTimerScope( stage )
+#else
+#define TIME_STAGE( stage )
+#endif
+
+/** ***************************************************************************
+ * @brief the bytes received from a socket and not yet used.
+ *****************************************************************************/
+struct socketReader
+{
+    int fd = -1; /*!< the socket */
+    vector<char> buffer; /*!< the bytes received */
+    size_t pos = 0; /*!< the first byte of the buffer not yet used */
+    size_t fill = 0; /*!< one past the last byte received */
+};
+
+/** ***************************************************************************
+ * @brief a whole file read or written in the background by startRead or
+ * startWrite, until finishIO.
+ *****************************************************************************/
+struct asyncFile
+{
+    string path; /*!< the file */
+    vector<pixel> data; /*!< the bytes read, or the bytes to write */
+    size_t size = 0; /*!< the bytes read so far, or the bytes to write */
+    size_t done = 0; /*!< the bytes written so far */
+    size_t length = 0; /*!< the bytes of the file being read when it was
+                       opened, or SIZE_MAX when not known */
+    bool writing = false; /*!< true to write the file, false to read it */
+    bool pending = false; /*!< true until the transfer is finished */
+    int fd = -1; /*!< the open file, -1 before it is opened */
+    int result = 0; /*!< the error number of a failed transfer, or zero */
+    thread helper; /*!< the thread making the transfer when io_uring is not
+                   used */
+};
+
+/******************************************************************************
+ *                         Function Prototypes
+ *****************************************************************************/
+
+// check command line arguments
+void usageStatement( );
+void parseOptions( int &argc, char *argv[], runOptions &options );
+void checkCMD( image specifications, int argc, char *argv[], bool &grayCheck,
+               bool &asciiCheck, string &outFileName );
+vector<operationStep> operationList( int argc, char *argv[] );
+void checkFramesCMD( int argc, char *argv[], vector<operationStep> &steps,
+                     bool &grayCheck, bool &asciiCheck );
+
+// batches of images, streams of frames, and the server
+bool processImageFile( const string &input, const string &output,
+                       const runOptions &options,
+                       const vector<operationStep> &steps, bool grayCheck,
+                       bool asciiCheck, runStats &stats, string &error );
+int processBatch( const string &source, const string &outDir,
+                  const runOptions &options,
+                  const vector<operationStep> &steps, bool grayCheck,
+                  bool asciiCheck, runStats &stats );
+int processFrames( const runOptions &options,
+                   const vector<operationStep> &steps, bool grayCheck,
+                   bool asciiCheck, runStats &stats );
+int serveSocket( const string &path, const runOptions &options );
+
+// requests and replies over a Unix socket, shared with image_client
+bool socketAddress( const string &path, struct sockaddr_un &address );
+bool sendAll( int fd, const void *data, size_t size );
+bool readSocketLine( socketReader &reader, string &line );
+bool socketLineReady( const socketReader &reader );
+bool receiveSocketBytes( socketReader &reader );
+bool readSocketBytes( socketReader &reader, pixel *data, size_t size );
+
+// whole files read and written in the background
+void setIOMode( ioMode mode );
+void startRead( asyncFile &file, const string &path );
+void startWrite( asyncFile &file, const string &path );
+bool finishIO( asyncFile &file, string &error );
+void progressIO( );
+
+// statistics of a run
+void countImage( runStats &stats, const image &specifications,
+                 const char *path );
+void mergeStats( runStats &total, const runStats &part );
+void finishStats( runStats &stats );
+void reportStats( ostream &out, const runStats &stats, statsFormat format );
+
+#endif
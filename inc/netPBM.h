@@ -8,6 +8,8 @@
 #include <string>
 #include <algorithm>
 #include <fstream>
+#include <functional>
+#include <vector>
 #ifndef __NETPBM__H__
 /** ***************************************************************************
  * @brief variable to stop redefinition errors
@@ -20,6 +22,29 @@ using namespace std;
  *****************************************************************************/
 typedef unsigned char pixel;
 
+/** ***************************************************************************
+ * @brief the alignment in bytes of every pixel plane, each row of a plane
+ * starts on a multiple of this value.
+ *****************************************************************************/
+const int PLANE_ALIGN = 64;
+
+/** ***************************************************************************
+ * @brief the largest radius accepted by the smooth operation.
+ *****************************************************************************/
+const int MAX_RADIUS = 1000;
+
+/** ***************************************************************************
+ * @brief the enumerated type referered to as borderMode holds the ways the
+ * sharpen and smooth operations treat pixels near the edges of the image.
+ *****************************************************************************/
+enum borderMode
+{
+    Zero, /**< the border pixels are set to zero */
+    Clamp, /**< the halo repeats the edge pixels */
+    Reflect, /**< the halo mirrors the image about the edge pixels */
+    Wrap /**< the halo continues from the opposite edge */
+};
+
 /** ***************************************************************************
  * @brief image structure holds all the data for the image both the header,
  * and the content of the image.
@@ -31,16 +56,74 @@ struct image
                      the image header */
     int rows; /*!< the number of rows of content in the image */
     int cols; /*!< the number of columns of conntent in the image */
+    int stride = 0; /*!< the number of bytes from the start of one row of a
+                    plane to the next, padded to a multiple of PLANE_ALIGN */
     string maxValue; /*!< the string containing the maximum value of a pixel */
-    pixel **red; /*!< a 2d array contianing the red pixel values */
-    pixel **green; /*!< a 2d array containing the green pixel values */
-    pixel **blue; /*!< a 2d array containing the blue pixel values */
-    pixel **gray; /*!< a 2d array containing the gray pixel values */
-    pixel **newred; /*!< a 2d array for modified red pixel values */
-    pixel **newgreen; /*!< a 2d array for modified green pixel values */
-    pixel **newblue; /*!< a 2d array for modified blue pixel values */
+    pixel *red = nullptr; /*!< a contiguous plane containing the red pixel
+                          values */
+    pixel *green = nullptr; /*!< a contiguous plane containing the green pixel
+                            values */
+    pixel *blue = nullptr; /*!< a contiguous plane containing the blue pixel
+                           values */
+    pixel *gray = nullptr; /*!< a contiguous plane containing the gray pixel
+                           values */
+    pixel *newred = nullptr; /*!< a plane for modified red pixel values */
+    pixel *newgreen = nullptr; /*!< a plane for modified green pixel values */
+    pixel *newblue = nullptr; /*!< a plane for modified blue pixel values */
+    pixel *mapping = nullptr; /*!< the memory mapped image file, or nullptr
+                              when the image is read through a stream */
+    size_t mappingSize = 0; /*!< the number of bytes in the mapped file */
+    size_t bodyOffset = 0; /*!< the offset of the pixel data in the file */
+    pixel *packed = nullptr; /*!< interleaved red, green, and blue values
+                             operated on in place instead of the planes,
+                             3 * cols bytes per row with no padding */
+    borderMode border = Zero; /*!< how sharpen and smooth treat the pixels
+                              near the edges of the image */
 };
 
+/** ***************************************************************************
+ * @brief an image held in memory owned by the caller of the library, with
+ * the samples of each pixel next to each other and the rows stride bytes
+ * apart.
+ *****************************************************************************/
+struct imageBuffer
+{
+    pixel *data = nullptr; /*!< the first sample of the first row */
+    int rows = 0; /*!< the number of rows in the image */
+    int cols = 0; /*!< the number of columns in the image */
+    size_t stride = 0; /*!< the number of bytes from the start of one row
+                       to the next, at least cols * channels */
+    int channels = 3; /*!< 3 for red, green, and blue samples, 1 for gray */
+    int depth = 8; /*!< the number of bits in a sample, only 8 is
+                   supported */
+};
+
+/** ***************************************************************************
+ * @brief the counts kept by the pool of planes handed out by allocArray.
+ *****************************************************************************/
+struct poolStats
+{
+    size_t allocations = 0; /*!< the planes allocated from the system */
+    size_t bytesAllocated = 0; /*!< the bytes of the planes allocated */
+    size_t reuses = 0; /*!< the planes handed out again after release */
+    size_t releases = 0; /*!< the planes given back to the pool */
+    size_t peakBytes = 0; /*!< the most bytes of planes handed out at once */
+};
+
+/** ***************************************************************************
+ * @brief returns a pointer to the first pixel of a row in a plane.
+ *
+ * @param[in] color - the plane containing the row
+ * @param[in] stride - the number of bytes between consecutive rows
+ * @param[in] row - the row to locate
+ *
+ * @returns a pointer to the first pixel of the row
+ *****************************************************************************/
+inline pixel *planeRow( pixel *color, int stride, int row )
+{
+    return color + (size_t) row * stride;
+}
+
 /** ***************************************************************************
  * @brief the enumerated type referered to as operation holds the operations
  * that can be performed on the image with the funcitons in this program.
@@ -53,50 +136,260 @@ enum operation
     Smooth, /**< operation Smooth */
     Grayscale, /**< operation Grayscale */
     Contrast, /**< operation Contrast */
+    Equalize, /**< operation Equalize */
     None /**< operation None */
 };
 
 
+/** ***************************************************************************
+ * @brief one operation of a chain along with its parameter.
+ *****************************************************************************/
+struct operationStep
+{
+    operation op = None; /*!< the operation */
+    int value = 0; /*!< the amount to brighten by, the radius to smooth
+                   with, or the percent of pixels contrast clips at each
+                   end */
+};
+
+/** ***************************************************************************
+ * @brief the number of gray pixels of each value in an image or part of one.
+ *****************************************************************************/
+struct histogram
+{
+    size_t bins[256] = { }; /*!< the number of pixels of each value */
+};
+
+/** ***************************************************************************
+ * @brief a point operation, or a chain of them, as a table giving the
+ * output for each of the 256 sample values. Tables compose, so a chain
+ * costs one lookup per sample however long it is. A table made from a
+ * single negate or brighten remembers the step, so it can run with its own
+ * kernel instead of a lookup.
+ *****************************************************************************/
+struct pointTable
+{
+    pixel map[256]; /*!< the output for each sample value */
+    operationStep step; /*!< the single negate or brighten the table
+                        equals, or None to look up the map */
+    bool identity = true; /*!< true when the table changes nothing */
+};
+
+
+/** ***************************************************************************
+ * \typedef a stencil run on a band of rows of one plane. Output pixel
+ * (i, j) is computed from the pixels of the source whose rows and columns
+ * run from i and j to i + 2 * radius and j + 2 * radius. When rowDone is
+ * given it is called with each output row once the row is written.
+ *****************************************************************************/
+typedef void ( *stencilFilter )( pixel *source, int sourceStride,
+                                 pixel *dest, int destStride, int cols,
+                                 int radius, int first, int last,
+                                 const function<void( int row )> *rowDone );
+
+/** ***************************************************************************
+ * @brief the enumerated type referered to as instructionSet holds the
+ * instruction sets a kernel may be built for, from narrowest to widest.
+ *****************************************************************************/
+enum instructionSet
+{
+    Scalar, /**< plain C++ */
+    Sse2, /**< SSE2 */
+    Ssse3, /**< SSSE3 */
+    Avx2, /**< AVX2 */
+    Avx512, /**< AVX-512 F and BW */
+    Avx512Vbmi /**< AVX-512 F, BW, and VBMI */
+};
+
+/** ***************************************************************************
+ * @brief the kernel table holds the kernel used for each low level task.
+ * It starts out holding the scalar references; initKernels replaces them
+ * with the widest vector variants the processor supports. An operation adds
+ * its own vector variants by adding a slot here and registering the
+ * variants in initKernels.
+ *****************************************************************************/
+struct kernelTable
+{
+    void ( *deinterleave )( const pixel *source, pixel *red, pixel *green,
+                            pixel *blue, int count ); /*!< splits red,
+                            green, blue triples into three rows */
+    void ( *interleave )( const pixel *red, const pixel *green,
+                          const pixel *blue, pixel *dest, int count ); /*!<
+                          merges three rows into red, green, blue triples */
+    void ( *negate )( pixel *samples, size_t count ); /*!< subtracts each
+                      sample from 255 */
+    void ( *brighten )( pixel *samples, size_t count, int value ); /*!<
+                        adds a value to each sample, limited to 0 to 255 */
+    void ( *lookup )( pixel *samples, size_t count, const pixel *table );
+                      /*!< replaces each sample with its entry of a 256
+                      entry table */
+    void ( *grayscale )( const pixel *red, const pixel *green,
+                         const pixel *blue, pixel *gray, int count, int &max,
+                         int &min ); /*!< converts a row to gray and merges
+                         its extremes into max and min */
+};
+
+/** ***************************************************************************
+ * @brief the kernels in use by the program.
+ *****************************************************************************/
+extern kernelTable kernels;
+
+bool cpuSupports( instructionSet required );
+
+/** ***************************************************************************
+ * @brief installs a vector variant of a kernel in its slot of the kernel
+ * table if the processor supports the instruction set it was built for.
+ * Variants are registered from the narrowest instruction set to the widest.
+ *
+ * @param[in, out] slot - the slot of the kernel table
+ * @param[in] required - the instruction set the variant was built for
+ * @param[in] variant - the vector variant of the kernel
+ *
+ * @returns none
+ *****************************************************************************/
+template <typename kernel>
+void registerKernel( kernel &slot, instructionSet required, kernel variant )
+{
+    if( cpuSupports( required ) )
+    {
+        slot = variant;
+    }
+}
+
 /******************************************************************************
  *                         Function Prototypes
  *****************************************************************************/
 
-// check commandl line arguments and direct operations
-void usageStatement( );
-void checkCMD( image specifications, int argc, char *argv[], bool &grayCheck,
-               string &outFileName );
-operation operationType( image specifications, int argc, char *argv[] );
-void read( ifstream &imageFile, image &specifications, int argc,
-           char *argv[] );
-void performOperation( image &specifications, operation operationValue,
-                       int argc, char *argv[] );
-void write( ofstream &writeFile, image &specifications, bool grayCheck,
-            int argc, char *argv[] );
+// direct operations
+bool grayOperation( const operationStep &step );
+bool read( ifstream &imageFile, image &specifications,
+           const vector<operationStep> &steps, string &error );
+void performOperation( image &specifications,
+                       const vector<operationStep> &steps );
+void write( ostream &writeFile, image &specifications, bool grayCheck,
+            bool asciiCheck );
+
+
+// images in memory owned by the caller
+bool parseOperations( const vector<string> &args,
+                      vector<operationStep> &steps, string &error );
+bool processImage( const imageBuffer &input, imageBuffer &output,
+                   const vector<operationStep> &steps, borderMode border,
+                   string &error );
 
 
 // fileio
 void readImageHeader( ifstream &imageFile, image &specificaitons );
-void readAscii( ifstream &imageFile, image &specifications );
-void readBinary( ifstream &imageFile, image &specifications );
-void writeAscii( ofstream &writeFile, image specifications, bool grayCheck );
-void writeBinary( ofstream &writeFile, image specifications, bool grayCheck );
+size_t readImageHeader( const pixel *data, size_t size,
+                        image &specifications );
+bool readAscii( ifstream &imageFile, image &specifications, string &error );
+bool readAscii( const pixel *data, size_t size, image &specifications,
+                string &error );
+bool readBinary( ifstream &imageFile, image &specifications, string &error );
+bool readBinary( const pixel *data, size_t size, image &specifications,
+                 string &error );
+bool readAsciiGray( ifstream &imageFile, image &specifications,
+                    const pointTable &before, string &error );
+bool readAsciiGray( const pixel *data, size_t size, image &specifications,
+                    const pointTable &before, string &error );
+bool readBinaryGray( ifstream &imageFile, image &specifications,
+                     const pointTable &before, string &error );
+bool readBinaryGray( pixel *data, size_t size, image &specifications,
+                     const pointTable &before, string &error );
+int sampleLimit( const image &specifications );
+void writeImageHeader( ostream &writeFile, const image &specifications );
+
 
+// ascii codec
+bool decodeAscii( const pixel *data, const pixel *end, size_t first,
+                  size_t count, int limit, image &specifications,
+                  string &error );
+size_t countAsciiSamples( const pixel *data, const pixel *end );
+const pixel *findAsciiSamples( const pixel *data, const pixel *end,
+                               size_t count, bool final );
+bool decodeAsciiParallel( const pixel *data, const pixel *end, int limit,
+                          image &specifications, string &error );
+bool decodeAsciiRows( const pixel *data, const pixel *end, int limit,
+                      const image &specifications,
+                      const function<void( int row, pixel *red,
+                                           pixel *green, pixel *blue )>
+                      &rowDone, string &error );
+char *formatAscii( const pixel *samples, int count, char *out );
+char *formatAscii( const pixel *red, const pixel *green, const pixel *blue,
+                   int count, char *out );
+char *formatAsciiRows( const image &specifications, bool grayCheck,
+                       int first, int last, char *out );
+void writeAscii( ostream &writeFile, const image &specifications,
+                 bool grayCheck );
+void writeBinary( ostream &writeFile, const image &specifications,
+                  bool grayCheck );
 
-// check the boundry for operations
-void checkBoundry( pixel **&colorRed, pixel **&colorGreen, pixel **&colorBlue,
-                   int testValueRed, int testValueGreen,
-                   int testValueBlue, int i, int j );
+
+// vectorized kernels
+void initKernels( );
+void deinterleaveRGB( const pixel *source, pixel *red, pixel *green,
+                      pixel *blue, int count );
+void interleaveRGB( const pixel *red, const pixel *green, const pixel *blue,
+                    pixel *dest, int count );
 
 // operations
 void _negate( image &specifications );
-void brighten( image &specifications, int argc, char *argv[] );
+void brighten( image &specifications, int value );
 void sharpen( image &specifications );
-void smooth( image &specifications );
+void smooth( image &specifications, int radius );
 void grayscale( image &specifications, int &max, int &min );
-void contrast( image &specifications );
+void grayscaleRow( const pixel *red, const pixel *green, const pixel *blue,
+                   pixel *gray, int cols, int &max, int &min );
+void grayscalePackedRow( pixel *rgb, pixel *gray, int cols,
+                         const pointTable &before, int &max, int &min );
+stencilFilter stencilFor( operation operationValue );
+void applyOperations( image &specifications,
+                      const vector<operationStep> &steps );
+void contrast( image &specifications, int percent );
+void equalize( image &specifications );
+
+// point tables
+pointTable identityTable( );
+pointTable stepTable( const operationStep &step );
+pointTable contrastTable( int max, int min );
+pointTable composeTables( const pointTable &first,
+                          const pointTable &second );
+pointTable chainTable( const vector<operationStep> &chain );
+void applyTable( const pointTable &table, pixel *samples, size_t count );
+
+// histograms
+void countGrayRow( const pixel *gray, int cols, histogram &counts );
+void mergeHistograms( histogram &total, const histogram &part );
+pointTable stretchTable( const histogram &counts, int percent );
+pointTable equalizeTable( const histogram &counts );
+
+// thread pool
+void setWorkerCount( int count );
+size_t workerCount( );
+void parallelFor( int count, const function<void( int index )> &task );
+int rowBands( int rows );
+void parallelRows( int rows,
+                   const function<void( int band, int first, int last )>
+                   &task );
+
+
+// streaming
+bool streamImage( ifstream &imageFile, ofstream &writeFile,
+                  image &specifications, const vector<operationStep> &steps,
+                  bool grayCheck, bool asciiCheck, string &error );
+
+
+// memory mapped input
+bool mapImage( const char *path, image &specifications );
+void unmapImage( image &specifications );
+
 
 // memory
-void allocArray( pixel **&color, int rows, int cols );
-void free2d( pixel **&color, int rows );
+int planeStride( int cols );
+void allocArray( pixel *&color, int rows, int stride );
+void free2d( pixel *&color );
+void trimPlanes( );
+poolStats planePoolStats( );
+void reportPlanePool( ostream &out );
 
 #endif
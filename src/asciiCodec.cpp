@@ -0,0 +1,754 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the tokenizer which decodes the pixel data of Ascii images
+******************************************************************************/
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <emmintrin.h>
+#include <vector>
+#include "netPBM.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @brief the smallest number of bytes of Ascii pixel data worth handing to
+ * a thread of its own.
+ *****************************************************************************/
+static const size_t PARALLEL_BLOCK = 1 << 20;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function checks for the whitespace recognized by the netpbm formats:
+ * space, tab, newline, vertical tab, form feed, and carriage return.
+ *
+ * @param[in] c - the byte to check
+ *
+ * @returns true if the byte separates samples
+ *****************************************************************************/
+static inline bool asciiSpace( pixel c )
+{
+    return c == ' ' || ( c >= '\t' && c <= '\r' );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the decimal number at the front of the data. When at
+ * least eight bytes remain, the bytes are loaded into one 64 bit word and
+ * handled all at once (SWAR). Xor with '0' turns the digits into the values
+ * 0 to 9, and adding 0x76 to each byte sets its high bit only when the byte
+ * was not a digit, so the lowest flagged byte ends the number. Carries can
+ * only move toward bytes past that one, so the length is exact. The digits
+ * are then shifted to the top of the word, and neighbouring digits are
+ * combined in pairs, then fours, then eights with three multiplies. Numbers
+ * near the end of the data or longer than eight digits are read a byte at a
+ * time. Values too large for an int are saturated.
+ *
+ * @param[in] pos - the first byte of the number
+ * @param[in] end - one past the last byte of the data
+ * @param[out] length - the number of digits read, zero if there is no
+ * number
+ *
+ * @returns the value of the number
+ *****************************************************************************/
+static inline int readNumber( const pixel *pos, const pixel *end,
+                              int &length )
+{
+    uint64_t chunk, flags;
+    int value;
+
+    if( end - pos >= 8 )
+    {
+        memcpy( &chunk, pos, 8 );
+        chunk ^= 0x3030303030303030ull;
+        flags = ( ( chunk + 0x7676767676767676ull ) | chunk ) &
+            0x8080808080808080ull;
+        if( flags != 0 )
+        {
+            length = __builtin_ctzll( flags ) >> 3;
+            if( length == 0 )
+            {
+                return 0;
+            }
+
+            // keep only the digits, the first digit being the most
+            // significant, and combine them
+            chunk <<= 8 * ( 8 - length );
+            chunk = ( chunk * 10 + ( chunk >> 8 ) ) &
+                0x00ff00ff00ff00ffull;
+            chunk = ( chunk * 100 + ( chunk >> 16 ) ) &
+                0x0000ffff0000ffffull;
+            chunk = ( chunk * 10000 + ( chunk >> 32 ) ) & 0xffffffffull;
+            return (int) chunk;
+        }
+    }
+
+    // the slow path for the end of the data and very long numbers
+    value = 0;
+    length = 0;
+    while( pos + length < end && (unsigned) ( pos[length] - '0' ) <= 9 )
+    {
+        value = min( value * 10 + ( pos[length] - '0' ), 1 << 20 );
+        length++;
+    }
+    return value;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function builds a mask of the whitespace in a block of up to 64
+ * bytes, bit k being set when byte k of the block separates samples. Full
+ * blocks are classified 16 bytes at a time with SSE2 compares; a byte is
+ * whitespace when it is a space or when it minus a tab is at most 4. Bytes
+ * past the end of the data are treated as whitespace.
+ *
+ * @param[in] block - the first byte of the block
+ * @param[in] end - one past the last byte of the data
+ *
+ * @returns the whitespace mask of the block
+ *****************************************************************************/
+static inline uint64_t spaceMask( const pixel *block, const pixel *end )
+{
+    uint64_t mask = 0;
+    int k;
+    __m128i bytes, shifted;
+
+    if( end - block >= 64 )
+    {
+        for( k = 0; k < 4; k++ )
+        {
+            bytes = _mm_loadu_si128( (const __m128i *) ( block + 16 * k ) );
+            shifted = _mm_sub_epi8( bytes, _mm_set1_epi8( '\t' ) );
+            mask |= (uint64_t) (unsigned) _mm_movemask_epi8( _mm_or_si128(
+                _mm_cmpeq_epi8( bytes, _mm_set1_epi8( ' ' ) ),
+                _mm_cmpeq_epi8( _mm_min_epu8( shifted, _mm_set1_epi8( 4 ) ),
+                                shifted ) ) ) << ( 16 * k );
+        }
+        return mask;
+    }
+
+    for( k = 0; k < 64; k++ )
+    {
+        if( block + k >= end || asciiSpace( block[k] ) )
+        {
+            mask |= 1ull << k;
+        }
+    }
+    return mask;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function decodes a run of samples from the pixel data of an Ascii
+ * (P3) image directly into the red, green, and blue planes. Sample s of the
+ * image is channel s % 3 of pixel s / 3, so the run may start at any sample.
+ * Each sample must be a decimal number no larger than the limit and must be
+ * followed by whitespace or the end of the data. Decoding stops at the first
+ * sample that breaks these rules or when the data runs out. The error
+ * numbers samples from 1, the way it counts those found before the data
+ * ran out.
+ *
+ * The data is scanned in blocks of 64 bytes. The whitespace mask of a block
+ * gives the start of every token in it at once (a byte that is not
+ * whitespace following one that is), so the numbers of a block are located
+ * without waiting on each other and are converted independently.
+ *
+ * @param[in] data - the first byte of the run
+ * @param[in] end - one past the last byte of the run
+ * @param[in] first - the index of the first sample in the run
+ * @param[in] count - the number of samples in the run
+ * @param[in] limit - the maximum value of a sample
+ * @param[in, out] specifications - the structure containing the planes
+ * which are written
+ * @param[out] error - a description of the problem when decoding fails
+ *
+ * @returns true - every sample was decoded
+ * @returns false - the data was truncated or contained an invalid sample
+ *****************************************************************************/
+bool decodeAscii( const pixel *data, const pixel *end, size_t first,
+                  size_t count, int limit, image &specifications,
+                  string &error )
+{
+    const pixel *block, *pos;
+    size_t s, last, pixelIndex;
+    int channel, col, row, length, value;
+    uint64_t spaces, starts, previous = 1;
+    pixel *rows[3];
+
+    if( count == 0 )
+    {
+        return true;
+    }
+
+    // locate the first sample of the run in the planes
+    pixelIndex = first / 3;
+    channel = first % 3;
+    row = pixelIndex / specifications.cols;
+    col = pixelIndex % specifications.cols;
+    rows[0] = planeRow( specifications.red, specifications.stride, row );
+    rows[1] = planeRow( specifications.green, specifications.stride, row );
+    rows[2] = planeRow( specifications.blue, specifications.stride, row );
+
+    s = first;
+    last = first + count;
+    for( block = data; block < end && s < last; block += 64 )
+    {
+        // a token starts at each byte that follows whitespace
+        spaces = spaceMask( block, end );
+        starts = ~spaces & ( ( spaces << 1 ) | previous );
+        previous = spaces >> 63;
+
+        for( ; starts != 0 && s < last; starts &= starts - 1, s++ )
+        {
+            // convert the digits and make sure the number ends at
+            // whitespace
+            pos = block + __builtin_ctzll( starts );
+            value = readNumber( pos, end, length );
+            if( length == 0 || ( pos + length < end &&
+                                 !asciiSpace( pos[length] ) ) )
+            {
+                error = "sample " + to_string( s + 1 ) + " is not a number";
+                return false;
+            }
+            if( value > limit )
+            {
+                error = "sample " + to_string( s + 1 ) + " is larger than " +
+                    to_string( limit );
+                return false;
+            }
+
+            rows[channel][col] = value;
+
+            // move to the next channel, pixel, and row
+            if( ++channel == 3 )
+            {
+                channel = 0;
+                if( ++col == specifications.cols )
+                {
+                    col = 0;
+                    if( ++row < specifications.rows )
+                    {
+                        rows[0] += specifications.stride;
+                        rows[1] += specifications.stride;
+                        rows[2] += specifications.stride;
+                    }
+                }
+            }
+        }
+    }
+
+    if( s < last )
+    {
+        error = "the image data ends after " + to_string( s ) + " of " +
+            to_string( 3 * (size_t) specifications.rows *
+                       specifications.cols ) + " samples";
+        return false;
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function counts the tokens in a run of pixel data of an Ascii image
+ * without converting them. The run must begin at the start of the data or
+ * at whitespace so that no token is split. Whether each token is a valid
+ * sample is left for decodeAscii to check.
+ *
+ * @param[in] data - the first byte of the run
+ * @param[in] end - one past the last byte of the run
+ *
+ * @returns the number of tokens in the run
+ *****************************************************************************/
+size_t countAsciiSamples( const pixel *data, const pixel *end )
+{
+    const pixel *block;
+    size_t count = 0;
+    uint64_t spaces, previous = 1;
+
+    for( block = data; block < end; block += 64 )
+    {
+        spaces = spaceMask( block, end );
+        count += __builtin_popcountll( ~spaces &
+                                       ( ( spaces << 1 ) | previous ) );
+        previous = spaces >> 63;
+    }
+    return count;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function finds where a given number of tokens of Ascii pixel data
+ * end, so that a run of samples can be decoded from data arriving a block
+ * at a time. The run must begin at the start of the data or at whitespace.
+ * A token which reaches the end of the data may continue in data not yet
+ * read, so it only counts when the data is final.
+ *
+ * @param[in] data - the first byte of the data
+ * @param[in] end - one past the last byte of the data
+ * @param[in] count - the number of tokens wanted
+ * @param[in] final - true if no data follows the end
+ *
+ * @returns one past the last byte of the last token wanted, or nullptr if
+ * the data does not hold that many complete tokens
+ *****************************************************************************/
+const pixel *findAsciiSamples( const pixel *data, const pixel *end,
+                               size_t count, bool final )
+{
+    const pixel *block, *pos;
+    size_t found = 0, inBlock;
+    uint64_t spaces, starts, previous = 1;
+
+    if( count == 0 )
+    {
+        return data;
+    }
+
+    for( block = data; block < end; block += 64 )
+    {
+        spaces = spaceMask( block, end );
+        starts = ~spaces & ( ( spaces << 1 ) | previous );
+        previous = spaces >> 63;
+        inBlock = __builtin_popcountll( starts );
+        if( found + inBlock < count )
+        {
+            found += inBlock;
+            continue;
+        }
+
+        // drop the tokens before the last one wanted and find its end
+        for( ; found + 1 < count; found++ )
+        {
+            starts &= starts - 1;
+        }
+        pos = block + __builtin_ctzll( starts );
+        while( pos < end && !asciiSpace( *pos ) )
+        {
+            pos++;
+        }
+        return pos < end || final ? pos : nullptr;
+    }
+    return nullptr;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function splits the pixel data of an Ascii image into one chunk per
+ * thread, each boundary moved forward to the next whitespace so no number
+ * is split, and counts the samples in the chunks in parallel. The running
+ * total of the counts gives the index of the first sample of each chunk.
+ * Small data is left as a single chunk whose samples are not counted.
+ *
+ * @param[in] data - the first byte of the pixel data
+ * @param[in] end - one past the last byte of the pixel data
+ * @param[out] bounds - the first byte of each chunk, followed by the end
+ * @param[out] counts - the number of samples in each chunk
+ * @param[out] firsts - the index of the first sample of each chunk
+ *
+ * @returns the number of chunks
+ *****************************************************************************/
+static int splitAscii( const pixel *data, const pixel *end,
+                       vector<const pixel *> &bounds, vector<size_t> &counts,
+                       vector<size_t> &firsts )
+{
+    size_t size = end - data;
+    size_t found = 0;
+    int chunks, k;
+
+    // one chunk per thread, but never less than a block of data each
+    chunks = (int) max<size_t>( 1, min<size_t>( workerCount( ),
+                                                size / PARALLEL_BLOCK ) );
+    bounds.assign( 1, data );
+    counts.assign( chunks, 0 );
+    firsts.assign( chunks, 0 );
+    if( chunks == 1 )
+    {
+        bounds.push_back( end );
+        return 1;
+    }
+
+    // split the data at whitespace so that no number is cut in two
+    for( k = 1; k < chunks; k++ )
+    {
+        const pixel *bound = data + size * k / chunks;
+        while( bound < end && !asciiSpace( *bound ) )
+        {
+            bound++;
+        }
+        bounds.push_back( max( bound, bounds.back( ) ) );
+    }
+    bounds.push_back( end );
+
+    // count the samples of each chunk in parallel
+    parallelFor( chunks, [&]( int k )
+    {
+        counts[k] = countAsciiSamples( bounds[k], bounds[k + 1] );
+    } );
+
+    // the running total of the counts places each chunk in the image
+    for( k = 0; k < chunks; k++ )
+    {
+        firsts[k] = found;
+        found += counts[k];
+    }
+    return chunks;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function decodes all the pixel data of an Ascii (P3) image into the
+ * red, green, and blue planes using the thread pool. The data is split into
+ * one chunk per thread by splitAscii, whose sample counts give each chunk
+ * its place in the planes, and the threads then decode their chunks
+ * straight into the planes. Small images are decoded by the calling
+ * thread alone. When several chunks hold a bad sample the error of the
+ * earliest one is reported.
+ *
+ * @param[in] data - the first byte of the pixel data
+ * @param[in] end - one past the last byte of the pixel data
+ * @param[in] limit - the maximum value of a sample
+ * @param[in, out] specifications - the structure containing the planes
+ * which are written
+ * @param[out] error - a description of the problem when decoding fails
+ *
+ * @returns true - every sample was decoded
+ * @returns false - the data was truncated or contained an invalid sample
+ *****************************************************************************/
+bool decodeAsciiParallel( const pixel *data, const pixel *end, int limit,
+                          image &specifications, string &error )
+{
+    size_t total = (size_t) 3 * specifications.rows * specifications.cols;
+    size_t found;
+    int chunks, k;
+    vector<const pixel *> bounds;
+    vector<size_t> counts, firsts;
+    vector<string> errors;
+
+    chunks = splitAscii( data, end, bounds, counts, firsts );
+    if( chunks == 1 )
+    {
+        return decodeAscii( data, end, 0, total, limit, specifications,
+                            error );
+    }
+
+    // decode each chunk in parallel, ignoring any data past the last sample
+    errors.resize( chunks );
+    parallelFor( chunks, [&]( int k )
+    {
+        if( firsts[k] < total )
+        {
+            decodeAscii( bounds[k], bounds[k + 1], firsts[k],
+                         min( counts[k], total - firsts[k] ), limit,
+                         specifications, errors[k] );
+        }
+    } );
+
+    for( k = 0; k < chunks; k++ )
+    {
+        if( !errors[k].empty( ) )
+        {
+            error = errors[k];
+            return false;
+        }
+    }
+    found = firsts.back( ) + counts.back( );
+    if( found < total )
+    {
+        error = "the image data ends after " + to_string( found ) + " of " +
+            to_string( total ) + " samples";
+        return false;
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function decodes all the pixel data of an Ascii (P3) image one row
+ * at a time, handing each row to a function instead of storing it in the
+ * planes, so the caller can convert the rows as they are decoded without
+ * the color planes of the whole image. The data is split like
+ * decodeAsciiParallel, and each chunk then starts at the first row
+ * beginning inside it and decodes rows until the row the next chunk starts
+ * at, reading past the end of its chunk to finish its last row. A chunk in
+ * which no row begins is left to the chunk before it. Each thread decodes
+ * into a red, green, and blue row of its own. When several chunks hold a
+ * bad sample the error of the earliest one is reported.
+ *
+ * @param[in] data - the first byte of the pixel data
+ * @param[in] end - one past the last byte of the pixel data
+ * @param[in] limit - the maximum value of a sample
+ * @param[in] specifications - the structure containing the image header
+ * @param[in] rowDone - the function given each row once it is decoded, with
+ * the index of the row and its red, green, and blue samples; it is called
+ * from several threads at once
+ * @param[out] error - a description of the problem when decoding fails
+ *
+ * @returns true - every sample was decoded
+ * @returns false - the data was truncated or contained an invalid sample
+ *****************************************************************************/
+bool decodeAsciiRows( const pixel *data, const pixel *end, int limit,
+                      const image &specifications,
+                      const function<void( int row, pixel *red,
+                                           pixel *green, pixel *blue )>
+                      &rowDone, string &error )
+{
+    size_t rowSamples = (size_t) 3 * specifications.cols;
+    int rows = specifications.rows, chunks, k, next;
+    vector<const pixel *> bounds;
+    vector<size_t> counts, firsts;
+    vector<int> firstRows, lastRows;
+    vector<string> errors;
+
+    if( rows <= 0 || rowSamples == 0 )
+    {
+        return true;
+    }
+    chunks = splitAscii( data, end, bounds, counts, firsts );
+
+    // find the first row beginning in each chunk, if one does
+    firstRows.assign( chunks, -1 );
+    lastRows.assign( chunks, rows );
+    firstRows[0] = 0;
+    for( k = 1; k < chunks; k++ )
+    {
+        size_t row = ( firsts[k] + rowSamples - 1 ) / rowSamples;
+        if( row < (size_t) rows && row * rowSamples - firsts[k] < counts[k] )
+        {
+            firstRows[k] = (int) row;
+        }
+    }
+    for( k = chunks - 1, next = rows; k >= 0; k-- )
+    {
+        if( firstRows[k] >= 0 )
+        {
+            lastRows[k] = next;
+            next = firstRows[k];
+        }
+    }
+
+    // decode the rows of each chunk in parallel
+    errors.resize( chunks );
+    parallelFor( chunks, [&]( int k )
+    {
+        const pixel *pos = bounds[k], *stop;
+        size_t skip;
+        int row, stride = planeStride( specifications.cols );
+        pixel *scratch = nullptr;
+        image rowView;
+
+        if( firstRows[k] < 0 )
+        {
+            return;
+        }
+
+        // skip the end of the row the chunk before finishes
+        skip = (size_t) firstRows[k] * rowSamples - firsts[k];
+        if( skip > 0 )
+        {
+            pos = findAsciiSamples( pos, bounds[k + 1], skip, true );
+        }
+
+        // a view with a stride of zero puts every row in the same buffers
+        allocArray( scratch, 3, stride );
+        rowView.rows = rows;
+        rowView.cols = specifications.cols;
+        rowView.red = scratch;
+        rowView.green = scratch + stride;
+        rowView.blue = scratch + 2 * stride;
+
+        for( row = firstRows[k]; row < lastRows[k]; row++ )
+        {
+            // a short or invalid row is reported by decodeAscii
+            stop = findAsciiSamples( pos, end, rowSamples, true );
+            if( stop == nullptr )
+            {
+                stop = end;
+            }
+            if( !decodeAscii( pos, stop, (size_t) row * rowSamples,
+                              rowSamples, limit, rowView, errors[k] ) )
+            {
+                break;
+            }
+            rowDone( row, rowView.red, rowView.green, rowView.blue );
+            pos = stop;
+        }
+        free2d( scratch );
+    } );
+
+    for( k = 0; k < chunks; k++ )
+    {
+        if( !errors[k].empty( ) )
+        {
+            error = errors[k];
+            return false;
+        }
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @brief the text written for one sample of an Ascii image: its decimal
+ * digits followed by a space, padded to four bytes so it can be copied
+ * with a single four byte move.
+ *****************************************************************************/
+struct sampleText
+{
+    char text[4]; /*!< the digits and the trailing space */
+    int length; /*!< the number of meaningful bytes in text */
+};
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function builds the table holding the text of every sample value.
+ *
+ * @returns the table, indexed by sample value
+ *****************************************************************************/
+static array<sampleText, 256> buildSampleTable( )
+{
+    array<sampleText, 256> table;
+    string text;
+    int value;
+
+    for( value = 0; value < 256; value++ )
+    {
+        text = to_string( value ) + ' ';
+        memset( table[value].text, ' ', 4 );
+        memcpy( table[value].text, text.data( ), text.size( ) );
+        table[value].length = text.size( );
+    }
+    return table;
+}
+
+/** ***************************************************************************
+ * @brief the text of every sample value, built before main runs.
+ *****************************************************************************/
+static const array<sampleText, 256> sampleTable = buildSampleTable( );
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function formats a row of samples as Ascii text, each sample followed
+ * by a space. Every sample copies four bytes from the table and advances by
+ * its length, so there is no branching on the number of digits. The output
+ * must have room for four bytes per sample.
+ *
+ * @param[in] samples - the samples to format
+ * @param[in] count - the number of samples
+ * @param[out] out - where the text is written
+ *
+ * @returns one past the last byte written
+ *****************************************************************************/
+char *formatAscii( const pixel *samples, int count, char *out )
+{
+    int j;
+
+    for( j = 0; j < count; j++ )
+    {
+        memcpy( out, sampleTable[samples[j]].text, 4 );
+        out += sampleTable[samples[j]].length;
+    }
+    return out;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function formats a row of color pixels as Ascii text, writing the
+ * red, green, and blue samples of each pixel in turn, each followed by a
+ * space. The output must have room for twelve bytes per pixel.
+ *
+ * @param[in] red - the red samples of the row
+ * @param[in] green - the green samples of the row
+ * @param[in] blue - the blue samples of the row
+ * @param[in] count - the number of pixels
+ * @param[out] out - where the text is written
+ *
+ * @returns one past the last byte written
+ *****************************************************************************/
+char *formatAscii( const pixel *red, const pixel *green, const pixel *blue,
+                   int count, char *out )
+{
+    int j;
+
+    for( j = 0; j < count; j++ )
+    {
+        memcpy( out, sampleTable[red[j]].text, 4 );
+        out += sampleTable[red[j]].length;
+        memcpy( out, sampleTable[green[j]].text, 4 );
+        out += sampleTable[green[j]].length;
+        memcpy( out, sampleTable[blue[j]].text, 4 );
+        out += sampleTable[blue[j]].length;
+    }
+    return out;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function formats a range of rows of an image as Ascii text. The gray
+ * plane is formatted when the image is grayscaled, the interleaved bytes
+ * when the image has no planes, and the color planes otherwise. The output
+ * must have room for four bytes per sample.
+ *
+ * @param[in] specifications - the structure containing the image
+ * @param[in] grayCheck - a boolean specifying wether the gray plane is
+ * formatted
+ * @param[in] first - the first row to format
+ * @param[in] last - one past the last row to format
+ * @param[out] out - where the text is written
+ *
+ * @returns one past the last byte written
+ *****************************************************************************/
+char *formatAsciiRows( const image &specifications, bool grayCheck,
+                       int first, int last, char *out )
+{
+    int i;
+    size_t rowBytes = (size_t) 3 * specifications.cols;
+
+    for( i = first; i < last; i++ )
+    {
+        if( grayCheck == true )
+        {
+            out = formatAscii( planeRow( specifications.gray,
+                                         specifications.stride, i ),
+                               specifications.cols, out );
+        }
+        else if( specifications.packed != nullptr )
+        {
+            out = formatAscii( specifications.packed + i * rowBytes,
+                               rowBytes, out );
+        }
+        else
+        {
+            out = formatAscii(
+                planeRow( specifications.red, specifications.stride, i ),
+                planeRow( specifications.green, specifications.stride, i ),
+                planeRow( specifications.blue, specifications.stride, i ),
+                specifications.cols, out );
+        }
+    }
+    return out;
+}
@@ -0,0 +1,551 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the asynchronous reads and writes of whole files used by
+* batches of images, through io_uring or a helper thread, part of
+* image_operations but not the library
+******************************************************************************/
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "imageProgram.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @brief the bytes first set aside for reading a file, doubled as often as
+ * the file needs.
+ *****************************************************************************/
+static const size_t READ_START = 1 << 20;
+
+/** ***************************************************************************
+ * @brief the entries of the submission queue of each ring, enough for the
+ * few transfers a thread has in flight at once.
+ *****************************************************************************/
+static const unsigned RING_ENTRIES = 8;
+
+/** ***************************************************************************
+ * @brief an io_uring of one thread, set up the first time the thread starts
+ * a transfer.
+ *****************************************************************************/
+struct ioRing
+{
+    int fd = -1; /*!< the ring, or -1 if io_uring is not available */
+    bool tried = false; /*!< true once the ring has been set up or failed */
+    void *sqMap = nullptr; /*!< the mapped submission queue */
+    void *cqMap = nullptr; /*!< the mapped completion queue, the same as
+                           sqMap when the kernel maps them together */
+    size_t sqMapSize = 0; /*!< the bytes of sqMap */
+    size_t cqMapSize = 0; /*!< the bytes of cqMap */
+    io_uring_sqe *sqes = nullptr; /*!< the submission entries */
+    unsigned *sqTail = nullptr; /*!< the next submission entry to fill */
+    unsigned *sqMask = nullptr; /*!< the mask of the submission queue */
+    unsigned *sqArray = nullptr; /*!< the entries submitted, in order */
+    unsigned *cqHead = nullptr; /*!< the next completion to take */
+    unsigned *cqTail = nullptr; /*!< one past the last completion */
+    unsigned *cqMask = nullptr; /*!< the mask of the completion queue */
+    io_uring_cqe *cqes = nullptr; /*!< the completions */
+
+    /** ***********************************************************************
+     * @brief releases the ring when its thread ends.
+     *************************************************************************/
+    ~ioRing( )
+    {
+        if( fd < 0 )
+        {
+            return;
+        }
+        munmap( sqes, RING_ENTRIES * sizeof( io_uring_sqe ) );
+        if( cqMap != sqMap )
+        {
+            munmap( cqMap, cqMapSize );
+        }
+        munmap( sqMap, sqMapSize );
+        close( fd );
+    }
+};
+
+/** ***************************************************************************
+ * @brief how the transfers are made, io_uring where it is available unless
+ * setIOMode chose otherwise.
+ *****************************************************************************/
+static ioMode transferMode = UringIO;
+
+/** ***************************************************************************
+ * @brief the ring of each thread.
+ *****************************************************************************/
+static thread_local ioRing ring;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function chooses how files are transferred by startRead and
+ * startWrite: through io_uring, falling back to a helper thread where the
+ * kernel does not offer it, or always through a helper thread.
+ *
+ * @param[in] mode - UringIO or ThreadIO
+ *
+ * @returns none
+ *****************************************************************************/
+void setIOMode( ioMode mode )
+{
+    transferMode = mode;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function sets up the ring of the calling thread the first time it
+ * is needed. The ring is only used if the kernel supports reading and
+ * writing files through it; otherwise, or if io_uring is not
+ * available at all, it is left unusable and the transfers of the thread go
+ * to helper threads.
+ *
+ * @returns true - the ring of the thread can be used
+ * @returns false - io_uring is not available
+ *****************************************************************************/
+static bool ringReady( )
+{
+    io_uring_params params;
+    size_t probeSize = sizeof( io_uring_probe ) +
+        256 * sizeof( io_uring_probe_op );
+    vector<char> probeSpace( probeSize );
+    io_uring_probe *probe = (io_uring_probe *) probeSpace.data( );
+    void *sqes;
+    int fd;
+
+    if( ring.tried )
+    {
+        return ring.fd >= 0;
+    }
+    ring.tried = true;
+
+    memset( &params, 0, sizeof( params ) );
+    fd = (int) syscall( __NR_io_uring_setup, RING_ENTRIES, &params );
+    if( fd < 0 )
+    {
+        return false;
+    }
+
+    // the operations used arrived after io_uring itself
+    if( syscall( __NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+                 256 ) < 0 || probe->last_op < IORING_OP_WRITE ||
+        !( probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED ) ||
+        !( probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED ) )
+    {
+        close( fd );
+        return false;
+    }
+
+    // map the queues, together when the kernel allows it
+    ring.sqMapSize = params.sq_off.array +
+        params.sq_entries * sizeof( unsigned );
+    ring.cqMapSize = params.cq_off.cqes +
+        params.cq_entries * sizeof( io_uring_cqe );
+    if( params.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        ring.sqMapSize = ring.cqMapSize =
+            max( ring.sqMapSize, ring.cqMapSize );
+    }
+    ring.sqMap = mmap( nullptr, ring.sqMapSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+    if( ring.sqMap == MAP_FAILED )
+    {
+        close( fd );
+        return false;
+    }
+    ring.cqMap = ring.sqMap;
+    if( !( params.features & IORING_FEAT_SINGLE_MMAP ) )
+    {
+        ring.cqMap = mmap( nullptr, ring.cqMapSize, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, fd,
+                           IORING_OFF_CQ_RING );
+    }
+    sqes = mmap( nullptr, RING_ENTRIES * sizeof( io_uring_sqe ),
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                 IORING_OFF_SQES );
+    if( ring.cqMap == MAP_FAILED || sqes == MAP_FAILED )
+    {
+        if( ring.cqMap != MAP_FAILED && ring.cqMap != ring.sqMap )
+        {
+            munmap( ring.cqMap, ring.cqMapSize );
+        }
+        if( sqes != MAP_FAILED )
+        {
+            munmap( sqes, RING_ENTRIES * sizeof( io_uring_sqe ) );
+        }
+        munmap( ring.sqMap, ring.sqMapSize );
+        close( fd );
+        return false;
+    }
+
+    ring.sqes = (io_uring_sqe *) sqes;
+    ring.sqTail = (unsigned *) ( (char *) ring.sqMap + params.sq_off.tail );
+    ring.sqMask = (unsigned *) ( (char *) ring.sqMap +
+                                 params.sq_off.ring_mask );
+    ring.sqArray = (unsigned *) ( (char *) ring.sqMap + params.sq_off.array );
+    ring.cqHead = (unsigned *) ( (char *) ring.cqMap + params.cq_off.head );
+    ring.cqTail = (unsigned *) ( (char *) ring.cqMap + params.cq_off.tail );
+    ring.cqMask = (unsigned *) ( (char *) ring.cqMap +
+                                 params.cq_off.ring_mask );
+    ring.cqes = (io_uring_cqe *) ( (char *) ring.cqMap +
+                                   params.cq_off.cqes );
+    ring.fd = fd;
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function submits the next step of a transfer to the ring of the
+ * calling thread, reading or writing the bytes from where the transfer
+ * stands. A read asks for the rest of the buffer, which is doubled first
+ * if it is full.
+ *
+ * @param[in, out] file - the transfer
+ *
+ * @returns none
+ *****************************************************************************/
+static void submitStep( asyncFile &file )
+{
+    unsigned tail = *ring.sqTail, index = tail & *ring.sqMask;
+    io_uring_sqe &entry = ring.sqes[index];
+
+    memset( &entry, 0, sizeof( entry ) );
+    entry.user_data = (uintptr_t) &file;
+    if( file.writing )
+    {
+        entry.opcode = IORING_OP_WRITE;
+        entry.fd = file.fd;
+        entry.addr = (uintptr_t) ( file.data.data( ) + file.done );
+        entry.len = (unsigned) min<size_t>( file.size - file.done,
+                                            1u << 30 );
+        entry.off = file.done;
+    }
+    else
+    {
+        if( file.size == file.data.size( ) )
+        {
+            file.data.resize( max( 2 * file.data.size( ), READ_START ) );
+        }
+        entry.opcode = IORING_OP_READ;
+        entry.fd = file.fd;
+        entry.addr = (uintptr_t) ( file.data.data( ) + file.size );
+        entry.len = (unsigned) min<size_t>( file.data.size( ) - file.size,
+                                            1u << 30 );
+        entry.off = file.size;
+    }
+
+    ring.sqArray[index] = index;
+    __atomic_store_n( ring.sqTail, tail + 1, __ATOMIC_RELEASE );
+    while( syscall( __NR_io_uring_enter, ring.fd, 1, 0, 0, nullptr, 0 ) < 0 &&
+           errno == EINTR )
+    {
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function takes the next completion on the ring of the calling
+ * thread, waiting for one if asked to, and moves its transfer on: a read
+ * continues until the file ends, and a write until every byte is written.
+ * A transfer that fails keeps the error and stops.
+ *
+ * @param[in] wait - true to wait for a completion, false to return when
+ * none has arrived
+ *
+ * @returns true - a completion was taken
+ * @returns false - no completion had arrived
+ *****************************************************************************/
+static bool completeStep( bool wait )
+{
+    unsigned head = *ring.cqHead;
+    asyncFile *file;
+    int result;
+
+    while( head == __atomic_load_n( ring.cqTail, __ATOMIC_ACQUIRE ) )
+    {
+        if( !wait )
+        {
+            return false;
+        }
+        syscall( __NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS,
+                 nullptr, 0 );
+    }
+    file = (asyncFile *) (uintptr_t) ring.cqes[head & *ring.cqMask].user_data;
+    result = ring.cqes[head & *ring.cqMask].res;
+    __atomic_store_n( ring.cqHead, head + 1, __ATOMIC_RELEASE );
+
+    if( result == -EINTR || result == -EAGAIN )
+    {
+        submitStep( *file );
+        return true;
+    }
+    if( result < 0 )
+    {
+        file->result = -result;
+        file->pending = false;
+        return true;
+    }
+
+    // a read goes on until the file ends, or it has the bytes the file held
+    // when it was opened, and a write until every byte is written
+    if( file->writing && result == 0 )
+    {
+        file->result = EIO;
+        file->pending = false;
+        return true;
+    }
+    if( file->writing )
+    {
+        file->done += result;
+    }
+    else
+    {
+        file->size += result;
+    }
+    if( ( file->writing && file->done == file->size ) ||
+        ( !file->writing && ( result == 0 || file->size == file->length ) ) )
+    {
+        file->pending = false;
+        return true;
+    }
+    submitStep( *file );
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function makes a whole transfer with blocking calls, on the helper
+ * thread of the transfer when io_uring is not used.
+ *
+ * @param[in, out] file - the transfer
+ *
+ * @returns none
+ *****************************************************************************/
+static void blockingTransfer( asyncFile &file )
+{
+    ssize_t result = 0;
+
+    file.fd = open( file.path.c_str( ), file.writing ?
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC :
+                    O_RDONLY | O_CLOEXEC, 0666 );
+    if( file.fd < 0 )
+    {
+        file.result = errno;
+        return;
+    }
+
+    do
+    {
+        if( file.writing )
+        {
+            result = pwrite( file.fd, file.data.data( ) + file.done,
+                             file.size - file.done, file.done );
+            file.done += max<ssize_t>( result, 0 );
+        }
+        else
+        {
+            if( file.size == file.data.size( ) )
+            {
+                file.data.resize( max( 2 * file.data.size( ), READ_START ) );
+            }
+            result = pread( file.fd, file.data.data( ) + file.size,
+                            file.data.size( ) - file.size, file.size );
+            file.size += max<ssize_t>( result, 0 );
+        }
+    } while( ( result > 0 || ( result < 0 && errno == EINTR ) ) &&
+             ( !file.writing || file.done < file.size ) );
+
+    if( result < 0 )
+    {
+        file.result = errno;
+    }
+    else if( file.writing && file.done < file.size )
+    {
+        file.result = EIO;
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function starts a transfer, on the ring of the calling thread or on
+ * a helper thread, and returns at once. On the ring the file is opened
+ * here, which takes little time, so the whole of a read, sized by the
+ * file, or of a write is in flight from the start and moves while the
+ * caller works rather than only inside finishIO.
+ *
+ * @param[in, out] file - the transfer
+ *
+ * @returns none
+ *****************************************************************************/
+static void startTransfer( asyncFile &file )
+{
+    struct stat status;
+
+    file.fd = -1;
+    file.done = 0;
+    file.length = SIZE_MAX;
+    file.result = 0;
+    file.pending = true;
+
+    if( transferMode != UringIO || !ringReady( ) )
+    {
+        file.helper = thread( blockingTransfer, ref( file ) );
+        return;
+    }
+
+    file.fd = open( file.path.c_str( ), file.writing ?
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC :
+                    O_RDONLY | O_CLOEXEC, 0666 );
+    if( file.fd < 0 )
+    {
+        file.result = errno;
+        file.pending = false;
+        return;
+    }
+    if( file.writing && file.size == 0 )
+    {
+        file.pending = false;
+        return;
+    }
+
+    // a read asks for the whole file at once, with room for one more byte
+    // in case it has grown
+    if( !file.writing && fstat( file.fd, &status ) == 0 &&
+        S_ISREG( status.st_mode ) )
+    {
+        file.length = status.st_size;
+        if( file.data.size( ) <= file.length )
+        {
+            file.data.resize( file.length + 1 );
+        }
+        if( file.length == 0 )
+        {
+            file.pending = false;
+            return;
+        }
+    }
+    submitStep( file );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function starts reading the whole of a file into the buffer of a
+ * transfer and returns at once; finishIO waits for the bytes. The buffer
+ * keeps its size from the transfer before, so a batch of images of one
+ * size is read without growing it again.
+ *
+ * @param[in, out] file - the transfer, whose buffer receives the file
+ * @param[in] path - the file to read
+ *
+ * @returns none
+ *****************************************************************************/
+void startRead( asyncFile &file, const string &path )
+{
+    file.path = path;
+    file.writing = false;
+    file.size = 0;
+    startTransfer( file );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function starts writing the first size bytes of the buffer of a
+ * transfer to a file, created or emptied first, and returns at once; the
+ * buffer must be left alone until finishIO returns.
+ *
+ * @param[in, out] file - the transfer, holding the bytes to write
+ * @param[in] path - the file to write
+ *
+ * @returns none
+ *****************************************************************************/
+void startWrite( asyncFile &file, const string &path )
+{
+    file.path = path;
+    file.writing = true;
+    startTransfer( file );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function moves on the transfers of the calling thread whose steps
+ * have completed, without waiting, so a read or write needing more than
+ * one step goes on while the thread works. Calling it now and then
+ * between other work is enough.
+ *
+ * @returns none
+ *****************************************************************************/
+void progressIO( )
+{
+    if( ring.fd >= 0 )
+    {
+        while( completeStep( false ) )
+        {
+        }
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function waits for a transfer started by startRead or startWrite to
+ * finish and closes its file. It must be called by the thread that started
+ * the transfer. Calling it for a transfer already finished, or never
+ * started, does nothing.
+ *
+ * @param[in, out] file - the transfer
+ * @param[out] error - a description of the problem when the transfer
+ * failed
+ *
+ * @returns true - the file was read or written
+ * @returns false - the transfer failed
+ *****************************************************************************/
+bool finishIO( asyncFile &file, string &error )
+{
+    if( file.helper.joinable( ) )
+    {
+        file.helper.join( );
+        file.pending = false;
+    }
+    while( file.pending )
+    {
+        completeStep( true );
+    }
+    if( file.fd >= 0 )
+    {
+        close( file.fd );
+        file.fd = -1;
+    }
+
+    if( file.result != 0 )
+    {
+        error = string( file.writing ? "unable to write " :
+                        "unable to read " ) + file.path + ": " +
+            strerror( file.result );
+        file.result = 0;
+        return false;
+    }
+    return true;
+}
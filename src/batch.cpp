@@ -0,0 +1,601 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the batch mode of image_operations, which handles many
+* images in one run, part of it but not the library
+******************************************************************************/
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <glob.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <vector>
+#include "imageProgram.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @brief one image of a batch.
+ *****************************************************************************/
+struct batchEntry
+{
+    string input; /*!< the path of the input image */
+    string output; /*!< the path of the output image without its extension */
+};
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function returns the name of a file without its directory or its
+ * extension, used to name the output of an image found by a pattern.
+ *
+ * @param[in] path - the path of the file
+ *
+ * @returns the name of the file without its directory or extension
+ *****************************************************************************/
+static string fileStem( const string &path )
+{
+    size_t slash = path.find_last_of( '/' );
+    string name = slash == string::npos ? path : path.substr( slash + 1 );
+    size_t dot = name.find_last_of( '.' );
+
+    return dot == string::npos || dot == 0 ? name : name.substr( 0, dot );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads a manifest naming the images of a batch, one per
+ * line. A line holds the input path, optionally followed by the output
+ * path without its extension; the two are separated by a tab, or by spaces
+ * when the line has no tab. An image without an output path is written to
+ * the output directory under the name of its input. Blank lines and lines
+ * starting with # are skipped.
+ *
+ * @param[in] path - the path of the manifest
+ * @param[in] outDir - the directory of outputs not named by the manifest
+ * @param[out] entries - the images of the batch, in the order listed
+ * @param[out] error - a description of the problem when the manifest can
+ * not be read
+ *
+ * @returns true - the manifest was read
+ * @returns false - the manifest could not be opened
+ *****************************************************************************/
+static bool readManifest( const string &path, const string &outDir,
+                          vector<batchEntry> &entries, string &error )
+{
+    ifstream manifest( path );
+    string line, blanks = " \t\r";
+    size_t first, last, split;
+    batchEntry entry;
+
+    if( !manifest.is_open( ) )
+    {
+        error = "unable to open the manifest " + path;
+        return false;
+    }
+
+    while( getline( manifest, line ) )
+    {
+        first = line.find_first_not_of( blanks );
+        if( first == string::npos || line[first] == '#' )
+        {
+            continue;
+        }
+        last = line.find_last_not_of( blanks );
+        line = line.substr( first, last - first + 1 );
+
+        split = line.find( '\t' );
+        if( split == string::npos )
+        {
+            split = line.find_first_of( blanks );
+        }
+        entry.input = line.substr( 0, split );
+        if( split == string::npos )
+        {
+            entry.output = outDir + "/" + fileStem( entry.input );
+        }
+        else
+        {
+            entry.output = line.substr( line.find_first_not_of( blanks,
+                                                                split ) );
+        }
+        entries.push_back( entry );
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function lists the images of a batch. The source is a directory,
+ * whose .ppm files are taken; a pattern holding *, ?, or [, whose matches
+ * are taken; or otherwise a manifest read by readManifest. The outputs of
+ * images found in a directory or by a pattern are written to the output
+ * directory under the names of their inputs.
+ *
+ * @param[in] source - the directory, pattern, or manifest
+ * @param[in] outDir - the directory receiving the outputs
+ * @param[out] entries - the images of the batch
+ * @param[out] error - a description of the problem when the images can not
+ * be listed
+ *
+ * @returns true - the images were listed
+ * @returns false - the manifest could not be opened or the pattern is
+ * invalid
+ *****************************************************************************/
+static bool batchEntries( const string &source, const string &outDir,
+                          vector<batchEntry> &entries, string &error )
+{
+    struct stat status;
+    string pattern = source;
+    glob_t matches;
+    batchEntry entry;
+    size_t i;
+    int result;
+
+    if( stat( source.c_str( ), &status ) == 0 && S_ISDIR( status.st_mode ) )
+    {
+        pattern = source + "/*.ppm";
+    }
+    else if( pattern.find_first_of( "*?[" ) == string::npos )
+    {
+        return readManifest( source, outDir, entries, error );
+    }
+
+    result = glob( pattern.c_str( ), 0, nullptr, &matches );
+    if( result != 0 && result != GLOB_NOMATCH )
+    {
+        error = "unable to search for " + pattern;
+        return false;
+    }
+    for( i = 0; result == 0 && i < matches.gl_pathc; i++ )
+    {
+        entry.input = matches.gl_pathv[i];
+        entry.output = outDir + "/" + fileStem( entry.input );
+        entries.push_back( entry );
+    }
+    globfree( &matches );
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the pixels of an image of a batch, or of a request
+ * to the server, with read and adds the image to the statistics only if
+ * it was read, so the pixels and bytes counted do not depend on how the
+ * file was brought in.
+ *
+ * @param[in, out] imageFile - the file, unused when the image is mapped
+ * @param[in, out] specifications - the image whose header has been read
+ * @param[in] steps - the operations to perform, in order
+ * @param[in] path - the path of the input image file, or nullptr when the
+ * image is mapped
+ * @param[in, out] stats - the statistics of the images
+ * @param[out] error - a description of the problem when the image could
+ * not be read
+ *
+ * @returns true - the image was read
+ * @returns false - the image could not be read
+ *****************************************************************************/
+static bool decodeImage( ifstream &imageFile, image &specifications,
+                         const vector<operationStep> &steps,
+                         const char *path, runStats &stats, string &error )
+{
+    if( !read( imageFile, specifications, steps, error ) )
+    {
+        return false;
+    }
+    countImage( stats, specifications, path );
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function handles one image of a batch, or of a request to the
+ * server, the way image_operations handles a single image: the input is
+ * mapped, or read as a stream when it can not be, then read, operated on,
+ * and written with read, performOperation, and write. Unlike a single
+ * image, a problem is described in the error instead of ending the
+ * program. The partial output is removed, and whatever the image holds is
+ * released so the next one starts clean. The times of the stages and the
+ * bytes handled are added to the statistics of the image.
+ *
+ * @param[in] input - the path of the input image
+ * @param[in] output - the path of the output image without its extension
+ * @param[in] options - the structure holding the border mode
+ * @param[in] steps - the operations to perform, in order
+ * @param[in] grayCheck - a boolean specifying wether the output is gray
+ * @param[in] asciiCheck - a boolean specifying wether the output is written
+ * as Ascii text or binary bytes
+ * @param[in, out] stats - the statistics of the image
+ * @param[out] error - a description of the problem when the image could
+ * not be handled
+ *
+ * @returns true - the output was written
+ * @returns false - the image could not be read or written
+ *****************************************************************************/
+bool processImageFile( const string &input, const string &output,
+                       const runOptions &options,
+                       const vector<operationStep> &steps, bool grayCheck,
+                       bool asciiCheck, runStats &stats, string &error )
+{
+    // variables
+    image specifications;
+    ifstream imageFile;
+    ofstream writeFile;
+    string outFileName = output + ( grayCheck ? ".pgm" : ".ppm" );
+    bool written = false;
+
+    specifications.rows = specifications.cols = 0;
+    specifications.border = options.border;
+
+    {
+        TIME_STAGE( stats.open );
+
+        // map the image into memory, falling back to reading it as a stream
+        if( !mapImage( input.c_str( ), specifications ) )
+        {
+            imageFile.open( input, ios::in | ios::binary );
+            if( !imageFile.is_open( ) )
+            {
+                error = "unable to open";
+                return false;
+            }
+            readImageHeader( imageFile, specifications );
+        }
+
+        writeFile.open( outFileName, ios::out | ios::trunc | ios::binary );
+        if( !writeFile.is_open( ) )
+        {
+            error = "unable to open " + outFileName;
+            unmapImage( specifications );
+            return false;
+        }
+    }
+
+    {
+        TIME_STAGE( stats.read );
+        written = decodeImage( imageFile, specifications, steps,
+                               input.c_str( ), stats, error );
+    }
+    if( written )
+    {
+        {
+            TIME_STAGE( stats.operate );
+            performOperation( specifications, steps );
+        }
+        {
+            TIME_STAGE( stats.write );
+            write( writeFile, specifications, grayCheck, asciiCheck );
+            writeFile.flush( );
+        }
+        if( !writeFile )
+        {
+            error = "unable to write " + outFileName;
+            written = false;
+        }
+        stats.bytesWritten += max<streamoff>( writeFile.tellp( ), 0 );
+    }
+
+    // an output that was not written completely is removed
+    if( !written )
+    {
+        writeFile.close( );
+        remove( outFileName.c_str( ) );
+    }
+
+    // give back whatever a failed read left behind
+    free2d( specifications.red );
+    free2d( specifications.green );
+    free2d( specifications.blue );
+    free2d( specifications.gray );
+    unmapImage( specifications );
+    return written;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function handles one image of a batch whose file is being read in
+ * the background. Once the bytes have arrived, they are decoded like a
+ * memory mapped file with read, operated on with performOperation, and
+ * encoded by write into the buffer of the output, ready to be written in
+ * the background. The times of the stages are added to the statistics.
+ *
+ * @param[in, out] input - the transfer reading the image
+ * @param[in, out] output - the transfer whose buffer receives the encoded
+ * image, which must not be in flight
+ * @param[in] options - the structure holding the border mode
+ * @param[in] steps - the operations to perform, in order
+ * @param[in] grayCheck - a boolean specifying wether the output is gray
+ * @param[in] asciiCheck - a boolean specifying wether the output is written
+ * as Ascii text or binary bytes
+ * @param[in, out] stats - the statistics of the images
+ * @param[out] error - a description of the problem when the image could
+ * not be read
+ *
+ * @returns true - the output is ready to be written
+ * @returns false - the image could not be read
+ *****************************************************************************/
+static bool encodeEntry( asyncFile &input, asyncFile &output,
+                         const runOptions &options,
+                         const vector<operationStep> &steps, bool grayCheck,
+                         bool asciiCheck, runStats &stats, string &error )
+{
+    // variables
+    image specifications;
+    ifstream noFile;
+    byteSink sink( output.data );
+    ostream encoder( &sink );
+    bool ready;
+
+    specifications.rows = specifications.cols = 0;
+    specifications.border = options.border;
+
+    {
+        TIME_STAGE( stats.read );
+        ready = finishIO( input, error );
+        if( ready )
+        {
+            specifications.mapping = input.data.data( );
+            specifications.mappingSize = input.size;
+            specifications.bodyOffset = readImageHeader( input.data.data( ),
+                                                         input.size,
+                                                         specifications );
+            ready = decodeImage( noFile, specifications, steps, nullptr,
+                                 stats, error );
+        }
+    }
+    if( ready )
+    {
+        {
+            TIME_STAGE( stats.operate );
+            performOperation( specifications, steps );
+        }
+        progressIO( );
+        {
+            TIME_STAGE( stats.write );
+            output.data.clear( );
+            write( encoder, specifications, grayCheck, asciiCheck );
+            output.size = output.data.size( );
+        }
+    }
+
+    // give back whatever a failed read left behind
+    free2d( specifications.red );
+    free2d( specifications.green );
+    free2d( specifications.blue );
+    free2d( specifications.gray );
+    return ready;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function waits for the output of an image of a batch to be written,
+ * removing it if it was not written completely, and adds it to the
+ * statistics. A problem is reported on standard error, named by the input.
+ *
+ * @param[in, out] output - the transfer writing the image
+ * @param[in] entry - the image written
+ * @param[in, out] stats - the statistics of the images
+ * @param[in, out] report - guards standard error
+ *
+ * @returns none
+ *****************************************************************************/
+static void finishEntry( asyncFile &output, const batchEntry &entry,
+                         runStats &stats, mutex &report )
+{
+    string problem;
+
+    {
+        TIME_STAGE( stats.write );
+        if( finishIO( output, problem ) )
+        {
+            stats.bytesWritten += output.size;
+            return;
+        }
+    }
+    remove( output.path.c_str( ) );
+    stats.failures++;
+
+    lock_guard<mutex> guard( report );
+    cerr << entry.input << ": " << problem << endl;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function handles images of a batch one after another on one thread
+ * of the pool, taking the next image not yet taken by another thread each
+ * time, with the files moved in the background. Two buffers are kept for
+ * the input and two for the output, so while an image is decoded,
+ * operated on, and encoded, the next image is already being read and the
+ * output of the one before is still being written. The buffers keep their
+ * size from one image to the next.
+ *
+ * @param[in] entries - the images of the batch
+ * @param[in, out] next - the next image not yet taken by a thread
+ * @param[in] options - the structure holding the border mode
+ * @param[in] steps - the operations to perform, in order
+ * @param[in] grayCheck - a boolean specifying wether the output is gray
+ * @param[in] asciiCheck - a boolean specifying wether the output is written
+ * as Ascii text or binary bytes
+ * @param[in, out] stats - the statistics of the images handled
+ * @param[in, out] report - guards standard error
+ *
+ * @returns none
+ *****************************************************************************/
+static void processLane( const vector<batchEntry> &entries,
+                         atomic<size_t> &next, const runOptions &options,
+                         const vector<operationStep> &steps, bool grayCheck,
+                         bool asciiCheck, runStats &stats, mutex &report )
+{
+    // variables
+    asyncFile inputs[2], outputs[2];
+    size_t written[2] = { SIZE_MAX, SIZE_MAX };
+    size_t current = next++, following;
+    string problem, extension = grayCheck ? ".pgm" : ".ppm";
+    int slot = 0;
+
+    if( current < entries.size( ) )
+    {
+        TIME_STAGE( stats.open );
+        startRead( inputs[slot], entries[current].input );
+    }
+    while( current < entries.size( ) )
+    {
+        // read the next image while this one is handled
+        following = next++;
+        if( following < entries.size( ) )
+        {
+            TIME_STAGE( stats.open );
+            startRead( inputs[1 - slot], entries[following].input );
+        }
+
+        // the output buffer was last used two images back
+        if( written[slot] != SIZE_MAX )
+        {
+            finishEntry( outputs[slot], entries[written[slot]], stats,
+                         report );
+            written[slot] = SIZE_MAX;
+        }
+
+        // move on the transfers in flight before the long stages
+        progressIO( );
+        stats.images++;
+        if( encodeEntry( inputs[slot], outputs[slot], options, steps,
+                         grayCheck, asciiCheck, stats, problem ) )
+        {
+            TIME_STAGE( stats.open );
+            startWrite( outputs[slot], entries[current].output + extension );
+            written[slot] = current;
+        }
+        else
+        {
+            stats.failures++;
+            lock_guard<mutex> guard( report );
+            cerr << entries[current].input << ": " << problem << endl;
+        }
+
+        slot = 1 - slot;
+        current = following;
+    }
+
+    // wait for the last outputs
+    for( slot = 0; slot < 2; slot++ )
+    {
+        if( written[slot] != SIZE_MAX )
+        {
+            finishEntry( outputs[slot], entries[written[slot]], stats,
+                         report );
+        }
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function performs the chain of operations on every image of a
+ * batch, listed by batchEntries from a directory, pattern, or manifest.
+ * The images are handed out to the threads of the pool, each thread
+ * handling one image at a time on its own. Unless the files are to be
+ * handled in place, each thread reads its next image and writes its last
+ * output in the background with processLane, through io_uring or helper
+ * threads, so the time spent waiting on the files is hidden behind the
+ * work on the images; otherwise each image is mapped and written while it
+ * is handled by processImageFile. Planes and staging buffers are reused
+ * from one image to the next. An image which can not be handled is
+ * reported on standard error, named by its input, and the batch goes on.
+ *
+ * @param[in] source - the directory, pattern, or manifest naming the images
+ * @param[in] outDir - the directory receiving outputs not named by a
+ * manifest
+ * @param[in] options - the structure holding the border mode and how the
+ * files are read and written
+ * @param[in] steps - the operations to perform, in order
+ * @param[in] grayCheck - a boolean specifying wether the output is gray
+ * @param[in] asciiCheck - a boolean specifying wether the output is written
+ * as Ascii text or binary bytes
+ * @param[in, out] stats - the statistics of the run, receiving those of
+ * every image
+ *
+ * @returns the number of images which could not be handled, or one if the
+ * images could not be listed
+ *****************************************************************************/
+int processBatch( const string &source, const string &outDir,
+                  const runOptions &options,
+                  const vector<operationStep> &steps, bool grayCheck,
+                  bool asciiCheck, runStats &stats )
+{
+    // variables
+    vector<batchEntry> entries;
+    string error;
+    mutex merge;
+
+    if( !batchEntries( source, outDir, entries, error ) )
+    {
+        cerr << "Unable to read batch: " << error << endl;
+        return 1;
+    }
+    if( entries.empty( ) )
+    {
+        cerr << "No images found in " << source << endl;
+    }
+
+    // move the files in the background, one lane of images per thread
+    if( options.io != BlockingIO )
+    {
+        atomic<size_t> next( 0 );
+
+        setIOMode( options.io );
+        parallelFor( (int) min( workerCount( ), entries.size( ) ),
+                     [&]( int lane )
+        {
+            runStats part;
+
+            processLane( entries, next, options, steps, grayCheck,
+                         asciiCheck, part, merge );
+            lock_guard<mutex> guard( merge );
+            mergeStats( stats, part );
+        } );
+        return (int) min<size_t>( stats.failures, INT_MAX );
+    }
+
+    parallelFor( (int) entries.size( ), [&]( int index )
+    {
+        runStats part;
+        string problem;
+
+        part.images = 1;
+        if( !processImageFile( entries[index].input, entries[index].output,
+                               options, steps, grayCheck, asciiCheck, part,
+                               problem ) )
+        {
+            part.failures++;
+        }
+
+        lock_guard<mutex> guard( merge );
+        mergeStats( stats, part );
+        if( !problem.empty( ) )
+        {
+            cerr << entries[index].input << ": " << problem << endl;
+        }
+    } );
+
+    return (int) min<size_t>( stats.failures, INT_MAX );
+}
@@ -0,0 +1,618 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the image_bench program which times the codecs and
+* operations of the library on synthetic images
+******************************************************************************/
+
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "netPBM.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @brief the sizes of the images timed when none are given, in megapixels.
+ *****************************************************************************/
+static const char *DEFAULT_SIZES = "1,4,16,64,200";
+
+/** ***************************************************************************
+ * @brief the most timed or untimed runs of each kernel, so their sum can
+ * not overflow.
+ *****************************************************************************/
+static const long MAX_RUNS = 100000;
+
+/** ***************************************************************************
+ * @brief the settings of a benchmark run, read from the command line.
+ *****************************************************************************/
+struct benchOptions
+{
+    vector<double> sizes; /*!< the sizes of the images, in megapixels */
+    int reps = 5; /*!< the number of timed runs of each kernel */
+    int warmups = 1; /*!< the number of untimed runs before them */
+    string filter; /*!< only kernels whose name contains this are run */
+    string jsonPath; /*!< the file receiving the results as JSON, or
+                     empty */
+};
+
+/** ***************************************************************************
+ * @brief the timings of one kernel on one image.
+ *****************************************************************************/
+struct benchResult
+{
+    string name; /*!< the name of the kernel */
+    int rows = 0; /*!< the number of rows in the image */
+    int cols = 0; /*!< the number of columns in the image */
+    size_t bytes = 0; /*!< the bytes the kernel reads in one run */
+    vector<double> seconds; /*!< the time of each timed run */
+    double mean = 0; /*!< the mean of the times */
+    double deviation = 0; /*!< the standard deviation of the times */
+    double best = 0; /*!< the shortest time */
+    double worst = 0; /*!< the longest time */
+};
+
+/** ***************************************************************************
+ * @brief a synthetic image along with copies of its planes and its encoded
+ * forms, so every run of a kernel starts from the same pixels.
+ *****************************************************************************/
+struct benchImage
+{
+    image specifications; /*!< the planes the kernels work on */
+    vector<pixel> red; /*!< the original red plane */
+    vector<pixel> green; /*!< the original green plane */
+    vector<pixel> blue; /*!< the original blue plane */
+    vector<pixel> body; /*!< the pixel data of the image as P3 or P6 */
+};
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function outputs the usage of image_bench and exits.
+ *
+ * @returns none
+ *****************************************************************************/
+static void benchUsage( )
+{
+    cout << "Usage: image_bench [-j threads] [--sizes mp,mp,...] "
+        "[--reps n] [--warmup n] [--filter name] [--json file]" << endl;
+    cout << "\t--sizes megapixels of the images, " << DEFAULT_SIZES
+        << " by default" << endl;
+    cout << "\t--reps timed runs of each kernel, 1 to " << MAX_RUNS
+        << ", 5 by default" << endl;
+    cout << "\t--warmup untimed runs before them, 0 to " << MAX_RUNS
+        << ", 1 by default" << endl;
+    cout << "\t--filter only run kernels whose name contains the text"
+        << endl;
+    cout << "\t--json write the results to a file as JSON" << endl;
+    exit( 0 );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads a comma separated list of image sizes in megapixels.
+ * The function outputs the usage and exits if a size is not a positive
+ * number.
+ *
+ * @param[in] text - the list of sizes
+ *
+ * @returns the sizes, in the order given
+ *****************************************************************************/
+static vector<double> parseSizes( const string &text )
+{
+    vector<double> sizes;
+    size_t start = 0, comma;
+    string item;
+    char *end;
+    double size;
+
+    do
+    {
+        comma = text.find( ',', start );
+        item = text.substr( start, comma == string::npos ? string::npos :
+                            comma - start );
+        size = strtod( item.c_str( ), &end );
+        if( item.empty( ) || *end != '\0' || !( size > 0 ) || size > 2000 )
+        {
+            benchUsage( );
+        }
+        sizes.push_back( size );
+        start = comma + 1;
+    } while( comma != string::npos );
+
+    return sizes;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads a whole number given to an option, with nothing
+ * before or after it. The function outputs the usage and exits if the
+ * value is not a number or is outside the limits.
+ *
+ * @param[in] value - the text of the value
+ * @param[in] low - the smallest value allowed
+ * @param[in] high - the largest value allowed
+ *
+ * @returns the value
+ *****************************************************************************/
+static int parseCount( const string &value, long low, long high )
+{
+    char *end;
+    long parsed = strtol( value.c_str( ), &end, 10 );
+
+    if( value.empty( ) || isspace( value[0] ) || *end != '\0' ||
+        parsed < low || parsed > high )
+    {
+        benchUsage( );
+    }
+    return (int) parsed;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the command line of image_bench. Every option takes
+ * a value, given as the next argument.
+ *
+ * @param[in] argc - the number of command line arguments
+ * @param[in] argv - the command line arguments
+ *
+ * @returns the settings of the run
+ *****************************************************************************/
+static benchOptions parseBenchOptions( int argc, char *argv[] )
+{
+    benchOptions options;
+    string option, value;
+    int i;
+
+    options.sizes = parseSizes( DEFAULT_SIZES );
+    for( i = 1; i < argc; i += 2 )
+    {
+        option = argv[i];
+        if( i + 1 >= argc )
+        {
+            benchUsage( );
+        }
+        value = argv[i + 1];
+
+        if( option == "--sizes" )
+        {
+            options.sizes = parseSizes( value );
+        }
+        else if( option == "--reps" )
+        {
+            options.reps = parseCount( value, 1, MAX_RUNS );
+        }
+        else if( option == "--warmup" )
+        {
+            options.warmups = parseCount( value, 0, MAX_RUNS );
+        }
+        else if( option == "--filter" )
+        {
+            options.filter = value;
+        }
+        else if( option == "--json" )
+        {
+            options.jsonPath = value;
+        }
+        else if( option == "-j" )
+        {
+            setWorkerCount( parseCount( value, 1, 1024 ) );
+        }
+        else
+        {
+            benchUsage( );
+        }
+    }
+    return options;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function builds a synthetic color image of about the given number
+ * of megapixels with a 4:3 aspect. The pixels are smooth gradients mixed
+ * with noise from a fixed seed, so every run sees the same image, the Ascii
+ * samples have a realistic mix of one, two, and three digits, and the
+ * histogram is not degenerate.
+ *
+ * @param[in] megapixels - the size of the image
+ * @param[out] bench - the image, with its planes allocated and filled
+ *
+ * @returns none
+ *****************************************************************************/
+static void makeImage( double megapixels, benchImage &bench )
+{
+    image &specifications = bench.specifications;
+    double pixels = megapixels * 1e6;
+    unsigned state = 2463534242u;
+    int i, j, noise;
+    size_t at;
+
+    specifications.encType = "P6";
+    specifications.maxValue = "255";
+    specifications.cols = max( 1, (int) lround( sqrt( pixels * 4 / 3 ) ) );
+    specifications.rows = max( 1, (int) lround( pixels /
+                                                specifications.cols ) );
+    specifications.stride = planeStride( specifications.cols );
+    allocArray( specifications.red, specifications.rows,
+                specifications.stride );
+    allocArray( specifications.green, specifications.rows,
+                specifications.stride );
+    allocArray( specifications.blue, specifications.rows,
+                specifications.stride );
+
+    bench.red.assign( (size_t) specifications.rows * specifications.stride,
+                      0 );
+    bench.green.assign( bench.red.size( ), 0 );
+    bench.blue.assign( bench.red.size( ), 0 );
+    for( i = 0; i < specifications.rows; i++ )
+    {
+        for( j = 0; j < specifications.cols; j++ )
+        {
+            // xorshift noise of up to 32 levels either way
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            noise = (int) ( state & 63 ) - 32;
+            at = (size_t) i * specifications.stride + j;
+            bench.red[at] = (pixel) min( 255, max( 0, 255 * j /
+                max( specifications.cols - 1, 1 ) + noise ) );
+            bench.green[at] = (pixel) min( 255, max( 0, 255 * i /
+                max( specifications.rows - 1, 1 ) + noise ) );
+            bench.blue[at] = (pixel) ( ( i + j ) * 7 + noise );
+        }
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function copies the original pixels back into the planes of the
+ * image and gives back any gray plane, undoing whatever a kernel did.
+ *
+ * @param[in, out] bench - the image to restore
+ *
+ * @returns none
+ *****************************************************************************/
+static void restoreImage( benchImage &bench )
+{
+    image &specifications = bench.specifications;
+
+    memcpy( specifications.red, bench.red.data( ), bench.red.size( ) );
+    memcpy( specifications.green, bench.green.data( ), bench.green.size( ) );
+    memcpy( specifications.blue, bench.blue.data( ), bench.blue.size( ) );
+    free2d( specifications.gray );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function encodes the original pixels of the image as the pixel data
+ * of a P3 or P6 file, the way the writers lay them out.
+ *
+ * @param[in, out] bench - the image, receiving the encoded data
+ * @param[in] ascii - true for P3 text, false for P6 bytes
+ *
+ * @returns none
+ *****************************************************************************/
+static void encodeImage( benchImage &bench, bool ascii )
+{
+    const image &specifications = bench.specifications;
+    size_t rowBytes = (size_t) 3 * specifications.cols, at, fill = 0;
+    int i;
+
+    bench.body.resize( rowBytes * specifications.rows * ( ascii ? 4 : 1 ) );
+    for( i = 0; i < specifications.rows; i++ )
+    {
+        at = (size_t) i * specifications.stride;
+        if( ascii )
+        {
+            fill = (pixel *) formatAscii( &bench.red[at], &bench.green[at],
+                &bench.blue[at], specifications.cols,
+                (char *) bench.body.data( ) + fill ) - bench.body.data( );
+        }
+        else
+        {
+            interleaveRGB( &bench.red[at], &bench.green[at], &bench.blue[at],
+                           bench.body.data( ) + fill, specifications.cols );
+            fill += rowBytes;
+        }
+    }
+    bench.body.resize( fill );
+    bench.body.shrink_to_fit( );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function times a kernel on an image. The image is prepared before
+ * every run, outside the timed region; the warmup runs are not counted.
+ * The mean, standard deviation, shortest, and longest times are kept with
+ * the result.
+ *
+ * @param[in] options - the number of runs
+ * @param[in, out] result - the result, named and sized by the caller,
+ * receiving the times
+ * @param[in] prepare - the untimed work done before each run
+ * @param[in] run - the work timed
+ *
+ * @returns none
+ *****************************************************************************/
+static void timeKernel( const benchOptions &options, benchResult &result,
+                        const function<void( )> &prepare,
+                        const function<void( )> &run )
+{
+    chrono::steady_clock::time_point start;
+    double sum = 0, squares = 0;
+    int k;
+
+    for( k = 0; k < options.warmups + options.reps; k++ )
+    {
+        prepare( );
+        start = chrono::steady_clock::now( );
+        run( );
+        if( k >= options.warmups )
+        {
+            result.seconds.push_back( chrono::duration<double>(
+                chrono::steady_clock::now( ) - start ).count( ) );
+        }
+    }
+
+    for( double seconds : result.seconds )
+    {
+        sum += seconds;
+    }
+    result.mean = sum / result.seconds.size( );
+    for( double seconds : result.seconds )
+    {
+        squares += ( seconds - result.mean ) * ( seconds - result.mean );
+    }
+    result.deviation = result.seconds.size( ) > 1 ?
+        sqrt( squares / ( result.seconds.size( ) - 1 ) ) : 0;
+    result.best = *min_element( result.seconds.begin( ),
+                                result.seconds.end( ) );
+    result.worst = *max_element( result.seconds.begin( ),
+                                 result.seconds.end( ) );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function outputs the result of a kernel as one line of the table:
+ * its name, the size of the image, the mean time with its deviation, and
+ * the throughput at the mean time in megapixels and gigabytes a second.
+ *
+ * @param[in] result - the result to output
+ *
+ * @returns none
+ *****************************************************************************/
+static void reportResult( const benchResult &result )
+{
+    double megapixels = (double) result.rows * result.cols / 1e6;
+    char line[160];
+
+    snprintf( line, sizeof( line ),
+              "%-14s %7.2f MP %10.3f ms +- %5.1f%% %10.1f MP/s %7.2f GB/s",
+              result.name.c_str( ), megapixels, result.mean * 1e3,
+              result.mean > 0 ? 100 * result.deviation / result.mean : 0.0,
+              megapixels / result.mean, result.bytes / result.mean / 1e9 );
+    cout << line << endl;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function writes every result to a file as a JSON document, with the
+ * number of threads and the widest instruction set in use, so runs can be
+ * compared to catch regressions.
+ *
+ * @param[in] path - the file to write
+ * @param[in] options - the settings of the run
+ * @param[in] results - the results to write
+ *
+ * @returns true - the file was written
+ * @returns false - the file could not be opened
+ *****************************************************************************/
+static bool writeJson( const string &path, const benchOptions &options,
+                       const vector<benchResult> &results )
+{
+    static const char *sets[] = { "scalar", "sse2", "ssse3", "avx2",
+                                  "avx512", "avx512vbmi" };
+    ofstream out( path, ios::out | ios::trunc );
+    int widest = Scalar;
+    size_t i, k;
+    double megapixels;
+
+    if( !out.is_open( ) )
+    {
+        return false;
+    }
+    while( widest < Avx512Vbmi &&
+           cpuSupports( (instructionSet) ( widest + 1 ) ) )
+    {
+        widest++;
+    }
+
+    out.precision( 9 );
+    out << "{\n  \"threads\": " << workerCount( ) << ",\n  \"isa\": \""
+        << sets[widest] << "\",\n  \"reps\": " << options.reps
+        << ",\n  \"warmup\": " << options.warmups
+        << ",\n  \"results\": [";
+    for( i = 0; i < results.size( ); i++ )
+    {
+        megapixels = (double) results[i].rows * results[i].cols / 1e6;
+        out << ( i == 0 ? "" : "," ) << "\n    { \"name\": \""
+            << results[i].name << "\", \"rows\": " << results[i].rows
+            << ", \"cols\": " << results[i].cols << ", \"megapixels\": "
+            << megapixels << ", \"bytes\": " << results[i].bytes
+            << ", \"mean_s\": " << results[i].mean << ", \"stddev_s\": "
+            << results[i].deviation << ", \"min_s\": " << results[i].best
+            << ", \"max_s\": " << results[i].worst << ", \"mp_per_s\": "
+            << megapixels / results[i].mean << ", \"gb_per_s\": "
+            << results[i].bytes / results[i].mean / 1e9
+            << ", \"seconds\": [";
+        for( k = 0; k < results[i].seconds.size( ); k++ )
+        {
+            out << ( k == 0 ? "" : ", " ) << results[i].seconds[k];
+        }
+        out << "] }";
+    }
+    out << "\n  ]\n}\n";
+    return (bool) out;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function times the readers, the writers, and every operation on a
+ * synthetic image of each size. The readers decode pixel data held in
+ * memory, as they do for a mapped file, and the writers write to
+ * /dev/null, so the disk does not take part. The bytes counted for a
+ * reader or writer are those of the encoded data; those counted for an
+ * operation are the three color planes it reads. Each kernel starts from
+ * the original pixels of the image. A line is output for each kernel as it
+ * finishes, and the results are written as JSON when a file is given.
+ *
+ * @param[in] argc - the number of command line arguments
+ * @param[in] argv - the command line arguments
+ *
+ * @returns 0 when every kernel was timed, 1 if the JSON could not be
+ * written
+ *****************************************************************************/
+int main( int argc, char *argv[] )
+{
+    // variables
+    benchOptions options;
+    vector<benchResult> results;
+    benchImage bench;
+    image &specifications = bench.specifications;
+    ofstream sink;
+    size_t pixels;
+    int max, min;
+    string error;
+
+    initKernels( );
+    options = parseBenchOptions( argc, argv );
+    sink.open( "/dev/null", ios::out | ios::binary );
+
+    // times a kernel unless it is filtered out
+    auto measure = [&]( const string &name, size_t bytes,
+                        const function<void( )> &prepare,
+                        const function<void( )> &run )
+    {
+        benchResult result;
+
+        if( name.find( options.filter ) == string::npos )
+        {
+            return;
+        }
+        result.name = name;
+        result.rows = specifications.rows;
+        result.cols = specifications.cols;
+        result.bytes = bytes;
+        timeKernel( options, result, prepare, run );
+        reportResult( result );
+        results.push_back( result );
+    };
+    auto restore = [&]( ) { restoreImage( bench ); };
+    auto nothing = [ ]( ) { };
+
+    for( double megapixels : options.sizes )
+    {
+        makeImage( megapixels, bench );
+        pixels = (size_t) specifications.rows * specifications.cols;
+
+        // the codecs, one encoding at a time to bound the memory held
+        encodeImage( bench, false );
+        measure( "readBinary", bench.body.size( ), nothing, [&]( )
+        {
+            readBinary( bench.body.data( ), bench.body.size( ),
+                        specifications, error );
+        } );
+        measure( "writeBinary", bench.body.size( ), restore, [&]( )
+        {
+            writeBinary( sink, specifications, false );
+            sink.flush( );
+        } );
+        encodeImage( bench, true );
+        measure( "readAscii", bench.body.size( ), nothing, [&]( )
+        {
+            readAscii( bench.body.data( ), bench.body.size( ),
+                       specifications, error );
+        } );
+        measure( "writeAscii", bench.body.size( ), restore, [&]( )
+        {
+            writeAscii( sink, specifications, false );
+            sink.flush( );
+        } );
+        vector<pixel>( ).swap( bench.body );
+
+        // the operations
+        measure( "negate", 3 * pixels, restore, [&]( )
+        {
+            _negate( specifications );
+        } );
+        measure( "brighten", 3 * pixels, restore, [&]( )
+        {
+            brighten( specifications, 40 );
+        } );
+        measure( "sharpen", 3 * pixels, restore, [&]( )
+        {
+            sharpen( specifications );
+        } );
+        measure( "smooth", 3 * pixels, restore, [&]( )
+        {
+            smooth( specifications, 1 );
+        } );
+        measure( "smooth-r8", 3 * pixels, restore, [&]( )
+        {
+            smooth( specifications, 8 );
+        } );
+        measure( "grayscale", 3 * pixels, restore, [&]( )
+        {
+            max = 0;
+            min = 255;
+            grayscale( specifications, max, min );
+        } );
+        measure( "contrast", 3 * pixels, restore, [&]( )
+        {
+            contrast( specifications, 2 );
+        } );
+        measure( "equalize", 3 * pixels, restore, [&]( )
+        {
+            equalize( specifications );
+        } );
+
+        // give the planes back before the next size
+        free2d( specifications.red );
+        free2d( specifications.green );
+        free2d( specifications.blue );
+        free2d( specifications.gray );
+        trimPlanes( );
+    }
+
+    if( !options.jsonPath.empty( ) &&
+        !writeJson( options.jsonPath, options, results ) )
+    {
+        cout << "Unable to open: " << options.jsonPath << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,360 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the image_client program which sends requests to
+* image_operations running as a server
+******************************************************************************/
+
+#include <climits>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+#include "imageProgram.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function outputs the usage of image_client and exits.
+ *
+ * @returns none
+ *****************************************************************************/
+static void clientUsage( )
+{
+    cout << "Usage: image_client socket stats" << endl;
+    cout << "       image_client socket [--inline] [--border mode] "
+        "[option ...] -o[ab] basename image.ppm" << endl;
+    cout << "\tstats output the statistics of the server" << endl;
+    cout << "\t--inline send the pixels instead of the file names" << endl;
+    cout << "\tthe options are those of image_operations" << endl;
+    exit( 0 );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function makes a path relative to the current directory absolute,
+ * since the server may run in another directory.
+ *
+ * @param[in] path - the path
+ *
+ * @returns the absolute path
+ *****************************************************************************/
+static string absolutePath( const string &path )
+{
+    char *directory;
+    string result;
+
+    if( path.empty( ) || path[0] == '/' ||
+        ( directory = getcwd( nullptr, 0 ) ) == nullptr )
+    {
+        return path;
+    }
+    result = string( directory ) + "/" + path;
+    free( directory );
+    return result;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function receives the answer to a request. The answer is a line
+ * "OK bytes [channels]" followed by that many bytes, or "ERROR" followed by
+ * the problem, which is output before the program exits.
+ *
+ * @param[in, out] reader - the socket and the bytes received from it
+ * @param[out] body - the bytes following the answer
+ * @param[out] channels - the channels of pixels sent back, or zero
+ *
+ * @returns none
+ *****************************************************************************/
+static void receiveAnswer( socketReader &reader, vector<pixel> &body,
+                           int &channels )
+{
+    string line;
+    char *end;
+    unsigned long long size;
+
+    if( !readSocketLine( reader, line ) )
+    {
+        cout << "The server closed the connection" << endl;
+        exit( 1 );
+    }
+    if( line.compare( 0, 3, "OK " ) != 0 )
+    {
+        cout << "Unable to process image: " <<
+            ( line.compare( 0, 6, "ERROR " ) == 0 ? line.substr( 6 ) : line )
+            << endl;
+        exit( 1 );
+    }
+
+    size = strtoull( line.c_str( ) + 3, &end, 10 );
+    channels = (int) strtol( end, nullptr, 10 );
+    body.resize( size );
+    if( !readSocketBytes( reader, body.data( ), size ) )
+    {
+        cout << "The server closed the connection" << endl;
+        exit( 1 );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads an image file into interleaved red, green, and blue
+ * bytes with no padding between rows, using the readers of the library.
+ *
+ * @param[in] path - the path of the image
+ * @param[out] specifications - the header of the image
+ * @param[out] pixels - the pixels of the image
+ *
+ * @returns none
+ *****************************************************************************/
+static void readPixels( const string &path, image &specifications,
+                        vector<pixel> &pixels )
+{
+    ifstream imageFile;
+    string error;
+    size_t rowBytes;
+    int i;
+
+    if( !mapImage( path.c_str( ), specifications ) )
+    {
+        imageFile.open( path, ios::in | ios::binary );
+        if( !imageFile.is_open( ) )
+        {
+            cout << "Unable to open: " << path << endl;
+            exit( 1 );
+        }
+        readImageHeader( imageFile, specifications );
+    }
+    if( !read( imageFile, specifications, vector<operationStep>( ),
+               error ) )
+    {
+        cout << "Unable to read image: " << error << endl;
+        exit( 1 );
+    }
+
+    // a mapped binary image is already interleaved
+    rowBytes = (size_t) 3 * specifications.cols;
+    pixels.resize( rowBytes * specifications.rows );
+    if( specifications.packed != nullptr )
+    {
+        copy( specifications.packed, specifications.packed + pixels.size( ),
+              pixels.begin( ) );
+    }
+    for( i = 0; specifications.packed == nullptr && i < specifications.rows;
+         i++ )
+    {
+        interleaveRGB( planeRow( specifications.red, specifications.stride,
+                                 i ),
+                       planeRow( specifications.green, specifications.stride,
+                                 i ),
+                       planeRow( specifications.blue, specifications.stride,
+                                 i ),
+                       pixels.data( ) + i * rowBytes, specifications.cols );
+    }
+    free2d( specifications.red );
+    free2d( specifications.green );
+    free2d( specifications.blue );
+    unmapImage( specifications );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function writes pixels sent back by the server to an image file,
+ * a pgm for one channel and a ppm for three, using the writers of the
+ * library.
+ *
+ * @param[in] basename - the output file without its extension
+ * @param[in, out] specifications - the header of the input image, given
+ * the planes of the output
+ * @param[in] pixels - the pixels sent back
+ * @param[in] channels - 1 for gray pixels, 3 for color
+ * @param[in] asciiCheck - true to write Ascii text, false for binary bytes
+ *
+ * @returns none
+ *****************************************************************************/
+static void writePixels( const string &basename, image &specifications,
+                         const vector<pixel> &pixels, int channels,
+                         bool asciiCheck )
+{
+    ofstream writeFile;
+    bool grayCheck = channels == 1;
+    int i, cols = specifications.cols;
+    const pixel *row;
+
+    writeFile.open( basename + ( grayCheck ? ".pgm" : ".ppm" ),
+                    ios::out | ios::trunc | ios::binary );
+    if( !writeFile.is_open( ) )
+    {
+        cout << "Unable to open: " << basename << endl;
+        exit( 1 );
+    }
+
+    specifications.maxValue = "255";
+    specifications.stride = planeStride( cols );
+    if( grayCheck )
+    {
+        allocArray( specifications.gray, specifications.rows,
+                    specifications.stride );
+    }
+    else
+    {
+        allocArray( specifications.red, specifications.rows,
+                    specifications.stride );
+        allocArray( specifications.green, specifications.rows,
+                    specifications.stride );
+        allocArray( specifications.blue, specifications.rows,
+                    specifications.stride );
+    }
+    for( i = 0; i < specifications.rows; i++ )
+    {
+        row = pixels.data( ) + (size_t) i * channels * cols;
+        if( grayCheck )
+        {
+            copy( row, row + cols, planeRow( specifications.gray,
+                                             specifications.stride, i ) );
+        }
+        else
+        {
+            deinterleaveRGB( row,
+                planeRow( specifications.red, specifications.stride, i ),
+                planeRow( specifications.green, specifications.stride, i ),
+                planeRow( specifications.blue, specifications.stride, i ),
+                cols );
+        }
+    }
+    write( writeFile, specifications, grayCheck, asciiCheck );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This is the main function of image_client, a small tool to send requests
+ * to image_operations running as a server. A request takes the options of
+ * image_operations. By default the server is given the file names, made
+ * absolute, and reads and writes the files itself. With --inline the
+ * client reads the image, sends its pixels, and writes the pixels sent
+ * back. The request stats outputs the statistics of the server. A request
+ * is sent as one line of words, so a word, or a file name given to the
+ * server, may not hold whitespace.
+ *
+ * @param[in] argc - the number of command line arguments
+ * @param[in] argv - the command line arguments
+ *
+ * @returns 0 when the request was answered, 1 when it failed
+ *****************************************************************************/
+int main( int argc, char *argv[] )
+{
+    // variables
+    vector<string> words( argv + min( argc, 2 ), argv + argc );
+    vector<pixel> pixels, body;
+    sockaddr_un address;
+    socketReader reader;
+    image specifications;
+    string line;
+    bool sendPixels = false;
+    int channels = 0;
+    size_t k;
+
+    if( argc < 3 || !socketAddress( argv[1], address ) )
+    {
+        clientUsage( );
+    }
+    if( words[0] == "--inline" )
+    {
+        sendPixels = true;
+        words.erase( words.begin( ) );
+    }
+    if( !( words.size( ) == 1 && words[0] == "stats" && !sendPixels ) &&
+        ( words.size( ) < 3 || ( words[words.size( ) - 3] != "-oa" &&
+                                 words[words.size( ) - 3] != "-ob" ) ) )
+    {
+        clientUsage( );
+    }
+
+    reader.fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( reader.fd < 0 ||
+        connect( reader.fd, (sockaddr *) &address, sizeof( address ) ) != 0 )
+    {
+        cout << "Unable to connect to: " << argv[1] << endl;
+        return 1;
+    }
+    initKernels( );
+
+    // the statistics of the server
+    if( words[0] == "stats" )
+    {
+        line = "stats\n";
+        if( !sendAll( reader.fd, line.data( ), line.size( ) ) )
+        {
+            cout << "Unable to send the request" << endl;
+            return 1;
+        }
+        receiveAnswer( reader, body, channels );
+        cout << string( body.begin( ), body.end( ) ) << endl;
+        close( reader.fd );
+        return 0;
+    }
+
+    // the request ends with the files or with the size of the pixels sent
+    // after it
+    if( sendPixels )
+    {
+        readPixels( words.back( ), specifications, pixels );
+        words.resize( words.size( ) - 3 );
+        words.push_back( "--pixels" );
+        words.push_back( to_string( specifications.cols ) );
+        words.push_back( to_string( specifications.rows ) );
+    }
+    else
+    {
+        words[words.size( ) - 2] = absolutePath( words[words.size( ) - 2] );
+        words[words.size( ) - 1] = absolutePath( words[words.size( ) - 1] );
+    }
+
+    // the server splits the line at whitespace, so a word holding any can
+    // not be sent, the files included
+    for( k = 0; k < words.size( ); k++ )
+    {
+        if( words[k].find_first_of( " \t\n\v\f\r" ) != string::npos )
+        {
+            cout << "Unable to send a request containing whitespace: \""
+                << words[k] << "\"" << endl;
+            if( !sendPixels && k + 2 >= words.size( ) )
+            {
+                cout << "Use --inline to send the pixels of the file "
+                    "instead" << endl;
+            }
+            return 1;
+        }
+        line += ( k == 0 ? "" : " " ) + words[k];
+    }
+    line += "\n";
+
+    if( !sendAll( reader.fd, line.data( ), line.size( ) ) ||
+        !sendAll( reader.fd, pixels.data( ), pixels.size( ) ) )
+    {
+        cout << "Unable to send the request" << endl;
+        return 1;
+    }
+    receiveAnswer( reader, body, channels );
+    close( reader.fd );
+
+    if( sendPixels )
+    {
+        writePixels( argv[argc - 2], specifications, body, channels,
+                     (string) argv[argc - 3] == "-oa" );
+    }
+    return 0;
+}
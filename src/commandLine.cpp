@@ -0,0 +1,408 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the functions which read the command line of the
+* image_operations program, the only part of it outside of the library
+******************************************************************************/
+
+#include <cstdlib>
+#include <vector>
+#include "imageProgram.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function outputs an error message and exits the program if the
+ * incorrect command line arguments are provided. The functions also specifies
+ * the correct arguments for the programmer.
+ *
+ * @returns none
+ *****************************************************************************/
+void usageStatement( )
+{
+    cout << "Usage: image_operations [-j threads] [--border mode] "
+        "[--pool-stats] [--stream] [--stats[=json]] [--stats-file file] "
+        "[--batch] [--io mode] [option ...] -o[ab] basename image.ppm"
+        << endl;
+    cout << "       image_operations [-j threads] [--border mode] [--stats] "
+        "--frames [option ...] -o[ab] < frames > frames" << endl;
+    cout << "       image_operations [-j threads] [--border mode] [--stats] "
+        "--serve socket" << endl;
+    cout << "\t-n negate\t-oa ascii" << endl;
+    cout << "\t-b brighten #\t-ob binary" << endl;
+    cout << "\t-p sharpen" << endl;
+    cout << "\t-s smooth [radius]" << endl;
+    cout << "\t-g grayscale" << endl;
+    cout << "\t-c contrast [percent]" << endl;
+    cout << "\t-e equalize" << endl;
+    cout << "\toptions run in the order given, -g, -c, or -e last" << endl;
+    cout << "\t-j threads, one per core by default" << endl;
+    cout << "\t--border zero|clamp|reflect|wrap, zero by default" << endl;
+    cout << "\t--pool-stats report plane allocations" << endl;
+    cout << "\t--stream hold only the rows an operation needs" << endl;
+    cout << "\t--stats[=json] report the time of each stage" << endl;
+    cout << "\t--stats-file file receives the report, stderr by default"
+        << endl;
+    cout << "\t--batch basename is a directory, image.ppm a manifest, "
+        "directory, or pattern" << endl;
+    cout << "\t--io uring|thread|sync how a batch moves files, uring by "
+        "default" << endl;
+    cout << "\t--frames read frames from stdin, write them to stdout"
+        << endl;
+    cout << "\t--serve answer requests from image_client on a socket"
+        << endl;
+    // exit without fail
+    exit( 0 );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function handles the options which come before the operation and are
+ * not part of it, and removes them from the command line arguments so the
+ * remaining arguments can be checked as before. The option -j sets the
+ * number of threads used, given either as -j 4 or -j4. The option --border
+ * sets how sharpen and smooth treat the edges of the image, given either as
+ * --border clamp or --border=clamp. The option --pool-stats reports the
+ * counts of the pool of planes when the program ends, and --stream passes
+ * the image through one row at a time. The option --stats reports the time
+ * of each stage and the data handled as text, or as JSON when given as
+ * --stats=json, on standard error or in the file named by --stats-file. A
+ * build without statistics accepts them with a warning. The option --batch
+ * handles every image named by a manifest, directory, or pattern given in
+ * place of the image, reading and writing the files in the background
+ * through io_uring or helper threads, or in place, as chosen by --io.
+ * Instead of handling an image, --frames handles a stream of images from
+ * standard input, and --serve answers requests on a Unix socket. The
+ * function will exit with a zero and output a usage statement if a value
+ * is invalid.
+ *
+ * @param[in, out] argc - an intiger containing the number of command line
+ * arguments provided, reduced by the arguments removed
+ * @param[in, out] argv - a character array containing the command line
+ * arguments provided by the programmer, with the options removed
+ * @param[in, out] options - the structure receiving the border mode,
+ * whether the pool is reported, the image streamed, a batch or frames
+ * handled, or requests served, how the files of a batch are moved, and how
+ * the statistics are reported
+ *
+ * @returns none
+ *****************************************************************************/
+void parseOptions( int &argc, char *argv[], runOptions &options )
+{
+    // variables
+    int removed = 0, threads = 0, i;
+    string option, value;
+
+    while( argc > 1 )
+    {
+        option = argv[1];
+
+        // options without a value
+        if( option == "--pool-stats" )
+        {
+            removed = 1;
+            options.poolReport = true;
+        }
+        else if( option == "--stream" )
+        {
+            removed = 1;
+            options.streaming = true;
+        }
+        else if( option == "--batch" )
+        {
+            removed = 1;
+            options.batch = true;
+        }
+        else if( option == "--frames" )
+        {
+            removed = 1;
+            options.frames = true;
+        }
+        else if( option == "--stats" || option == "--stats=text" ||
+                 option == "--stats=json" )
+        {
+            removed = 1;
+            options.statsReport = option == "--stats=json" ?
+                JsonStats : TextStats;
+        }
+        // the value either follows the option or is the next argument
+        else if( option.compare( 0, 2, "-j" ) == 0 && option.size( ) > 2 )
+        {
+            value = option.substr( 2 );
+            option = "-j";
+            removed = 1;
+        }
+        else if( option.compare( 0, 9, "--border=" ) == 0 )
+        {
+            value = option.substr( 9 );
+            option = "--border";
+            removed = 1;
+        }
+        else if( option.compare( 0, 5, "--io=" ) == 0 )
+        {
+            value = option.substr( 5 );
+            option = "--io";
+            removed = 1;
+        }
+        else if( option.compare( 0, 8, "--serve=" ) == 0 )
+        {
+            value = option.substr( 8 );
+            option = "--serve";
+            removed = 1;
+        }
+        else if( option.compare( 0, 13, "--stats-file=" ) == 0 )
+        {
+            value = option.substr( 13 );
+            option = "--stats-file";
+            removed = 1;
+        }
+        else if( option == "-j" || option == "--border" ||
+                 option == "--stats-file" || option == "--serve" ||
+                 option == "--io" )
+        {
+            if( argc <= 2 )
+            {
+                usageStatement( );
+            }
+            value = argv[2];
+            removed = 2;
+        }
+        else
+        {
+            break;
+        }
+
+        if( option == "-j" )
+        {
+            if( value.empty( ) ||
+                value.find_first_not_of( "0123456789" ) != string::npos ||
+                ( threads = atoi( value.c_str( ) ) ) < 1 || threads > 1024 )
+            {
+                usageStatement( );
+            }
+            setWorkerCount( threads );
+        }
+        else if( option == "--border" )
+        {
+            if( value == "zero" )
+            {
+                options.border = Zero;
+            }
+            else if( value == "clamp" )
+            {
+                options.border = Clamp;
+            }
+            else if( value == "reflect" )
+            {
+                options.border = Reflect;
+            }
+            else if( value == "wrap" )
+            {
+                options.border = Wrap;
+            }
+            else
+            {
+                usageStatement( );
+            }
+        }
+        else if( option == "--io" )
+        {
+            if( value == "uring" )
+            {
+                options.io = UringIO;
+            }
+            else if( value == "thread" )
+            {
+                options.io = ThreadIO;
+            }
+            else if( value == "sync" )
+            {
+                options.io = BlockingIO;
+            }
+            else
+            {
+                usageStatement( );
+            }
+        }
+        else if( option == "--serve" )
+        {
+            if( value.empty( ) )
+            {
+                usageStatement( );
+            }
+            options.serverPath = value;
+        }
+        else if( option == "--stats-file" )
+        {
+            if( value.empty( ) )
+            {
+                usageStatement( );
+            }
+            options.statsPath = value;
+            if( options.statsReport == NoStats )
+            {
+                options.statsReport = TextStats;
+            }
+        }
+
+        // shift the remaining arguments over the option
+        for( i = 1; i + removed <= argc; i++ )
+        {
+            argv[i] = argv[i + removed];
+        }
+        argc -= removed;
+    }
+
+#ifdef NO_STATS
+    // the timers were compiled out, so there is nothing to report
+    if( options.statsReport != NoStats )
+    {
+        cerr << "Statistics are not built into this image_operations"
+            << endl;
+        options.statsReport = NoStats;
+    }
+#endif
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This functions validates the number of command line arguments provided and
+ * the output option, and appends the file type of the image to the output
+ * file name. The fucntion will exit with a zero and output a usage statemet
+ * if it fails to validate.
+ *
+ * @param[in] specifications  - the structure containing the content of the
+ * image
+ * @param[in] argc - an intiger containing the number of command line
+ * arguments provided
+ * @param[in] argv - a character array containing the command line arguments
+ * provided by the programmer
+ * @param[in, out] grayCheck - a boolean specifying wether the image is going
+ * to be grayscaled or not
+ * @param[in, out] asciiCheck - a boolean specifying wether the output image
+ * is written as Ascii text or binary bytes
+ * @param[in, out] outFileName - the name of the output file to be appended to
+ * have a file type of PPM (Color) or PGM (Grayscale)
+ *
+ * @returns none
+ *****************************************************************************/
+void checkCMD( image specifications, int argc, char *argv[], bool &grayCheck,
+               bool &asciiCheck, string &outFileName )
+{
+    // variables
+    vector<operationStep> steps;
+
+    // check for proper amount of arguments
+    if( argc < 4 )
+    {
+        usageStatement( );
+    }
+
+    // the output is written as Ascii text or binary bytes
+    if( (string) argv[argc - 3] == "-oa" )
+    {
+        asciiCheck = true;
+    }
+    else if( (string) argv[argc - 3] == "-ob" )
+    {
+        asciiCheck = false;
+    }
+    else
+    {
+        usageStatement( );
+    }
+
+    // a chain ending in grayscale, contrast, or equalize writes a gray image
+    steps = operationList( argc, argv );
+    outFileName = (string) argv[argc - 2];
+    if( !steps.empty( ) && grayOperation( steps.back( ) ) )
+    {
+        outFileName += ".pgm";
+        grayCheck = true;
+    }
+    else
+    {
+        outFileName += ".ppm";
+        grayCheck = false;
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function validates the command line of a run over a stream of
+ * frames, which names no files, so the output option is the last argument
+ * and the chain of operations comes before it. The function will exit with
+ * a zero and output a usage statement if it fails to validate.
+ *
+ * @param[in] argc - an intiger containing the number of command line
+ * arguments provided
+ * @param[in] argv - a character array containing the command line arguments
+ * provided by the programmer
+ * @param[out] steps - the operations to perform, in order
+ * @param[out] grayCheck - a boolean specifying wether the frames written are
+ * gray
+ * @param[out] asciiCheck - a boolean specifying wether the frames are
+ * written as Ascii text or binary bytes
+ *
+ * @returns none
+ *****************************************************************************/
+void checkFramesCMD( int argc, char *argv[], vector<operationStep> &steps,
+                     bool &grayCheck, bool &asciiCheck )
+{
+    // variables
+    string error;
+
+    if( argc < 2 || ( (string) argv[argc - 1] != "-oa" &&
+                      (string) argv[argc - 1] != "-ob" ) )
+    {
+        usageStatement( );
+    }
+    asciiCheck = (string) argv[argc - 1] == "-oa";
+
+    if( !parseOperations( vector<string>( argv + 1, argv + argc - 1 ),
+                          steps, error ) )
+    {
+        usageStatement( );
+    }
+    grayCheck = !steps.empty( ) && grayOperation( steps.back( ) );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the chain of operations given between the program
+ * name and the output option, in the order they are to be performed, with
+ * the parser of the library. The function will exit with a zero and output
+ * a usage statement if an option or value is invalid. An empty chain
+ * outputs the data as it was read.
+ *
+ * @param[in] argc - an intiger containing the number of command line
+ * arguments provided
+ * @param[in] argv - a character array containing the command line arguments
+ * provided by the programmer
+ *
+ * @returns the operations to perform, in order
+ *****************************************************************************/
+vector<operationStep> operationList( int argc, char *argv[] )
+{
+    // variables
+    vector<operationStep> steps;
+    string error;
+
+    if( !parseOperations( vector<string>( argv + 1,
+                                          argv + max( argc - 3, 1 ) ),
+                          steps, error ) )
+    {
+        usageStatement( );
+    }
+    return steps;
+}
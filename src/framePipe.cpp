@@ -0,0 +1,516 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the frame mode of image_operations, which passes a stream
+* of images from standard input to standard output, part of it but not the
+* library
+******************************************************************************/
+
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "imageProgram.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @brief the most frames waiting between two stages of the pipeline.
+ *****************************************************************************/
+static const size_t FRAME_QUEUE = 2;
+
+/** ***************************************************************************
+ * @brief the most bytes read at once while looking for the end of an Ascii
+ * frame.
+ *****************************************************************************/
+static const size_t FRAME_BLOCK = 1 << 20;
+
+/** ***************************************************************************
+ * @brief the longest header, comments included, accepted for a frame.
+ *****************************************************************************/
+static const size_t HEADER_LIMIT = 1 << 16;
+
+/** ***************************************************************************
+ * @brief one image of the stream on its way through the pipeline.
+ *****************************************************************************/
+struct streamFrame
+{
+    size_t index = 0; /*!< the position of the frame in the stream, from 1 */
+    vector<pixel> bytes; /*!< the frame as read, its header and pixel data */
+    image specifications; /*!< the header and planes of the frame */
+    string error; /*!< the problem with the frame, empty if it is good */
+};
+
+/** ***************************************************************************
+ * @brief frames passed from one stage of the pipeline to the next. A stage
+ * putting a frame in waits while FRAME_QUEUE frames are already waiting.
+ *****************************************************************************/
+struct frameQueue
+{
+    mutex lock; /*!< guards the fields below */
+    condition_variable changed; /*!< signals a frame was put in or taken */
+    deque<streamFrame> frames; /*!< the frames waiting, oldest first */
+    bool closed = false; /*!< true once no more frames will be put in */
+};
+
+/** ***************************************************************************
+ * @brief the bytes read from standard input and not yet part of a frame.
+ *****************************************************************************/
+struct frameReader
+{
+    int fd = STDIN_FILENO; /*!< the stream of frames */
+    vector<pixel> buffer; /*!< the bytes read */
+    size_t fill = 0; /*!< one past the last byte read */
+    bool ended = false; /*!< true once the stream has no more bytes */
+};
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function puts a frame at the end of a queue, waiting while the
+ * queue is full.
+ *
+ * @param[in, out] queue - the queue
+ * @param[in, out] frame - the frame, moved into the queue
+ *
+ * @returns none
+ *****************************************************************************/
+static void pushFrame( frameQueue &queue, streamFrame &frame )
+{
+    unique_lock<mutex> guard( queue.lock );
+
+    queue.changed.wait( guard, [&] { return queue.frames.size( ) <
+                                            FRAME_QUEUE; } );
+    queue.frames.push_back( move( frame ) );
+    queue.changed.notify_all( );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function takes the oldest frame from a queue, waiting while the
+ * queue is empty and still open.
+ *
+ * @param[in, out] queue - the queue
+ * @param[out] frame - the frame taken
+ *
+ * @returns true - a frame was taken
+ * @returns false - the queue is empty and closed
+ *****************************************************************************/
+static bool popFrame( frameQueue &queue, streamFrame &frame )
+{
+    unique_lock<mutex> guard( queue.lock );
+
+    queue.changed.wait( guard, [&] { return !queue.frames.empty( ) ||
+                                            queue.closed; } );
+    if( queue.frames.empty( ) )
+    {
+        return false;
+    }
+    frame = move( queue.frames.front( ) );
+    queue.frames.pop_front( );
+    queue.changed.notify_all( );
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function closes a queue once the stage filling it is done, so the
+ * stage emptying it ends after the frames still waiting.
+ *
+ * @param[in, out] queue - the queue
+ *
+ * @returns none
+ *****************************************************************************/
+static void closeQueue( frameQueue &queue )
+{
+    lock_guard<mutex> guard( queue.lock );
+
+    queue.closed = true;
+    queue.changed.notify_all( );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads more of the stream of frames, at most the given
+ * number of bytes, growing the buffer of the reader as needed.
+ *
+ * @param[in, out] reader - the stream and the bytes read from it
+ * @param[in] wanted - the most bytes to read
+ *
+ * @returns true - more bytes were read
+ * @returns false - the stream ended or failed
+ *****************************************************************************/
+static bool fillFrameReader( frameReader &reader, size_t wanted )
+{
+    ssize_t received;
+
+    if( reader.buffer.size( ) < reader.fill + wanted )
+    {
+        reader.buffer.resize( reader.fill + wanted );
+    }
+    do
+    {
+        received = ::read( reader.fd, reader.buffer.data( ) + reader.fill,
+                           wanted );
+    } while( received < 0 && errno == EINTR );
+
+    if( received <= 0 )
+    {
+        reader.ended = true;
+        return false;
+    }
+    reader.fill += received;
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function finds where the Ascii pixel data of a frame ends, reading
+ * more of the stream until it holds every sample of the frame. The tokens
+ * are counted as the bytes arrive, so each byte is looked at about twice
+ * however the frame is split between reads.
+ *
+ * @param[in, out] reader - the stream and the bytes read from it
+ * @param[in] offset - the first byte of the pixel data
+ * @param[in] samples - the number of samples in the frame
+ * @param[out] end - one past the last byte of the frame
+ *
+ * @returns true - the end of the frame was found
+ * @returns false - the stream ended first
+ *****************************************************************************/
+static bool findAsciiFrame( frameReader &reader, size_t offset,
+                            size_t samples, size_t &end )
+{
+    const pixel *data, *last;
+    size_t scan = offset, cut;
+
+    while( true )
+    {
+        data = reader.buffer.data( );
+        last = findAsciiSamples( data + scan, data + reader.fill, samples,
+                                 reader.ended );
+        if( last != nullptr )
+        {
+            end = last - data;
+            return true;
+        }
+        if( reader.ended )
+        {
+            return false;
+        }
+
+        // count the tokens ending before the last whitespace, the token
+        // after it may continue in the bytes not yet read
+        for( cut = reader.fill; cut > scan && !isspace( data[cut - 1] );
+             cut-- )
+        {
+        }
+        if( cut > scan + 1 )
+        {
+            samples -= countAsciiSamples( data + scan, data + cut - 1 );
+            scan = cut - 1;
+        }
+        fillFrameReader( reader, FRAME_BLOCK );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the next frame of the stream. Frames follow each
+ * other with nothing but whitespace between them. The header is read like
+ * that of a mapped file, then exactly the bytes of a Binary frame are read,
+ * while the end of an Ascii frame is found by counting its samples. The
+ * bytes of the frame become its own so they can travel down the pipeline,
+ * and any bytes read past it are kept for the next one.
+ *
+ * @param[in, out] reader - the stream and the bytes read from it
+ * @param[out] frame - the frame read, with its header filled in
+ * @param[out] error - a description of the problem when the stream can not
+ * be split into frames
+ *
+ * @returns true - a frame was read
+ * @returns false - the stream ended, cleanly if error is empty
+ *****************************************************************************/
+static bool readFrame( frameReader &reader, streamFrame &frame,
+                       string &error )
+{
+    image &specifications = frame.specifications;
+    size_t start = 0, offset, samples, end;
+
+    // skip the whitespace after the last frame
+    while( true )
+    {
+        while( start < reader.fill && isspace( reader.buffer[start] ) )
+        {
+            start++;
+        }
+        if( start < reader.fill )
+        {
+            break;
+        }
+        start = reader.fill = 0;
+        if( !fillFrameReader( reader, FRAME_BLOCK ) )
+        {
+            return false;
+        }
+    }
+    if( start > 0 )
+    {
+        memmove( reader.buffer.data( ), reader.buffer.data( ) + start,
+                 reader.fill - start );
+        reader.fill -= start;
+    }
+
+    // read until the header is followed by pixel data
+    while( true )
+    {
+        specifications.comments.clear( );
+        offset = readImageHeader( reader.buffer.data( ), reader.fill,
+                                  specifications );
+        if( offset < reader.fill || reader.ended )
+        {
+            break;
+        }
+        if( reader.fill > HEADER_LIMIT )
+        {
+            error = "the header of frame " + to_string( frame.index ) +
+                " is too long";
+            return false;
+        }
+        fillFrameReader( reader, FRAME_BLOCK );
+    }
+    if( specifications.encType != "P3" && specifications.encType != "P6" )
+    {
+        error = "frame " + to_string( frame.index ) + " is " +
+            specifications.encType + ", not P3 or P6";
+        return false;
+    }
+    if( specifications.rows <= 0 || specifications.cols <= 0 )
+    {
+        error = "frame " + to_string( frame.index ) + " has no pixels";
+        return false;
+    }
+
+    // read the pixel data, only as far as the end of a Binary frame
+    samples = (size_t) 3 * specifications.rows * specifications.cols;
+    if( specifications.encType == "P6" )
+    {
+        end = offset + samples;
+        while( reader.fill < end &&
+               fillFrameReader( reader, end - reader.fill ) )
+        {
+        }
+    }
+    else if( !findAsciiFrame( reader, offset, samples, end ) )
+    {
+        end = SIZE_MAX;
+    }
+    if( end > reader.fill )
+    {
+        error = "the stream ends inside frame " + to_string( frame.index );
+        return false;
+    }
+
+    // the frame takes the buffer, and the bytes after it start a new one
+    if( end == reader.fill )
+    {
+        frame.bytes.swap( reader.buffer );
+        reader.buffer.clear( );
+    }
+    else
+    {
+        frame.bytes.assign( reader.buffer.begin( ),
+                            reader.buffer.begin( ) + end );
+        memmove( reader.buffer.data( ), reader.buffer.data( ) + end,
+                 reader.fill - end );
+    }
+    frame.bytes.resize( end );
+    reader.fill -= end;
+
+    // the frame is decoded like a memory mapped file
+    specifications.mapping = frame.bytes.data( );
+    specifications.mappingSize = end;
+    specifications.bodyOffset = offset;
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function writes an encoded frame to standard output, calling write
+ * as many times as it takes, so the frame is whole even on a pipe.
+ *
+ * @param[in] bytes - the encoded frame
+ *
+ * @returns true - every byte was written
+ * @returns false - standard output failed or was closed
+ *****************************************************************************/
+static bool writeFrame( const vector<pixel> &bytes )
+{
+    const pixel *next = bytes.data( );
+    size_t left = bytes.size( );
+    ssize_t written;
+
+    while( left > 0 )
+    {
+        written = write( STDOUT_FILENO, next, left );
+        if( written < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        if( written <= 0 )
+        {
+            return false;
+        }
+        next += written;
+        left -= written;
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function runs the chain of operations on a stream of P3 and P6
+ * frames read from standard input, writing each result to standard output
+ * in the order read. The frames pass through three stages, each on its own
+ * thread: reading and decoding, operating, and encoding and writing, with
+ * at most FRAME_QUEUE frames waiting between two stages. Each frame is
+ * encoded in memory and written to standard output in one piece, so the
+ * bytes written are counted on a pipe as well as a file. A frame is
+ * decoded while the one before it is operated on and the one before that
+ * is written, and a stage that waits for input or output leaves the thread
+ * pool to the others. A frame whose pixel data is invalid is reported on
+ * standard error and left out; a stream that can not be split into frames
+ * is reported and ends the run.
+ *
+ * @param[in] options - the structure holding the border mode
+ * @param[in] steps - the operations to perform, in order
+ * @param[in] grayCheck - a boolean specifying wether the output is gray
+ * @param[in] asciiCheck - a boolean specifying wether the output is written
+ * as Ascii text or binary bytes
+ * @param[in, out] stats - the statistics of the run, receiving those of
+ * every frame
+ *
+ * @returns the number of frames which could not be handled, counting a
+ * stream that ends early as one
+ *****************************************************************************/
+int processFrames( const runOptions &options,
+                   const vector<operationStep> &steps, bool grayCheck,
+                   bool asciiCheck, runStats &stats )
+{
+    // variables
+    frameQueue decoded, operated;
+    runStats readStats, operateStats;
+    streamFrame frame;
+    string streamError;
+    ifstream noFile;
+    vector<pixel> encoded;
+    byteSink sink( encoded );
+    ostream encoder( &sink );
+    bool writable = true;
+
+    // read and decode the frames
+    thread reading( [&]
+    {
+        frameReader reader;
+        streamFrame next;
+        size_t index = 1;
+
+        while( true )
+        {
+            next = streamFrame( );
+            next.index = index++;
+            next.specifications.border = options.border;
+            {
+                TIME_STAGE( readStats.read );
+                if( !readFrame( reader, next, streamError ) )
+                {
+                    break;
+                }
+                if( read( noFile, next.specifications, steps, next.error ) )
+                {
+                    countImage( readStats, next.specifications, nullptr );
+                }
+            }
+            readStats.images++;
+            pushFrame( decoded, next );
+        }
+        closeQueue( decoded );
+    } );
+
+    // operate on the frames decoded
+    thread operating( [&]
+    {
+        streamFrame next;
+
+        while( popFrame( decoded, next ) )
+        {
+            if( next.error.empty( ) )
+            {
+                TIME_STAGE( operateStats.operate );
+                performOperation( next.specifications, steps );
+            }
+            pushFrame( operated, next );
+        }
+        closeQueue( operated );
+    } );
+
+    // encode and write the frames in order on this thread
+    while( popFrame( operated, frame ) )
+    {
+        if( frame.error.empty( ) && writable )
+        {
+            TIME_STAGE( stats.write );
+            encoded.clear( );
+            write( encoder, frame.specifications, grayCheck, asciiCheck );
+            writable = writeFrame( encoded );
+        }
+        if( frame.error.empty( ) && writable )
+        {
+            stats.bytesWritten += encoded.size( );
+        }
+        else
+        {
+            stats.failures++;
+            cerr << "frame " << frame.index << ": " <<
+                ( frame.error.empty( ) ? "unable to write" : frame.error )
+                << endl;
+        }
+
+        // give back whatever a failed frame left behind
+        free2d( frame.specifications.red );
+        free2d( frame.specifications.green );
+        free2d( frame.specifications.blue );
+        free2d( frame.specifications.gray );
+    }
+    reading.join( );
+    operating.join( );
+
+    mergeStats( stats, readStats );
+    mergeStats( stats, operateStats );
+    if( !streamError.empty( ) )
+    {
+        cerr << "Unable to read frames: " << streamError << endl;
+        stats.failures++;
+    }
+    return (int) min<size_t>( stats.failures, INT_MAX );
+}
@@ -0,0 +1,169 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the histogram engine which counts the gray values of an
+* image and derives the point tables of the tone operations from the counts
+******************************************************************************/
+
+#include "netPBM.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function adds the gray pixels of a row to a histogram. The pixels
+ * are counted into four separate sets of bins which are summed at the end,
+ * so runs of equal values do not wait on the same counter.
+ *
+ * @param[in] gray - the gray pixels of the row
+ * @param[in] cols - the number of pixels in the row
+ * @param[in, out] counts - the histogram the row is added to
+ *
+ * @returns none
+ *****************************************************************************/
+void countGrayRow( const pixel *gray, int cols, histogram &counts )
+{
+    // variables
+    unsigned partial[4][256] = { };
+    int j, v;
+
+    for( j = 0; j + 4 <= cols; j += 4 )
+    {
+        partial[0][gray[j]]++;
+        partial[1][gray[j + 1]]++;
+        partial[2][gray[j + 2]]++;
+        partial[3][gray[j + 3]]++;
+    }
+    for( ; j < cols; j++ )
+    {
+        partial[0][gray[j]]++;
+    }
+
+    for( v = 0; v < 256; v++ )
+    {
+        counts.bins[v] += (size_t) partial[0][v] + partial[1][v] +
+            partial[2][v] + partial[3][v];
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function adds the counts of one histogram to another, used to merge
+ * the histograms kept apart by each band of rows.
+ *
+ * @param[in, out] total - the histogram receiving the counts
+ * @param[in] part - the histogram whose counts are added
+ *
+ * @returns none
+ *****************************************************************************/
+void mergeHistograms( histogram &total, const histogram &part )
+{
+    int v;
+
+    for( v = 0; v < 256; v++ )
+    {
+        total.bins[v] += part.bins[v];
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function builds the table which contrasts a gray image by stretching
+ * the range of its values to 0 to 255. The darkest and brightest percent of
+ * the pixels are clipped first: the range runs from the first value with
+ * more than that share of the pixels at or below it to the last value with
+ * more than that share at or above it. With no clipping the range is the
+ * minimum and maximum of the image, which is the contrast operation as it
+ * has always been.
+ *
+ * @param[in] counts - the histogram of the gray image
+ * @param[in] percent - the percent of the pixels clipped at each end, from 0
+ * to 49
+ *
+ * @returns the contrast table
+ *****************************************************************************/
+pointTable stretchTable( const histogram &counts, int percent )
+{
+    // variables
+    size_t total = 0, clipped, seen;
+    int v, low = 255, high = 0;
+
+    for( v = 0; v < 256; v++ )
+    {
+        total += counts.bins[v];
+    }
+    clipped = total * percent / 100;
+
+    // find the first and last values past the clipped pixels
+    for( v = 0, seen = 0; v < 256; v++ )
+    {
+        seen += counts.bins[v];
+        if( seen > clipped )
+        {
+            low = v;
+            break;
+        }
+    }
+    for( v = 255, seen = 0; v >= 0; v-- )
+    {
+        seen += counts.bins[v];
+        if( seen > clipped )
+        {
+            high = v;
+            break;
+        }
+    }
+
+    return contrastTable( high, low );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function builds the table which equalizes the histogram of a gray
+ * image, spreading its values so each output value holds about the same
+ * number of pixels. Each value is mapped through the cumulative count of
+ * the pixels at or below it, scaled so the darkest value present becomes 0
+ * and the brightest 255, and rounded to the nearest value. An image of a
+ * single value is left unchanged.
+ *
+ * @param[in] counts - the histogram of the gray image
+ *
+ * @returns the equalization table
+ *****************************************************************************/
+pointTable equalizeTable( const histogram &counts )
+{
+    // variables
+    pointTable table = identityTable( );
+    size_t total = 0, first = 0, seen = 0, range;
+    int v;
+
+    for( v = 0; v < 256; v++ )
+    {
+        total += counts.bins[v];
+        if( first == 0 )
+        {
+            first = counts.bins[v];
+        }
+    }
+    range = total - first;
+    if( range == 0 )
+    {
+        return table;
+    }
+
+    for( v = 0; v < 256; v++ )
+    {
+        seen += counts.bins[v];
+        table.map[v] = seen <= first ? 0 :
+            ( ( seen - first ) * 255 + range / 2 ) / range;
+    }
+    table.identity = false;
+    return table;
+}
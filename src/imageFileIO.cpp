@@ -4,222 +4,226 @@
 * @brief contains functions that read and write files both binary and ascii
 ******************************************************************************/
 
+#include <cstdlib>
+#include <vector>
 #include "netPBM.h"
 using namespace std;
 
+/** ***************************************************************************
+ * @brief the number of bytes of binary pixel data read from the image file
+ * with each call to read.
+ *****************************************************************************/
+static const int READ_BLOCK = 1 << 20;
+
+/** ***************************************************************************
+ * @brief the most bytes of Ascii text formatted before they are written to
+ * the output file.
+ *****************************************************************************/
+static const int WRITE_BLOCK = 1 << 22;
+
 /** ***************************************************************************
  * @author Cameron Custer
  *
  * @par Description:
- * This function outputs an error message and exits the program if the
- * incorrect command line arguments are provided. The functions also specifies
- * the correct arguments for the programmer.
+ * This function determines how many rows of an image make up a band of
+ * about the given number of bytes. A band always holds at least one row and
+ * never more rows than the image.
+ *
+ * @param[in] rowBytes - the number of bytes in each row
+ * @param[in] rows - the number of rows in the image
+ * @param[in] block - the number of bytes wanted in a band
  *
- * @returns none
+ * @returns the number of rows in a band
  *****************************************************************************/
-void usageStatement( )
+static int bandRows( size_t rowBytes, int rows, size_t block )
 {
-    cout << "Usage: image_operations [option] -o[ab] basename image.ppm" << endl;
-    cout << "\t-n negate\t-oa ascii" << endl;
-    cout << "\t-b brighten #\t-ob binary" << endl;
-    cout << "\t-p sharpen" << endl;
-    cout << "\t-s smooth" << endl;
-    cout << "\t-g grayscale" << endl;
-    cout << "\t-c contrast" << endl;
-    // exit without fail
-    exit( 0 );
+    return (int) min<size_t>( max<size_t>( block / max<size_t>( rowBytes, 1 ),
+                                           1 ), max( rows, 1 ) );
 }
 
 /** ***************************************************************************
  * @author Cameron Custer
  *
  * @par Description:
- * This functions validates the number of command line arguments provided and
- * appends the file type of the image to the output file name. The fucntion
- * will exit with a zero and output a usage statemet if it fails to validate.
- *
- * @param[in] specifications  - the structure containing the content of the
- * image
- * @param[in] argc - an intiger containing the number of command line
- * arguments provided
- * @param[in] argv - a character array containing the command line arguments
- * provided by the programmer
- * @param[in, out] grayCheck - a boolean specifying wether the image is going
- * to be grayscaled or not
- * @param[in, out] outFileName - the name of the output file to be appended to
- * have a file type of PPM (Color) or PGM (Grayscale)
- *
- * @returns none
+ * This function checks for an operation which changes the image to gray
+ * and so must end a chain.
+ *
+ * @param[in] step - the operation to check
+ *
+ * @returns true if the operation is grayscale, contrast, or equalize
  *****************************************************************************/
-void checkCMD( image specifications, int argc, char *argv[], bool &grayCheck,
-               string &outFileName )
+bool grayOperation( const operationStep &step )
 {
-    // check for proper amount of arguments
-    if( argc < 4 || argc > 6 )
-    {
-        usageStatement( );
-    }
-    // see if an operations was give and add extenstsion
-    else if( argc == 5 )
-    {
-        outFileName = (string) argv[argc - 2];
-        if( (string) argv[argc - 4] == "-g" ||
-            (string) argv[argc - 4] == "-c" )
-        {
-            outFileName += ".pgm";
-            grayCheck = true;
-        }
-        else
-        {
-            outFileName += ".ppm";
-            grayCheck = false;
-        }
-    }
-    // no operations, just add extension
-    else
-    {
-        outFileName = (string) argv[argc - 2];
-        outFileName += ".ppm";
-        grayCheck = false;
-    }
+    return step.op == Grayscale || step.op == Contrast || step.op == Equalize;
 }
 
 /** ***************************************************************************
  * @author Cameron Custer
  *
  * @par Description:
- * This function checks the operation type and returns the
- * enumerated operation type, based on the command line arguments provided.
- * The function will exit if an invalid argument is given or return none if
- * there is no operation specified.
- *
- * @param[in] specifications  - the structure containing the content of the
- * image
- * @param[in] argc - an intiger containing the number of command line
- * arguments provided
- * @param[in] argv - a character array containing the command line arguments
- * provided by the programmer
- *
- * @returns Negate - negate is the operation
- * @returns Brighten - brigthen is the operaiton
- * @returns Sharpen - sharpen is the operation
- * @returns Smooth - smooth is the operation
- * @returns Grayscale - grayscale is the operation
- * @returns Contrast - contrast is the operation
- * @returns None - there is no operation
+ * This function describes Binary pixel data that ends before the last
+ * pixel of the image, in the words the Ascii decoder uses for a short
+ * image.
+ *
+ * @param[in] found - the number of bytes of pixel data present
+ * @param[in] specifications - the header of the image
+ *
+ * @returns the description of the problem
  *****************************************************************************/
-operation operationType( image specifications, int argc, char *argv[] )
+static string shortBinary( size_t found, const image &specifications )
 {
-    // check the operation specified by the command line
-    if( (string) argv[argc - 4] == "-n" )
-    {
-        return Negate;
-    }
-    else if( argc == 6 )
-    {
-        if( (string) argv[argc - 5] == "-b" )
-        {
-            return Brighten;
-        }
-        else
-        {
-            usageStatement( );
-        }
-    }
-    else if( (string) argv[argc - 4] == "-p" )
-    {
-        return Sharpen;
-    }
-    else if( (string) argv[argc - 4] == "-s" )
-    {
-        return Smooth;
-    }
-    else if( (string) argv[argc - 4] == "-g" )
-    {
-        return Grayscale;
-    }
-    else if( (string) argv[argc - 4] == "-c" )
-    {
-        return Contrast;
-    }
-    // if no operation is given return None and output the data as it was read
-    if( argc != 4 )
-    {
-        usageStatement( );
-    }
-    return None;
+    return "the image data ends after " + to_string( found ) + " of " +
+        to_string( 3 * (size_t) specifications.rows * specifications.cols ) +
+        " bytes";
 }
 
 /** ***************************************************************************
  * @author Cameron Custer
  *
  * @par Description:
- * This function dynamically allocates the 2 dimensional arrays for red,
- * green, and blue pixels. The function then calls another function to read
+ * This function dynamically allocates the aligned planes for red, green,
+ * and blue pixels. The function then calls another function to read
  * the data in Ascii or Binary based on the encoder type provided in the
- * image header.
+ * image header, from the memory mapped file when there is one and from the
+ * image file otherwise. A mapped Binary image that is only negated,
+ * brightened, or copied is not read into planes at all, the operations work
+ * on the mapped pixel bytes in place. When the output is gray and only
+ * negate and brighten come before the operation making it gray, the pixels
+ * are converted to gray as they are decoded, with the point operations
+ * applied on the way, so only the gray plane is allocated. An image which is
+ * not P3 or P6, has no pixels, holds invalid Ascii data, or whose data
+ * ends before its last pixel is reported
+ * through the error instead of being read; any planes already allocated are
+ * left for the caller to free.
  *
  * @param[in] imageFile - the input image file to provide the data
  * @param[in, out] specifications - the content of the image file in a
  * structure hosting the pixel (unsigned character) arrays to be read into
- * @param[in] argc - an intiger containing the number of command line
- * arguments provided
- * @param[in] argv - a character array containing the command line arguments
- * provided
+ * @param[in] steps - the operations which will be performed on the data
+ * @param[out] error - a description of the problem when the image can not
+ * be read
  *
- * @returns None
+ * @returns true - the image was read
+ * @returns false - the image is not supported or its data is invalid
  *****************************************************************************/
-void read( ifstream &imageFile, image &specifications,
-           int argc, char *argv[] )
+bool read( ifstream &imageFile, image &specifications,
+           const vector<operationStep> &steps, string &error )
 {
-    // allocate 2d arrays for each color
+    size_t i = 0;
+    size_t bodySize = specifications.mappingSize - specifications.bodyOffset;
+    pointTable before = identityTable( );
+
+    // only P3 and P6 images with pixels can be read
+    if( specifications.encType != "P3" && specifications.encType != "P6" )
+    {
+        error = "the format " + specifications.encType + " is not P3 or P6";
+        return false;
+    }
+    if( specifications.rows <= 0 || specifications.cols <= 0 )
+    {
+        error = "the image has no pixels";
+        return false;
+    }
+
+    // compose the point operations at the front of the chain
+    for( ; i < steps.size( ) && ( steps[i].op == Negate ||
+                                  steps[i].op == Brighten ); i++ )
+    {
+        before = composeTables( before, stepTable( steps[i] ) );
+    }
+
+    // operations on single samples can work on the mapped bytes directly
+    if( specifications.mapping != nullptr &&
+        specifications.encType == "P6" &&
+        i == steps.size( ) &&
+        bodySize >= (size_t) 3 * specifications.rows * specifications.cols )
+    {
+        specifications.packed = specifications.mapping +
+            specifications.bodyOffset;
+        return true;
+    }
+
+    // gray output with nothing but point operations before it is decoded
+    // straight into a gray plane
+    if( i + 1 == steps.size( ) && grayOperation( steps[i] ) )
+    {
+        specifications.stride = planeStride( specifications.cols );
+        allocArray( specifications.gray, specifications.rows,
+                    specifications.stride );
+        if( specifications.mapping != nullptr &&
+            specifications.encType == "P3" )
+        {
+            return readAsciiGray( specifications.mapping +
+                                  specifications.bodyOffset, bodySize,
+                                  specifications, before, error );
+        }
+        else if( specifications.mapping != nullptr )
+        {
+            return readBinaryGray( specifications.mapping +
+                                   specifications.bodyOffset, bodySize,
+                                   specifications, before, error );
+        }
+        else if( specifications.encType == "P3" )
+        {
+            return readAsciiGray( imageFile, specifications, before, error );
+        }
+        return readBinaryGray( imageFile, specifications, before, error );
+    }
+
+    // allocate a contiguous plane for each color
+    specifications.stride = planeStride( specifications.cols );
     allocArray( specifications.red, specifications.rows,
-                specifications.cols );
+                specifications.stride );
     allocArray( specifications.green, specifications.rows,
-                specifications.cols );
+                specifications.stride );
     allocArray( specifications.blue, specifications.rows,
-                specifications.cols );
+                specifications.stride );
 
     // check the encoder type of the image and read the data respectively
-    if( specifications.encType == "P3" )
+    if( specifications.mapping != nullptr )
     {
-        readAscii( imageFile, specifications );
+        if( specifications.encType == "P3" )
+        {
+            return readAscii( specifications.mapping +
+                              specifications.bodyOffset, bodySize,
+                              specifications, error );
+        }
+        return readBinary( specifications.mapping +
+                           specifications.bodyOffset, bodySize,
+                           specifications, error );
     }
-    else if( specifications.encType == "P6" )
+    else if( specifications.encType == "P3" )
     {
-        readBinary( imageFile, specifications );
+        return readAscii( imageFile, specifications, error );
     }
+    return readBinary( imageFile, specifications, error );
 }
 
 /** ***************************************************************************
  * @author Cameron Custer
  *
  * @par Description:
- * This function will write the image data in ascii or binary based on the
- * command line. The encoder type is also specified in this function, and a
- * gray array is allocated and erased if necessary. This function will also
- * free the memory from the two dimensional arrays, and if incorrect command
- * line arguments are provided then a usage statement is output and the
- * program exits with a 0.
- *
- * @param[in] writeFile - the output image file to output the data too
+ * This function will write the image data in ascii or binary. The encoder
+ * type is also specified in this function, and the gray array is erased if
+ * necessary. This function will also free the memory from the color planes.
+ *
+ * @param[in] writeFile - the output image file, or any other stream such as
+ * standard output, to output the data too
  * @param[in, out] specifications - the content of the image file in a
  * structure containing the pixel (unsigned character) arrays which are
  * written too
  * @param[in] grayCheck - a boolean specifiying wether the output image will
  * be grayscaled or not
- * @param[in] argc - an intiger containing the number of command line
- * arguments provided
- * @param[in] argv - a character array containing the command line arguments
- * provided
+ * @param[in] asciiCheck - a boolean specifying wether the output image is
+ * written as Ascii text or binary bytes
  *
  * @returns None
  *****************************************************************************/
-void write( ofstream &writeFile, image &specifications, bool grayCheck,
-            int argc, char *argv[] )
+void write( ostream &writeFile, image &specifications, bool grayCheck,
+            bool asciiCheck )
 {
-    // check the read type specified in the command line
-    if( (string) argv[argc - 3] == "-oa" )
+    // check the write type asked for
+    if( asciiCheck == true )
     {
         // set the encoder type based on the operation and file type and
         // output the data
@@ -227,7 +231,7 @@ void write( ofstream &writeFile, image &specifications, bool grayCheck,
         {
             specifications.encType = "P2";
             writeAscii( writeFile, specifications, grayCheck );
-            free2d( specifications.gray, specifications.rows );
+            free2d( specifications.gray );
         }
         else if( grayCheck == false )
         {
@@ -235,13 +239,13 @@ void write( ofstream &writeFile, image &specifications, bool grayCheck,
             writeAscii( writeFile, specifications, grayCheck );
         }
     }
-    else if( (string) argv[argc - 3] == "-ob" )
+    else
     {
         if( grayCheck == true )
         {
             specifications.encType = "P5";
             writeBinary( writeFile, specifications, grayCheck );
-            free2d( specifications.gray, specifications.rows );
+            free2d( specifications.gray );
         }
         else if( grayCheck == false )
         {
@@ -249,74 +253,32 @@ void write( ofstream &writeFile, image &specifications, bool grayCheck,
             writeBinary( writeFile, specifications, grayCheck );
         }
     }
-    // if the incorrect arguments are provided output a usage statement
-    else
-    {
-        usageStatement( );
-    }
 
-    // free the memory from the 2d arrays previously allocated dynamically
-    free2d( specifications.red, specifications.rows );
-    free2d( specifications.green, specifications.rows );
-    free2d( specifications.blue, specifications.rows );
+    // free the memory from the planes previously allocated dynamically
+    free2d( specifications.red );
+    free2d( specifications.green );
+    free2d( specifications.blue );
 }
 
 /** ***************************************************************************
  * @author Cameron Custer
  *
  * @par Description:
- * This function takes the operation value specified from the previous
- * function and perfroms the operation by calling to the operation funcitons.
- * If no operation is specified the function returns.
+ * This function takes the chain of operations read from the command line
+ * and performs them in order by calling to the operation funcitons. If no
+ * operation is specified the function returns.
  *
  * @param[in, out] specifications - the content of the image file in a
  * structure which hosts the data to be modified in the pixel (unsigned
  * character) arrays
- * @param[in] operationValue- this value is of the enumerated type operation
- * and tells the function which operaiton to perform
- * @param[in] argc - an intiger containing the number of command line
- * arguments provided
- * @param[in] argv - a character array containing the command line arguments
- * provided
+ * @param[in] steps - the operations to perform, in order
  *
  * @returns None
  *****************************************************************************/
-void performOperation( image &specifications, operation operationValue,
-                       int argc, char *argv[] )
+void performOperation( image &specifications,
+                       const vector<operationStep> &steps )
 {
-    // store the minimum and maximum values of the array for gray
-    int max = 0;
-    int min = 255;
-    // perform the operation based on the image data
-    if( operationValue == Negate )
-    {
-        _negate( specifications );
-    }
-    else if( operationValue == Brighten )
-    {
-        brighten( specifications, argc, argv );
-    }
-    else if( operationValue == Sharpen )
-    {
-        sharpen( specifications );
-    }
-    else if( operationValue == Smooth )
-    {
-        smooth( specifications );
-    }
-    else if( operationValue == Grayscale )
-    {
-        grayscale( specifications, max, min );
-    }
-    else if( operationValue == Contrast )
-    {
-        contrast( specifications );
-    }
-    // if no operation is specified just return
-    else if( operationValue == None )
-    {
-        return;
-    }
+    applyOperations( specifications, steps );
 }
 
 /** ***************************************************************************
@@ -367,36 +329,198 @@ void readImageHeader( ifstream &imageFile, image &specifications )
  * @author Cameron Custer
  *
  * @par Description:
- * This function reads the data from an Ascii (P3) type image into the
- * specifications structure. The data from the image is stored in the 2
- * dimensional arrays perviously allocated for red, green, and blue.
+ * This function reads the next whitespace separated token of an image
+ * header held in memory, skipping any whitespace in front of it.
  *
- * @param[in] imageFile - this is the input image file containing the
- * origional content of the image in Binary or Ascii
+ * @param[in] data - the bytes of the image file
+ * @param[in] size - the number of bytes in the image file
+ * @param[in, out] pos - the position to read from, left after the token
+ *
+ * @returns the token, empty if the data ran out
+ *****************************************************************************/
+static string headerToken( const pixel *data, size_t size, size_t &pos )
+{
+    size_t start;
+
+    while( pos < size && isspace( data[pos] ) )
+    {
+        pos++;
+    }
+    start = pos;
+    while( pos < size && !isspace( data[pos] ) )
+    {
+        pos++;
+    }
+    return string( data + start, data + pos );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the header of an image held in memory, such as a
+ * memory mapped file, to the image structure. The header is parsed in place
+ * following the same rules as the stream version of the function: the
+ * encoder type, the comments, the columns and rows, and the maximum value
+ * of a pixel contained in the image.
+ *
+ * @param[in] data - the bytes of the image file
+ * @param[in] size - the number of bytes in the image file
  * @param[in, out] specifications - the content of the image file in a
- * structure which contains the 2 dimensional arrays that are read into.
+ * structure which is read into
  *
- * @returns None
+ * @returns the offset of the first byte of pixel data
  *****************************************************************************/
-void readAscii( ifstream &imageFile, image &specifications )
+size_t readImageHeader( const pixel *data, size_t size,
+                        image &specifications )
 {
-    int i, j;
-    int color;
-    // read the data for as many cols and rows exist in the image
-    for( i = 0; i < specifications.rows; i++ )
+    size_t pos = 0, start;
+
+    specifications.encType = headerToken( data, size, pos );
+    pos++;
+
+    // read as many lines of comments as necessary
+    while( pos < size && data[pos] == '#' )
     {
-        for( j = 0; j < specifications.cols; j++ )
+        start = pos;
+        while( pos < size && data[pos] != '\n' )
         {
-            imageFile >> color;
-            specifications.red[i][j] = color;
+            pos++;
+        }
+        if( specifications.comments.size( ) != 0 )
+        {
+            specifications.comments += '\n';
+        }
+        specifications.comments += string( data + start, data + pos );
+        pos++;
+    }
+    // output the image data to the image structure
+    specifications.cols = atoi( headerToken( data, size, pos ).c_str( ) );
+    specifications.rows = atoi( headerToken( data, size, pos ).c_str( ) );
+    specifications.maxValue = headerToken( data, size, pos );
+    pos++;
 
-            imageFile >> color;
-            specifications.green[i][j] = color;
+    return min( pos, size );
+}
 
-            imageFile >> color;
-            specifications.blue[i][j] = color;
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function determines the largest sample value allowed in the image
+ * from the maximum value in the header. Samples are stored in one byte, so
+ * the limit is never more than 255.
+ *
+ * @param[in] specifications - the structure containing the image header
+ *
+ * @returns the largest value a sample may have
+ *****************************************************************************/
+int sampleLimit( const image &specifications )
+{
+    int maxValue = atoi( specifications.maxValue.c_str( ) );
+
+    if( maxValue <= 0 || maxValue > 255 )
+    {
+        return 255;
+    }
+    return maxValue;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the rest of the image file into memory with a single
+ * read, or a few large reads if the file can not seek.
+ *
+ * @param[in] imageFile - this is the input image file containing the
+ * origional content of the image in Binary or Ascii
+ * @param[out] body - the bytes read
+ *
+ * @returns the number of bytes read
+ *****************************************************************************/
+static size_t readBody( ifstream &imageFile, vector<pixel> &body )
+{
+    size_t size = 0;
+    streampos start, finish;
+
+    // read the rest of a seekable file with a single read
+    start = imageFile.tellg( );
+    if( start != streampos( -1 ) )
+    {
+        imageFile.seekg( 0, ios::end );
+        finish = imageFile.tellg( );
+        imageFile.seekg( start );
+        if( finish > start )
+        {
+            body.resize( finish - start );
+            imageFile.read( (char *) body.data( ), body.size( ) );
+            return imageFile.gcount( );
         }
     }
+
+    // otherwise read the remaining data one block at a time until it ends
+    do
+    {
+        body.resize( size + READ_BLOCK );
+        imageFile.read( (char *) body.data( ) + size, READ_BLOCK );
+        size += imageFile.gcount( );
+    } while( imageFile );
+
+    return size;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the data from an Ascii (P3) type image into the
+ * specifications structure. The rest of the image file is read into memory
+ * by readBody and then decoded like a memory mapped image.
+ *
+ * @param[in] imageFile - this is the input image file containing the
+ * origional content of the image in Binary or Ascii
+ * @param[in, out] specifications - the content of the image file in a
+ * structure which contains the planes that are read into.
+ * @param[out] error - a description of the problem when the data is invalid
+ *
+ * @returns true - the image was read
+ * @returns false - the data is invalid
+ *****************************************************************************/
+bool readAscii( ifstream &imageFile, image &specifications, string &error )
+{
+    vector<pixel> body;
+    size_t size = readBody( imageFile, body );
+
+    return readAscii( body.data( ), size, specifications, error );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the data from an Ascii (P3) type image held in memory
+ * into the planes perviously allocated for red, green, and blue. The samples
+ * are decoded by the Ascii tokenizer, split across all cores for large
+ * images. If the data is truncated or contains a sample that is not a
+ * number or is larger than the maximum value in the header, the problem is
+ * described in the error.
+ *
+ * @param[in] data - the pixel data of the image file
+ * @param[in] size - the number of bytes of pixel data
+ * @param[in, out] specifications - the content of the image file in a
+ * structure which contains the planes that are read into.
+ * @param[out] error - a description of the problem when the data is invalid
+ *
+ * @returns true - the image was read
+ * @returns false - the data is invalid
+ *****************************************************************************/
+bool readAscii( const pixel *data, size_t size, image &specifications,
+                string &error )
+{
+    return decodeAsciiParallel( data, data + size,
+                                sampleLimit( specifications ),
+                                specifications, error );
 }
 
 /** ***************************************************************************
@@ -404,59 +528,309 @@ void readAscii( ifstream &imageFile, image &specifications )
  *
  * @par Description:
  * This function reads the data from an Binary (P6) type image into the
- * specifications structure. The data from the image is stored in the 2
- * dimensional arrays perviously allocated for red, green, and blue.
+ * specifications structure. The pixel data is read in bands of rows of
+ * about READ_BLOCK bytes with a single call to read per band, and each row of
+ * the band is split into the red, green, and blue planes perviously
+ * allocated by the vectorized deinterleave kernel. If the file ends early
+ * the problem is described in the error.
  *
  * @param[in] imageFile - this is the input image file containing the
  * origional content of the image in Binary or Ascii
  * @param[in, out] specifications - the content of the image file in a
- * structure which contains the pixel (unsigned character) 2 dimensional
- * arrays which must be read into.
+ * structure which contains the pixel (unsigned character) planes which
+ * must be read into.
+ * @param[out] error - a description of the problem when the data is short
  *
- * @returns None
+ * @returns true - the image was read
+ * @returns false - the file ends before the last pixel
  *****************************************************************************/
-void readBinary( ifstream &imageFile, image &specifications )
+bool readBinary( ifstream &imageFile, image &specifications, string &error )
 {
-    int i, j;
-    int color;
-    // read the data for as many cols and rows exist in the image
-    for( i = 0; i < specifications.rows; i++ )
+    int i, k, band, count;
+    size_t rowBytes, bytesRead;
+
+    // the staging buffer is kept by the thread between calls, so a batch of
+    // images reuses it instead of allocating it for every file, and reached
+    // through a reference so tasks on the thread pool use the one of the
+    // calling thread
+    static thread_local vector<pixel> scratch;
+    vector<pixel> &buffer = scratch;
+
+    // size the band of rows read at once, always at least one row
+    rowBytes = (size_t) 3 * specifications.cols;
+    band = bandRows( rowBytes, specifications.rows, READ_BLOCK );
+    buffer.resize( band * rowBytes );
+
+    // read the data one band of rows at a time
+    for( i = 0; i < specifications.rows; i += band )
     {
-        for( j = 0; j < specifications.cols; j++ )
+        count = min( band, specifications.rows - i );
+        imageFile.read( (char *) buffer.data( ), count * rowBytes );
+        bytesRead = imageFile.gcount( );
+        if( bytesRead < count * rowBytes )
         {
-            imageFile.read( (char *) &color, 1 );
-            specifications.red[i][j] = color;
-
-            imageFile.read( (char *) &color, 1 );
-            specifications.green[i][j] = color;
+            error = shortBinary( i * rowBytes + bytesRead, specifications );
+            return false;
+        }
 
-            imageFile.read( (char *) &color, 1 );
-            specifications.blue[i][j] = color;
+        // split the interleaved rows into the color planes
+        for( k = 0; k < count; k++ )
+        {
+            deinterleaveRGB( buffer.data( ) + k * rowBytes,
+                planeRow( specifications.red, specifications.stride, i + k ),
+                planeRow( specifications.green, specifications.stride, i + k ),
+                planeRow( specifications.blue, specifications.stride, i + k ),
+                specifications.cols );
         }
     }
+    return true;
 }
 
 /** ***************************************************************************
  * @author Cameron Custer
  *
  * @par Description:
- * This function writes the data to an Ascii (P3) type image. This includes
- * writing the image header and all of that data, as well as the image
- * content, after being modified as specified.
+ * This function reads the data from a Binary (P6) type image held in memory
+ * into the planes perviously allocated for red, green, and blue. Each row is
+ * deinterleaved straight from the data without an intermediate copy. If the
+ * data ends early the problem is described in the error and nothing is
+ * read.
+ *
+ * @param[in] data - the pixel data of the image file
+ * @param[in] size - the number of bytes of pixel data
+ * @param[in, out] specifications - the content of the image file in a
+ * structure which contains the pixel (unsigned character) planes which
+ * must be read into.
+ * @param[out] error - a description of the problem when the data is short
  *
- * @param[in] writeFile - the output file that the data from the image
- * contained in the image structure is written too
+ * @returns true - the image was read
+ * @returns false - the data ends before the last pixel
+ *****************************************************************************/
+bool readBinary( const pixel *data, size_t size, image &specifications,
+                 string &error )
+{
+    int i;
+    size_t rowBytes = (size_t) 3 * specifications.cols;
+
+    if( size < rowBytes * specifications.rows )
+    {
+        error = shortBinary( size, specifications );
+        return false;
+    }
+    for( i = 0; i < specifications.rows; i++ )
+    {
+        deinterleaveRGB( data + i * rowBytes,
+            planeRow( specifications.red, specifications.stride, i ),
+            planeRow( specifications.green, specifications.stride, i ),
+            planeRow( specifications.blue, specifications.stride, i ),
+            specifications.cols );
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the data from an Ascii (P3) type image straight into
+ * the gray plane. The rest of the image file is read into memory by
+ * readBody and then decoded like a memory mapped image.
+ *
+ * @param[in] imageFile - this is the input image file containing the
+ * origional content of the image in Binary or Ascii
  * @param[in, out] specifications - the content of the image file in a
- * structure which contains the pixel (unsigned character) 2 dimensional
- * arrays which are written too
- * @param[in] grayCheck - a boolean value specifying wether the image
- * was grayscaled or not
+ * structure which contains the gray plane that is read into.
+ * @param[in] before - the table of the point operations applied before the
+ * conversion to gray
+ * @param[out] error - a description of the problem when the data is invalid
+ *
+ * @returns true - the image was read
+ * @returns false - the data is invalid
+ *****************************************************************************/
+bool readAsciiGray( ifstream &imageFile, image &specifications,
+                    const pointTable &before, string &error )
+{
+    vector<pixel> body;
+    size_t size = readBody( imageFile, body );
+
+    return readAsciiGray( body.data( ), size, specifications, before,
+                          error );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the data from an Ascii (P3) type image held in memory
+ * straight into the gray plane. The samples are decoded a row at a time by
+ * the Ascii tokenizer, split across all cores for large images, and each
+ * row has the point operations applied and is converted to gray while it
+ * is in the cache. If the data is truncated or contains a sample that is
+ * not a number or is larger than the maximum value in the header, the
+ * problem is described in the error.
+ *
+ * @param[in] data - the pixel data of the image file
+ * @param[in] size - the number of bytes of pixel data
+ * @param[in, out] specifications - the content of the image file in a
+ * structure which contains the gray plane that is read into.
+ * @param[in] before - the table of the point operations applied before the
+ * conversion to gray
+ * @param[out] error - a description of the problem when the data is invalid
+ *
+ * @returns true - the image was read
+ * @returns false - the data is invalid
+ *****************************************************************************/
+bool readAsciiGray( const pixel *data, size_t size, image &specifications,
+                    const pointTable &before, string &error )
+{
+    int cols = specifications.cols;
+
+    return decodeAsciiRows( data, data + size, sampleLimit( specifications ),
+                          specifications,
+                          [&]( int row, pixel *red, pixel *green,
+                               pixel *blue )
+                          {
+                              int max = 0, min = 255;
+
+                              applyTable( before, red, cols );
+                              applyTable( before, green, cols );
+                              applyTable( before, blue, cols );
+                              grayscaleRow( red, green, blue,
+                                            planeRow( specifications.gray,
+                                                      specifications.stride,
+                                                      row ),
+                                            cols, max, min );
+                          }, error );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the data from an Binary (P6) type image straight into
+ * the gray plane. The pixel data is read in bands of rows of about
+ * READ_BLOCK bytes with a single call to read per band, and the rows of the
+ * band are converted to gray on the thread pool, the point operations
+ * applied to the interleaved values first. If the file ends early the
+ * problem is described in the error.
+ *
+ * @param[in] imageFile - this is the input image file containing the
+ * origional content of the image in Binary or Ascii
+ * @param[in, out] specifications - the content of the image file in a
+ * structure which contains the gray plane that is read into.
+ * @param[in] before - the table of the point operations applied before the
+ * conversion to gray
+ * @param[out] error - a description of the problem when the data is short
+ *
+ * @returns true - the image was read
+ * @returns false - the file ends before the last pixel
+ *****************************************************************************/
+bool readBinaryGray( ifstream &imageFile, image &specifications,
+                     const pointTable &before, string &error )
+{
+    int i, band, count;
+    size_t rowBytes, bytesRead;
+
+    // kept by the thread between calls, like that of readBinary
+    static thread_local vector<pixel> scratch;
+    vector<pixel> &buffer = scratch;
+
+    // size the band of rows read at once, always at least one row
+    rowBytes = (size_t) 3 * specifications.cols;
+    band = bandRows( rowBytes, specifications.rows, READ_BLOCK );
+    buffer.resize( band * rowBytes );
+
+    // read the data one band of rows at a time
+    for( i = 0; i < specifications.rows; i += band )
+    {
+        count = min( band, specifications.rows - i );
+        imageFile.read( (char *) buffer.data( ), count * rowBytes );
+        bytesRead = imageFile.gcount( );
+        if( bytesRead < count * rowBytes )
+        {
+            error = shortBinary( i * rowBytes + bytesRead, specifications );
+            return false;
+        }
+
+        // convert the rows of the band to gray
+        parallelRows( count, [&]( int part, int first, int last )
+        {
+            int k, max = 0, min = 255;
+
+            for( k = first; k < last; k++ )
+            {
+                grayscalePackedRow( buffer.data( ) + k * rowBytes,
+                                    planeRow( specifications.gray,
+                                              specifications.stride, i + k ),
+                                    specifications.cols, before, max, min );
+            }
+        } );
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the data from a Binary (P6) type image held in memory
+ * straight into the gray plane, a band of rows per task. The point
+ * operations are applied to the interleaved values in place, which leaves
+ * the file alone since its mapping is private, and each row is then
+ * converted to gray. If the data ends early the problem is described in
+ * the error and nothing is read.
+ *
+ * @param[in, out] data - the pixel data of the image file
+ * @param[in] size - the number of bytes of pixel data
+ * @param[in, out] specifications - the content of the image file in a
+ * structure which contains the gray plane that is read into.
+ * @param[in] before - the table of the point operations applied before the
+ * conversion to gray
+ * @param[out] error - a description of the problem when the data is short
+ *
+ * @returns true - the image was read
+ * @returns false - the data ends before the last pixel
+ *****************************************************************************/
+bool readBinaryGray( pixel *data, size_t size, image &specifications,
+                     const pointTable &before, string &error )
+{
+    size_t rowBytes = (size_t) 3 * specifications.cols;
+
+    if( size < rowBytes * specifications.rows )
+    {
+        error = shortBinary( size, specifications );
+        return false;
+    }
+    parallelRows( specifications.rows, [&]( int band, int first, int last )
+    {
+        int i, max = 0, min = 255;
+
+        for( i = first; i < last; i++ )
+        {
+            grayscalePackedRow( data + i * rowBytes,
+                                planeRow( specifications.gray,
+                                          specifications.stride, i ),
+                                specifications.cols, before, max, min );
+        }
+    } );
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function writes the image header: the encoder type, any comments,
+ * the number of columns and rows, and the maximum value of a pixel.
+ *
+ * @param[in] writeFile - the output file that the header is written too
+ * @param[in] specifications - the structure containing the content of the
+ * image header
  *
  * @returns None
  *****************************************************************************/
-void writeAscii( ofstream &writeFile, image specifications, bool grayCheck )
+void writeImageHeader( ostream &writeFile, const image &specifications )
 {
-    int i, j;
     // check for comments in the header and write the data
     if( specifications.comments.size( ) == 0 )
     {
@@ -471,23 +845,72 @@ void writeAscii( ofstream &writeFile, image specifications, bool grayCheck )
             << specifications.cols << ' ' << specifications.rows << endl
             << specifications.maxValue << '\n';
     }
+}
 
-    // write the data of the image for each row in each column
-    for( i = 0; i < specifications.rows; i++ )
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function writes the data to an Ascii (P3) type image. This includes
+ * writing the image header and all of that data, as well as the image
+ * content, after being modified as specified. An image that was operated on
+ * in place is written from its interleaved bytes instead of the planes.
+ * Rows are formatted into large buffers a band at a time, the band split
+ * between threads, and the buffers are written in order so the output is
+ * the same as formatting one sample at a time.
+ *
+ * @param[in] writeFile - the output file that the data from the image
+ * contained in the image structure is written too
+ * @param[in] specifications - the content of the image file in a
+ * structure which contains the pixel (unsigned character) planes
+ * which are written
+ * @param[in] grayCheck - a boolean value specifying wether the image
+ * was grayscaled or not
+ *
+ * @returns None
+ *****************************************************************************/
+void writeAscii( ostream &writeFile, const image &specifications,
+                 bool grayCheck )
+{
+    int i, k, band, threads, count;
+    size_t rowBytes;
+
+    // a text buffer for each share of a band, kept by the thread like that
+    // of readBinary
+    static thread_local vector<vector<char>> scratch;
+    vector<vector<char>> &buffers = scratch;
+    vector<char *> ends;
+
+    writeImageHeader( writeFile, specifications );
+
+    // size the band of rows formatted at once, always at least one row, and
+    // the share of the band each thread formats
+    rowBytes = (size_t) 4 * specifications.cols * ( grayCheck ? 1 : 3 );
+    band = bandRows( rowBytes, specifications.rows, WRITE_BLOCK );
+    threads = (int) min<size_t>( workerCount( ), band );
+    buffers.resize( threads );
+    ends.resize( threads );
+    for( k = 0; k < threads; k++ )
+    {
+        buffers[k].resize( ( band + threads - 1 ) / threads * rowBytes );
+    }
+
+    // format each band in parallel and write the pieces in order
+    for( i = 0; i < specifications.rows; i += band )
     {
-        for( j = 0; j < specifications.cols; j++ )
+        count = min( band, specifications.rows - i );
+        parallelFor( threads, [&]( int k )
         {
-            if( grayCheck == true )
-            {
-                writeFile << (int) specifications.gray[i][j] << ' ';
-            }
-            else if( grayCheck == false )
-            {
-                writeFile
-                    << (int) specifications.red[i][j] << ' '
-                    << (int) specifications.green[i][j] << ' '
-                    << (int) specifications.blue[i][j] << ' ';
-            }
+            ends[k] = formatAsciiRows( specifications, grayCheck,
+                                       i + count * k / threads,
+                                       i + count * ( k + 1 ) / threads,
+                                       buffers[k].data( ) );
+        } );
+
+        for( k = 0; k < threads; k++ )
+        {
+            writeFile.write( buffers[k].data( ),
+                             ends[k] - buffers[k].data( ) );
         }
     }
 }
@@ -498,51 +921,81 @@ void writeAscii( ofstream &writeFile, image specifications, bool grayCheck )
  * @par Description:
  * This function writes the data to an Binary (P6) type image. This includes
  * writing the image header and all of that data, as well as the image
- * content, after being modified as specified.
+ * content, after being modified as specified. An image that was operated on
+ * in place is written from its interleaved bytes instead of the planes.
+ * Color rows are interleaved by the vectorized kernel and gray rows copied
+ * into a staging buffer a band at a time, and each band is written with a
+ * single call to write.
  *
  * @param[in] writeFile - the output file that the data from the image
  * contained in the image structure is written too
- * @param[in, out] specifications - the content of the image file in a
+ * @param[in] specifications - the content of the image file in a
  * structure which contains the pixel (unsigned character) arrays which the
- * function writes too
+ * function writes
  * @param[in] grayCheck - a boolean value specifying wether the image
  * was grayscaled or not
  *
  * @returns None
  *****************************************************************************/
-void writeBinary( ofstream &writeFile, image specifications, bool grayCheck )
+void writeBinary( ostream &writeFile, const image &specifications,
+                  bool grayCheck )
 {
-    int i, j;
-    // check for comments in the image header and output the data
-    if( specifications.comments.size( ) == 0 )
+    int i, k, band, count;
+    size_t rowBytes;
+    pixel *plane;
+
+    // kept by the thread between calls, like that of readBinary
+    static thread_local vector<pixel> scratch;
+    vector<pixel> &buffer = scratch;
+
+    writeImageHeader( writeFile, specifications );
+
+    // write the interleaved bytes with a single write if there are no planes
+    if( specifications.packed != nullptr )
     {
-        writeFile << specifications.encType << endl
-            << specifications.cols << ' ' << specifications.rows << endl
-            << specifications.maxValue << '\n';
+        writeFile.write( (char *) specifications.packed,
+                         (streamsize) 3 * specifications.rows *
+                         specifications.cols );
+        return;
     }
-    else
+
+    // an unpadded gray plane is already laid out like the file
+    if( grayCheck == true && specifications.stride == specifications.cols )
     {
-        writeFile << specifications.encType << endl
-            << specifications.comments << endl
-            << specifications.cols << ' ' << specifications.rows << endl
-            << specifications.maxValue << '\n';
+        writeFile.write( (char *) specifications.gray,
+                         (streamsize) specifications.rows *
+                         specifications.cols );
+        return;
     }
 
-    // write the data for image to the output file
-    for( i = 0; i < specifications.rows; i++ )
+    // stage a band of rows at a time and write each band at once
+    rowBytes = (size_t) specifications.cols * ( grayCheck ? 1 : 3 );
+    band = bandRows( rowBytes, specifications.rows, WRITE_BLOCK );
+    buffer.resize( band * rowBytes );
+    for( i = 0; i < specifications.rows; i += band )
     {
-        for( j = 0; j < specifications.cols; j++ )
+        count = min( band, specifications.rows - i );
+        for( k = 0; k < count; k++ )
         {
             if( grayCheck == true )
             {
-                writeFile.write( (char *) &specifications.gray[i][j], 1 );
+                plane = planeRow( specifications.gray, specifications.stride,
+                                  i + k );
+                copy( plane, plane + specifications.cols,
+                      buffer.begin( ) + k * rowBytes );
             }
-            else if( grayCheck == false )
+            else
             {
-                writeFile.write( (char *) &specifications.red[i][j], 1 );
-                writeFile.write( (char *) &specifications.green[i][j], 1 );
-                writeFile.write( (char *) &specifications.blue[i][j], 1 );
+                interleaveRGB(
+                    planeRow( specifications.red, specifications.stride,
+                              i + k ),
+                    planeRow( specifications.green, specifications.stride,
+                              i + k ),
+                    planeRow( specifications.blue, specifications.stride,
+                              i + k ),
+                    buffer.data( ) + k * rowBytes, specifications.cols );
             }
         }
+        writeFile.write( (char *) buffer.data( ), count * rowBytes );
     }
 }
@@ -0,0 +1,406 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the interface of the image operations library which works
+* on images held in memory owned by the caller
+******************************************************************************/
+
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+#include "netPBM.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads a chain of operations given in the same form as on
+ * the command line of image_operations, in the order they are to be
+ * performed. The brighten option must be followed by its value, limited to
+ * between -255 and 255, and the smooth option may be followed by a radius
+ * from 1 to MAX_RADIUS. The contrast option may be followed by the percent
+ * of the darkest and brightest pixels to clip, from 0 to 49. Every value
+ * must be a whole number with nothing before or after it. Grayscale,
+ * contrast, and equalize change the image to gray, so they may only end
+ * the chain.
+ *
+ * @param[in] args - the options of the chain, one per element
+ * @param[out] steps - the operations to perform, in order
+ * @param[out] error - a description of the problem when the chain is invalid
+ *
+ * @returns true - the chain was read
+ * @returns false - an option or value is invalid
+ *****************************************************************************/
+bool parseOperations( const vector<string> &args,
+                      vector<operationStep> &steps, string &error )
+{
+    // variables
+    operationStep step;
+    string option, value;
+    long parsed;
+    char *end;
+    size_t i;
+
+    steps.clear( );
+    for( i = 0; i < args.size( ); i++ )
+    {
+        option = args[i];
+        step.value = 0;
+
+        // a chain may not continue past a gray image
+        if( !steps.empty( ) && grayOperation( steps.back( ) ) )
+        {
+            error = "nothing may follow a grayscale, contrast, or equalize";
+            return false;
+        }
+
+        if( option == "-n" )
+        {
+            step.op = Negate;
+        }
+        else if( option == "-b" )
+        {
+            // the value is required and may be negative
+            if( i + 1 >= args.size( ) )
+            {
+                error = "brighten needs a value";
+                return false;
+            }
+            value = args[++i];
+            parsed = strtol( value.c_str( ), &end, 10 );
+            if( value.empty( ) || isspace( value[0] ) || *end != '\0' )
+            {
+                error = "the brighten value " + value + " is not a number";
+                return false;
+            }
+
+            // any value past 255 either way, even one too large for a long,
+            // does the same as 255
+            step.op = Brighten;
+            step.value = (int) max( -255L, min( 255L, parsed ) );
+        }
+        else if( option == "-p" )
+        {
+            step.op = Sharpen;
+        }
+        else if( option == "-s" )
+        {
+            // the smooth operation may be followed by a radius
+            step.op = Smooth;
+            step.value = 1;
+            if( i + 1 < args.size( ) && args[i + 1][0] != '-' )
+            {
+                value = args[++i];
+                parsed = strtol( value.c_str( ), &end, 10 );
+                if( value.empty( ) || isspace( value[0] ) ||
+                    *end != '\0' || parsed < 1 || parsed > MAX_RADIUS )
+                {
+                    error = "the smooth radius must be from 1 to " +
+                        to_string( MAX_RADIUS );
+                    return false;
+                }
+                step.value = (int) parsed;
+            }
+        }
+        else if( option == "-g" )
+        {
+            step.op = Grayscale;
+        }
+        else if( option == "-c" )
+        {
+            // the contrast operation may be followed by a percent to clip
+            step.op = Contrast;
+            if( i + 1 < args.size( ) && args[i + 1][0] != '-' )
+            {
+                value = args[++i];
+                parsed = strtol( value.c_str( ), &end, 10 );
+                if( value.empty( ) || isspace( value[0] ) ||
+                    *end != '\0' || parsed < 0 || parsed > 49 )
+                {
+                    error = "the contrast percent must be from 0 to 49";
+                    return false;
+                }
+                step.value = (int) parsed;
+            }
+        }
+        else if( option == "-e" )
+        {
+            step.op = Equalize;
+        }
+        else
+        {
+            error = "unknown operation " + option;
+            return false;
+        }
+        steps.push_back( step );
+    }
+
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function checks that a chain of operations built by the caller holds
+ * values parseOperations would accept.
+ *
+ * @param[in] steps - the operations to perform, in order
+ * @param[out] error - a description of the problem when the chain is invalid
+ *
+ * @returns true - the chain can be performed
+ * @returns false - an operation or value is invalid
+ *****************************************************************************/
+static bool checkOperations( const vector<operationStep> &steps,
+                             string &error )
+{
+    size_t i;
+
+    for( i = 0; i < steps.size( ); i++ )
+    {
+        if( i > 0 && grayOperation( steps[i - 1] ) )
+        {
+            error = "nothing may follow a grayscale, contrast, or equalize";
+            return false;
+        }
+        if( steps[i].op < Negate || steps[i].op >= None )
+        {
+            error = "operation " + to_string( i ) + " is not an operation";
+            return false;
+        }
+        if( steps[i].op == Smooth &&
+            ( steps[i].value < 1 || steps[i].value > MAX_RADIUS ) )
+        {
+            error = "the smooth radius must be from 1 to " +
+                to_string( MAX_RADIUS );
+            return false;
+        }
+        if( steps[i].op == Contrast &&
+            ( steps[i].value < 0 || steps[i].value > 49 ) )
+        {
+            error = "the contrast percent must be from 0 to 49";
+            return false;
+        }
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function checks that a buffer given by the caller describes an image
+ * of one byte samples with the expected number of channels, and that its
+ * rows do not overlap.
+ *
+ * @param[in] buffer - the buffer to check
+ * @param[in] channels - the number of channels the buffer must have
+ * @param[in] name - the name of the buffer used in the error
+ * @param[out] error - a description of the problem when the buffer is
+ * invalid
+ *
+ * @returns true - the buffer can be used
+ * @returns false - the buffer is invalid
+ *****************************************************************************/
+static bool checkBuffer( const imageBuffer &buffer, int channels,
+                         const string &name, string &error )
+{
+    if( buffer.data == nullptr || buffer.rows <= 0 || buffer.cols <= 0 )
+    {
+        error = "the " + name + " buffer is empty";
+        return false;
+    }
+    if( buffer.depth != 8 )
+    {
+        error = "the " + name + " buffer must have a depth of 8 bits";
+        return false;
+    }
+    if( buffer.channels != channels )
+    {
+        error = "the " + name + " buffer must have " +
+            to_string( channels ) + ( channels == 1 ? " channel" :
+                                      " channels" );
+        return false;
+    }
+    if( buffer.stride < (size_t) buffer.cols * channels )
+    {
+        error = "the stride of the " + name + " buffer is shorter than a row";
+        return false;
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function performs a chain of operations on an image held in a
+ * buffer owned by the caller and places the result in another, without
+ * touching the filesystem. The input holds interleaved red, green, and blue
+ * samples; the output holds one gray channel when the chain ends with
+ * grayscale, contrast, or equalize and three color channels otherwise, and
+ * has the same number of rows and columns. Both buffers have one byte
+ * samples and rows stride bytes apart. The output may be the input itself
+ * when their strides match; otherwise the buffers must not overlap.
+ *
+ * The image is handled the way image_operations handles a file: a chain of
+ * point operations is applied to the output rows directly, gray output
+ * with only point operations before it is converted straight into a gray
+ * plane, and anything else is split into color planes taken from the pool
+ * and given back when done. Calls from several threads may overlap; the
+ * work of each runs on the shared thread pool.
+ *
+ * @param[in] input - the image to operate on
+ * @param[in, out] output - the buffer receiving the result
+ * @param[in] steps - the operations to perform, in order
+ * @param[in] border - how sharpen and smooth treat the pixels near the edges
+ * of the image
+ * @param[out] error - a description of the problem when the image can not
+ * be processed
+ *
+ * @returns true - the result was placed in the output buffer
+ * @returns false - a buffer or operation is invalid, nothing was written
+ *****************************************************************************/
+bool processImage( const imageBuffer &input, imageBuffer &output,
+                   const vector<operationStep> &steps, borderMode border,
+                   string &error )
+{
+    // variables
+    static once_flag kernelsChosen;
+    bool gray = !steps.empty( ) && grayOperation( steps.back( ) );
+    int rows = input.rows, cols = input.cols;
+    size_t i = 0, rowBytes = (size_t) 3 * cols;
+    pointTable before = identityTable( );
+    image specifications;
+
+    if( !checkOperations( steps, error ) ||
+        !checkBuffer( input, 3, "input", error ) ||
+        !checkBuffer( output, gray ? 1 : 3, "output", error ) )
+    {
+        return false;
+    }
+    if( output.rows != rows || output.cols != cols )
+    {
+        error = "the output buffer must have the rows and columns of the "
+            "input";
+        return false;
+    }
+    call_once( kernelsChosen, initKernels );
+
+    // compose the point operations at the front of the chain
+    for( ; i < steps.size( ) && ( steps[i].op == Negate ||
+                                  steps[i].op == Brighten ); i++ )
+    {
+        before = composeTables( before, stepTable( steps[i] ) );
+    }
+
+    // a chain of point operations runs on the output rows directly
+    if( i == steps.size( ) )
+    {
+        parallelRows( rows, [&]( int band, int first, int last )
+        {
+            int r;
+            const pixel *source;
+            pixel *dest;
+
+            for( r = first; r < last; r++ )
+            {
+                source = input.data + r * input.stride;
+                dest = output.data + r * output.stride;
+                if( source != dest )
+                {
+                    copy( source, source + rowBytes, dest );
+                }
+                applyTable( before, dest, rowBytes );
+            }
+        } );
+        return true;
+    }
+
+    specifications.rows = rows;
+    specifications.cols = cols;
+    specifications.stride = planeStride( cols );
+    specifications.maxValue = "255";
+    specifications.border = border;
+
+    // gray output with nothing but point operations before it is converted
+    // straight into a gray plane, anything else is split into color planes
+    if( i + 1 == steps.size( ) && gray )
+    {
+        allocArray( specifications.gray, rows, specifications.stride );
+        parallelRows( rows, [&]( int band, int first, int last )
+        {
+            int r, max = 0, min = 255;
+            vector<pixel> row( rowBytes );
+
+            for( r = first; r < last; r++ )
+            {
+                copy( input.data + r * input.stride,
+                      input.data + r * input.stride + rowBytes,
+                      row.begin( ) );
+                grayscalePackedRow( row.data( ),
+                                    planeRow( specifications.gray,
+                                              specifications.stride, r ),
+                                    cols, before, max, min );
+            }
+        } );
+    }
+    else
+    {
+        allocArray( specifications.red, rows, specifications.stride );
+        allocArray( specifications.green, rows, specifications.stride );
+        allocArray( specifications.blue, rows, specifications.stride );
+        parallelRows( rows, [&]( int band, int first, int last )
+        {
+            int r;
+
+            for( r = first; r < last; r++ )
+            {
+                deinterleaveRGB( input.data + r * input.stride,
+                    planeRow( specifications.red, specifications.stride, r ),
+                    planeRow( specifications.green, specifications.stride,
+                              r ),
+                    planeRow( specifications.blue, specifications.stride, r ),
+                    cols );
+            }
+        } );
+    }
+
+    applyOperations( specifications, steps );
+
+    // place the result in the output buffer
+    parallelRows( rows, [&]( int band, int first, int last )
+    {
+        int r;
+        pixel *plane;
+
+        for( r = first; r < last; r++ )
+        {
+            if( gray )
+            {
+                plane = planeRow( specifications.gray, specifications.stride,
+                                  r );
+                copy( plane, plane + cols, output.data + r * output.stride );
+            }
+            else
+            {
+                interleaveRGB(
+                    planeRow( specifications.red, specifications.stride, r ),
+                    planeRow( specifications.green, specifications.stride,
+                              r ),
+                    planeRow( specifications.blue, specifications.stride, r ),
+                    output.data + r * output.stride, cols );
+            }
+        }
+    } );
+
+    // give the planes back to the pool
+    free2d( specifications.red );
+    free2d( specifications.green );
+    free2d( specifications.blue );
+    free2d( specifications.gray );
+    return true;
+}
@@ -4,92 +4,262 @@
 * @brief contains the operation functions
 ******************************************************************************/
 #include <algorithm>
+#include <cstdint>
+#include <vector>
 #include "netPBM.h"
 
+/** ***************************************************************************
+ * @brief the number of pixels of an interleaved row split into the color
+ * channels at a time when it is converted straight to gray.
+ *****************************************************************************/
+static const int GRAY_BLOCK = 1024;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function checks for a point operation, which changes each sample on
+ * its own without looking at its neighbours.
+ *
+ * @param[in] step - the operation to check
+ *
+ * @returns true if the operation is negate or brighten
+ *****************************************************************************/
+static bool pointOperation( const operationStep &step )
+{
+    return step.op == Negate || step.op == Brighten;
+}
+
 /** ***************************************************************************
  * @author Cameron Custer
  *
  * @par Description:
- * This function checks the boundry for each pixel in the 2 dimensional arrays
- * to be between 0 and 255 and sets the values of the pixels after the
- * operations for the functions brighten, sharpen, and smooth.
- *
- * @param[in, out] colorRed - the red pixel color to be given a value
- * @param[in, out] colorGreen - the green pixel color to be given a value
- * @param[in, out] colorBlue - the blue pixel color to be given a value
- * @param[in] testValueRed - the value to be set to the red pixel location
- * @param[in] testValueGreen - the value to be set to the green pixel location
- * @param[in] testValueBlue - the value to be set to the blue pixel location
- * @param[in] i - row location in two dimensional array of pixels
- * @param[in] j - column location in two dimensional array of pixels
+ * This function applies a point table to the whole image on the thread
+ * pool. Since the table holds a whole chain of point operations, a chain
+ * costs a single traversal with one lookup per sample. Each band of rows of
+ * a plane is handed to the table as one run of samples, since the padding
+ * at the end of the rows may be changed along with the pixels. An image
+ * without planes has the table applied to its interleaved bytes.
+ *
+ * @param[in, out] specifications - the structure containing the content of
+ * the image to be modified
+ * @param[in] table - the point operations to apply
  *
  * @returns none
  *****************************************************************************/
-void checkBoundry( pixel **&colorRed, pixel **&colorGreen, pixel **&colorBlue,
-                   int testValueRed, int testValueGreen,
-                   int testValueBlue, int i, int j )
+static void applyPointTable( image &specifications, const pointTable &table )
 {
-    // reset the value of a pixel to limit if out of boundry
-    if( testValueRed > 255 )
+    size_t rowBytes = (size_t) 3 * specifications.cols;
+    int stride = specifications.stride;
+
+    if( table.identity )
     {
-        testValueRed = 255;
+        return;
     }
-    if( testValueRed < 0 )
+
+    parallelRows( specifications.rows, [&]( int band, int first, int last )
     {
-        testValueRed = 0;
-    }
+        if( specifications.packed != nullptr )
+        {
+            applyTable( table, specifications.packed + first * rowBytes,
+                        ( last - first ) * rowBytes );
+        }
+        else
+        {
+            applyTable( table, planeRow( specifications.red, stride, first ),
+                        (size_t) ( last - first ) * stride );
+            applyTable( table, planeRow( specifications.green, stride,
+                                         first ),
+                        (size_t) ( last - first ) * stride );
+            applyTable( table, planeRow( specifications.blue, stride, first ),
+                        (size_t) ( last - first ) * stride );
+        }
+    } );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function negates the image for the red, green, and blue pixels in each
+ * plane by subtracting the value of the pixel from the value 255, using the
+ * negate kernel selected at startup on each band of rows.
+ *
+ * @param[in, out] specifications - the structure containing the content of the
+ * image to be modified
+ *
+ * @returns none
+ *****************************************************************************/
+void _negate( image &specifications )
+{
+    applyPointTable( specifications, stepTable( { Negate, 0 } ) );
+}
 
-    if( testValueGreen > 255 )
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function brightens the image for red, green, and blue in each pixel
+ * based on amount specified by adding a specified value to the value in the
+ * pixel, limited to between 0 and 255. The brighten kernel selected at
+ * startup is used on each band of rows, which limits the values with
+ * saturating arithmetic.
+ *
+ * @param[in, out] specifications - the structure containing the content of the
+ * image to be modified
+ * @param[in] value - the amount added to each value, which may be negative
+ *
+ * @returns none
+ *****************************************************************************/
+void brighten( image &specifications, int value )
+{
+    applyPointTable( specifications, stepTable( { Brighten, value } ) );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function finds the row or column of the image which a pixel of the
+ * halo copies, given its position outside the image. Clamp repeats the edge
+ * pixel, reflect mirrors the image about the edge pixel without repeating
+ * it, and wrap continues from the opposite edge. Positions inside the image
+ * are returned unchanged.
+ *
+ * @param[in] k - the position of the pixel, which may be negative or past
+ * the end of the image
+ * @param[in] n - the number of rows or columns in the image
+ * @param[in] mode - the border mode filling the halo
+ *
+ * @returns a position between 0 and n - 1
+ *****************************************************************************/
+static int borderIndex( int k, int n, borderMode mode )
+{
+    // variables
+    int period;
+
+    if( k >= 0 && k < n )
     {
-        testValueGreen = 255;
+        return k;
     }
-    if( testValueGreen < 0 )
+    if( mode == Wrap )
     {
-        testValueGreen = 0;
+        return ( k % n + n ) % n;
     }
-
-    if( testValueBlue > 255 )
+    if( mode == Reflect && n > 1 )
     {
-        testValueBlue = 255;
+        period = 2 * n - 2;
+        k = ( k % period + period ) % period;
+        return k < n ? k : period - k;
     }
-    if( testValueBlue < 0 )
+    return k < 0 ? 0 : n - 1;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function copies a plane into a new plane surrounded on every side by
+ * a halo of the given width, filled according to the border mode, so a
+ * stencil can read past the edges of the image without checking where it
+ * is. The padded rows are filled a band at a time on the thread pool, and
+ * the point operations coming before the stencil are applied to each row
+ * as it is filled.
+ *
+ * @param[in] source - the plane to copy
+ * @param[in] rows - the number of rows in the plane
+ * @param[in] cols - the number of columns in the plane
+ * @param[in] stride - the number of bytes between rows of the plane
+ * @param[in] halo - the width of the halo
+ * @param[in] mode - the border mode filling the halo
+ * @param[in] before - the table of the point operations applied to the
+ * padded rows
+ * @param[out] padded - the new plane, holding rows + 2 * halo rows of
+ * cols + 2 * halo pixels
+ * @param[out] paddedStride - the number of bytes between rows of the new
+ * plane
+ *
+ * @returns none
+ *****************************************************************************/
+static void padPlane( pixel *source, int rows, int cols, int stride,
+                      int halo, borderMode mode, const pointTable &before,
+                      pixel *&padded,
+                      int &paddedStride )
+{
+    paddedStride = planeStride( cols + 2 * halo );
+    allocArray( padded, rows + 2 * halo, paddedStride );
+
+    parallelRows( rows + 2 * halo, [&]( int band, int first, int last )
     {
-        testValueBlue = 0;
-    }
+        int i, j;
+        pixel *in, *out;
 
-    // initialize array values
-    colorRed[i][j] = testValueRed;
-    colorGreen[i][j] = testValueGreen;
-    colorBlue[i][j] = testValueBlue;
+        for( i = first; i < last; i++ )
+        {
+            // copy the row of the image, then extend it to each side
+            in = planeRow( source, stride,
+                           borderIndex( i - halo, rows, mode ) );
+            out = planeRow( padded, paddedStride, i ) + halo;
+            copy( in, in + cols, out );
+            for( j = 1; j <= halo; j++ )
+            {
+                out[-j] = in[borderIndex( -j, cols, mode )];
+                out[cols - 1 + j] = in[borderIndex( cols - 1 + j, cols,
+                                                    mode )];
+            }
+            applyTable( before, out - halo, cols + 2 * halo );
+        }
+    } );
 }
 
 /** ***************************************************************************
  * @author Cameron Custer
  *
  * @par Description:
- * This function negates the image for the red, green, and blue pixels in each
- * array by subtracting the value of the pixel from the value 255. It moves
- * through the arrray by specificying a row then a column in a nested for-
- * loop.
+ * This function sharpens a band of rows of one plane. Output pixel (i, j) is
+ * centered on pixel (i + 1, j + 1) of the source, whose value is multiplied
+ * by 5 before the values of the pixels directly above, below, left, and
+ * right of it are subtracted. The result is limited to between 0 and 255.
+ * The source must extend one pixel past the output on every side, so there
+ * is no check for the edges of the image and the loop has no branches.
  *
- * @param[in, out] specifications - the structure containing the content of the
- * image to be modified
+ * @param[in] source - the top left pixel read by the stencil
+ * @param[in] sourceStride - the number of bytes between rows of the source
+ * @param[out] dest - the top left pixel written
+ * @param[in] destStride - the number of bytes between rows of the output
+ * @param[in] cols - the number of columns written
+ * @param[in] radius - unused, the stencil always reaches one pixel
+ * @param[in] first - the first row of the band
+ * @param[in] last - one past the last row of the band
+ * @param[in] rowDone - called with each row once it is written, or nullptr
  *
  * @returns none
  *****************************************************************************/
-void _negate( image &specifications )
+static void sharpenFilter( pixel *source, int sourceStride, pixel *dest,
+                           int destStride, int cols, int radius, int first,
+                           int last, const function<void( int row )> *rowDone )
 {
     // variables
-    int i, j;
+    int i, j, value;
+    pixel *above, *center, *below, *out;
 
-    // negate each pixel
-    for( i = 0; i < specifications.rows; i++ )
+    for( i = first; i < last; i++ )
     {
-        for( j = 0; j < specifications.cols; j++ )
+        // locate the rows above, at, and below the pixels
+        above = planeRow( source, sourceStride, i );
+        center = above + sourceStride;
+        below = center + sourceStride;
+        out = planeRow( dest, destStride, i );
+
+        for( j = 0; j < cols; j++ )
+        {
+            value = 5 * center[j + 1] - above[j + 1] - below[j + 1] -
+                center[j] - center[j + 2];
+            out[j] = min( max( value, 0 ), 255 );
+        }
+        if( rowDone != nullptr )
         {
-            specifications.red[i][j] = 255 - specifications.red[i][j];
-            specifications.green[i][j] = 255 - specifications.green[i][j];
-            specifications.blue[i][j] = 255 - specifications.blue[i][j];
+            ( *rowDone )( i );
         }
     }
 }
@@ -98,39 +268,96 @@ void _negate( image &specifications )
  * @author Cameron Custer
  *
  * @par Description:
- * This function brightens the image for red, green, and blue in each pixel
- * based on amount specified by adding a specified value to the value in the
- * pixel. It moves through the arrray by specificying a row then a column in a
- * nested for-loop.
+ * This function applies a box filter of a given radius to a band of rows of
+ * one plane. Output pixel (i, j) is the average of the (2 * radius + 1)
+ * squared pixels of the source whose top left corner is (i, j), rounded
+ * down. The filter is separable and uses running sums so the cost per pixel
+ * does not depend on the radius: a sum for each column of the window is
+ * kept, and moving down a row adds the row entering the window and
+ * subtracts the row leaving it; along a row, the window sum adds the column
+ * sum entering it and subtracts the one leaving it. The column sums are
+ * started from the first rows of the band, so every band gives the same
+ * pixels as filtering the whole plane at once.
  *
- * @param[in, out] specifications - the structure containing the content of the
- * image to be modified
- * @param[in] argc - the number of arguments given in the command line
- * @param[in] argv - an array containing the arguments given in the command
- * prompt
+ * The division by the window area is replaced by a multiply by a fixed point
+ * reciprocal m = ceil( 2^shift / area ) followed by a shift. Since a sum is
+ * at most 255 * area and 2^shift is at least 256 * area * area, the error
+ * of the reciprocal never reaches the next integer and the result is
+ * exactly the rounded down average.
+ *
+ * @param[in] source - the top left pixel read by the filter
+ * @param[in] sourceStride - the number of bytes between rows of the source
+ * @param[out] dest - the top left pixel written
+ * @param[in] destStride - the number of bytes between rows of the output
+ * @param[in] cols - the number of columns written
+ * @param[in] radius - the number of pixels on each side of the center of
+ * the window
+ * @param[in] first - the first row of the band
+ * @param[in] last - one past the last row of the band
+ * @param[in] rowDone - called with each row once it is written, or nullptr
  *
  * @returns none
  *****************************************************************************/
-void brighten( image &specifications, int argc, char *argv[] )
+static void boxFilter( pixel *source, int sourceStride, pixel *dest,
+                       int destStride, int cols, int radius, int first,
+                       int last, const function<void( int row )> *rowDone )
 {
     // variables
-    int value = stoi( (string) argv[argc - 4] );
-    int i, j, testValueRed, testValueGreen, testValueBlue;
+    int i, j, bits, side = 2 * radius + 1, width = cols + 2 * radius;
+    uint64_t area = (uint64_t) side * side, reciprocal, sum;
+    int shift;
+    pixel *in, *out;
+    vector<uint32_t> column( width, 0 );
 
-    // brighten each pixel with limits of 255 and 0
-    for( i = 0; i < specifications.rows; i++ )
+    // choose the fixed point reciprocal of the window area
+    for( bits = 0; ( 1ull << bits ) < area; bits++ )
     {
-        for( j = 0; j < specifications.cols; j++ )
+    }
+    shift = 2 * bits + 8;
+    reciprocal = ( ( 1ull << shift ) + area - 1 ) / area;
+
+    // start the column sums with the rows above the first full window
+    for( i = first; i < first + side - 1 && first < last; i++ )
+    {
+        in = planeRow( source, sourceStride, i );
+        for( j = 0; j < width; j++ )
         {
-            // determine the pixel value based on the amount specified
-            testValueRed = specifications.red[i][j] + value;
-            testValueGreen = specifications.green[i][j] + value;
-            testValueBlue = specifications.blue[i][j] + value;
-
-            // reset the value to limit if out of boundry
-            checkBoundry( specifications.red, specifications.green,
-                          specifications.blue, testValueRed,
-                          testValueGreen, testValueBlue, i, j );
+            column[j] += in[j];
+        }
+    }
+
+    for( i = first; i < last; i++ )
+    {
+        // add the row entering the window
+        in = planeRow( source, sourceStride, i + side - 1 );
+        for( j = 0; j < width; j++ )
+        {
+            column[j] += in[j];
+        }
+
+        // slide the window along the row
+        out = planeRow( dest, destStride, i );
+        sum = 0;
+        for( j = 0; j < side; j++ )
+        {
+            sum += column[j];
+        }
+        out[0] = sum * reciprocal >> shift;
+        for( j = 1; j < cols; j++ )
+        {
+            sum += column[j + side - 1] - column[j - 1];
+            out[j] = sum * reciprocal >> shift;
+        }
+        if( rowDone != nullptr )
+        {
+            ( *rowDone )( i );
+        }
+
+        // subtract the row leaving the window
+        in = planeRow( source, sourceStride, i );
+        for( j = 0; j < width; j++ )
+        {
+            column[j] -= in[j];
         }
     }
 }
@@ -139,81 +366,156 @@ void brighten( image &specifications, int argc, char *argv[] )
  * @author Cameron Custer
  *
  * @par Description:
- * This function sharpens the image for red, green, and blue in each pixel
- * based on an algorithm provided which multiplies the value in the pixel by
- * 5 and subtracts the surrounding (up, down, left ,right) values of the
- * array from the pixel. It moves through the arrray by specificying a row then
- * a column in a nested for-loop. The values of all border pixels are set to
- * zero.
+ * This function applies a stencil reaching a given radius around each pixel
+ * to the red, green, and blue planes, a band of rows per task, and replaces
+ * the planes with the results. With the zero border mode the pixels whose
+ * stencil does not fit in the image are set to zero, and the stencil is run
+ * on the interior straight from the planes. With the other border modes
+ * each plane is first copied into a padded plane whose halo is filled once,
+ * and the stencil is run on every pixel. Either way the stencil itself never
+ * checks for the edges of the image.
+ *
+ * The point operations coming before the stencil are applied to its input
+ * and the ones coming after it to each output row as soon as the row is
+ * written, while it is still in the cache, instead of in passes of their
+ * own.
  *
  * @param[in, out] specifications - the structure containing the content of
- * the image to be modified
+ * the image to be modified and the border mode
+ * @param[in] radius - the number of pixels the stencil reaches on each side
+ * @param[in] filter - the stencil, run on a band of rows of one plane
+ * @param[in] before - the table of the point operations applied before the
+ * stencil
+ * @param[in] after - the table of the point operations applied after the
+ * stencil
  *
  * @returns none
  *****************************************************************************/
-void sharpen( image &specifications )
+static void applyStencil( image &specifications, int radius,
+                          stencilFilter filter, const pointTable &before,
+                          const pointTable &after )
 {
     // variables
-    int i, j, testValueRed, testValueGreen, testValueBlue;
-
-    // allocate new arrays to host temporary calculated values
-    allocArray( specifications.newred, specifications.rows,
-                specifications.cols );
-    allocArray( specifications.newgreen, specifications.rows,
-                specifications.cols );
-    allocArray( specifications.newblue, specifications.rows,
-                specifications.cols );
-
-    // sharpen each pixel utilizing the provided algorithm
-    for( i = 0; i < specifications.rows; i++ )
+    int rows = specifications.rows, cols = specifications.cols;
+    int stride = specifications.stride, paddedStride = stride, k;
+    bool padded = specifications.border != Zero;
+    pixel *source[3] = { specifications.red, specifications.green,
+                         specifications.blue };
+    pixel *halo[3] = { nullptr, nullptr, nullptr };
+    pixel *dest[3];
+
+    // allocate new planes to host temporary calculated values
+    allocArray( specifications.newred, rows, stride );
+    allocArray( specifications.newgreen, rows, stride );
+    allocArray( specifications.newblue, rows, stride );
+    dest[0] = specifications.newred;
+    dest[1] = specifications.newgreen;
+    dest[2] = specifications.newblue;
+
+    // fill the halo of each plane once for the whole pass, applying the
+    // point operations before the stencil on the way; without a halo they
+    // are applied to the planes in a pass of their own
+    for( k = 0; k < 3 && padded; k++ )
+    {
+        padPlane( source[k], rows, cols, stride, radius,
+                  specifications.border, before, halo[k], paddedStride );
+    }
+    if( !padded )
     {
-        for( j = 0; j < specifications.cols; j++ )
+        applyPointTable( specifications, before );
+    }
+
+    parallelRows( rows, [&]( int band, int first, int last )
+    {
+        int i, k, start, finish;
+        pixel *out;
+        function<void( int row )> rowDone;
+
+        for( k = 0; k < 3; k++ )
         {
-            // ensure the pixel is not a border pixel
-            if( i != 0 && j != 0 && i != ( specifications.rows - 1 ) &&
-                j != ( specifications.cols - 1 ) )
+            if( padded )
+            {
+                // apply the point operations after the stencil to each
+                // row as soon as it is written
+                rowDone = [&]( int row )
+                {
+                    applyTable( after, planeRow( dest[k], stride, row ),
+                                cols );
+                };
+                filter( halo[k], paddedStride, dest[k], stride, cols, radius,
+                        first, last, after.identity ? nullptr : &rowDone );
+                continue;
+            }
+
+            // set the border pixels of the band to zero
+            for( i = first; i < last; i++ )
             {
-                // use test values to set temporary values in the new array
-                testValueRed = 5 * specifications.red[i][j] -
-                    specifications.red[i + 1][j] -
-                    specifications.red[i - 1][j] -
-                    specifications.red[i][j + 1] -
-                    specifications.red[i][j - 1];
-                testValueGreen = 5 * specifications.green[i][j] -
-                    specifications.green[i + 1][j] -
-                    specifications.green[i - 1][j] -
-                    specifications.green[i][j + 1] -
-                    specifications.green[i][j - 1];
-                testValueBlue = 5 * specifications.blue[i][j] -
-                    specifications.blue[i + 1][j] -
-                    specifications.blue[i - 1][j] -
-                    specifications.blue[i][j + 1] -
-                    specifications.blue[i][j - 1];
-
-                // boundry checking
-                checkBoundry( specifications.newred, specifications.newgreen,
-                              specifications.newblue, testValueRed,
-                              testValueGreen, testValueBlue, i, j );
+                out = planeRow( dest[k], stride, i );
+                if( i < radius || i >= rows - radius || cols <= 2 * radius )
+                {
+                    fill( out, out + cols, 0 );
+                    applyTable( after, out, cols );
+                }
+                else
+                {
+                    fill( out, out + radius, 0 );
+                    fill( out + cols - radius, out + cols, 0 );
+                }
             }
-            else
+
+            // run the stencil on the interior rows of the band
+            start = max( first, radius );
+            finish = min( last, rows - radius );
+            rowDone = [&]( int row )
             {
-                // set the border pixels to zero
-                specifications.newred[i][j] = 0;
-                specifications.newgreen[i][j] = 0;
-                specifications.newblue[i][j] = 0;
+                applyTable( after, planeRow( dest[k], stride, row + radius ),
+                            cols );
+            };
+            if( start < finish && cols > 2 * radius )
+            {
+                filter( source[k], stride,
+                        planeRow( dest[k], stride, radius ) + radius, stride,
+                        cols - 2 * radius, radius, start - radius,
+                        finish - radius, after.identity ? nullptr : &rowDone );
             }
         }
-    }
+    } );
 
     // use algorithm swap to remove excess memory
     swap( specifications.red, specifications.newred );
     swap( specifications.green, specifications.newgreen );
     swap( specifications.blue, specifications.newblue );
 
-    // free the excess memory from the temporary arrays utilized
-    free2d( specifications.newred, specifications.rows );
-    free2d( specifications.newgreen, specifications.rows );
-    free2d( specifications.newblue, specifications.rows );
+    // free the excess memory from the temporary and padded planes
+    free2d( specifications.newred );
+    free2d( specifications.newgreen );
+    free2d( specifications.newblue );
+    for( k = 0; k < 3; k++ )
+    {
+        free2d( halo[k] );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function sharpens the image for red, green, and blue in each pixel
+ * based on an algorithm provided which multiplies the value in the pixel by
+ * 5 and subtracts the surrounding (up, down, left ,right) values of the
+ * array from the pixel. The values of all border pixels are set to zero,
+ * unless another border mode was chosen, in which case the missing
+ * neighbours of the border pixels are taken from the halo.
+ *
+ * @param[in, out] specifications - the structure containing the content of
+ * the image to be modified
+ *
+ * @returns none
+ *****************************************************************************/
+void sharpen( image &specifications )
+{
+    applyStencil( specifications, 1, sharpenFilter, identityTable( ),
+                  identityTable( ) );
 }
 
 /** ***************************************************************************
@@ -221,92 +523,199 @@ void sharpen( image &specifications )
  *
  * @par Description:
  * This function smooths the image for red, green, and blue in each pixel
- * based on an algorithm provided which sums the 8 directly surrounding values
- * in the array and the pixel itself, and then divides by nine to determine the
- * new pixels value. It moves through the arrray by specificying a row then
- * a column in a nested for-loop. The values of all border pixels are set to
- * zero.
+ * by replacing it with the average of the square of pixels around it. With
+ * the default radius of one this sums the 8 directly surrounding values and
+ * the pixel itself and divides by nine. Any radius costs the same per pixel,
+ * as each plane is filtered with running sums. The values of all border
+ * pixels, whose square does not fit in the image, are set to zero, unless
+ * another border mode was chosen, in which case the square is completed
+ * from the halo.
  *
  * @param[in, out] specifications - the structure containing the content of the
  * image which contains the image content which is modified
+ * @param[in] radius - the number of pixels on each side of the center of
+ * the square
  *
  * @returns none
  *****************************************************************************/
-void smooth( image &specifications )
+void smooth( image &specifications, int radius )
+{
+    applyStencil( specifications, radius, boxFilter, identityTable( ),
+                  identityTable( ) );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function returns the stencil run by an operation on a band of rows
+ * of one plane, so the rows can be filtered outside of sharpen and smooth.
+ *
+ * @param[in] operationValue - the operation
+ *
+ * @returns the stencil, or nullptr if the operation is not a stencil
+ *****************************************************************************/
+stencilFilter stencilFor( operation operationValue )
+{
+    if( operationValue == Sharpen )
+    {
+        return sharpenFilter;
+    }
+    if( operationValue == Smooth )
+    {
+        return boxFilter;
+    }
+    return nullptr;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function converts a row of color pixels to gray by weighting the
+ * red, green, and blue values by .3, .6, and .1, rounding to the nearest
+ * value, and limiting the result to 255, with the kernel selected by
+ * initKernels. The maximum and minimum gray values of the row are merged
+ * into the ones given in the same pass.
+ *
+ * @param[in] red - the red pixels of the row
+ * @param[in] green - the green pixels of the row
+ * @param[in] blue - the blue pixels of the row
+ * @param[out] gray - the gray pixels of the row
+ * @param[in] cols - the number of pixels in the row
+ * @param[in, out] max - an intiger to hold the maximum value of a pixel
+ * @param[in, out] min - an intiger to hold the minimum value of a pixel
+ *
+ * @returns none
+ *****************************************************************************/
+void grayscaleRow( const pixel *red, const pixel *green, const pixel *blue,
+                   pixel *gray, int cols, int &max, int &min )
+{
+    kernels.grayscale( red, green, blue, gray, cols, max, min );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function converts a row of interleaved red, green, and blue values
+ * to gray, applying the point operations coming before the conversion to
+ * the interleaved values in place first. The row is split into the color
+ * channels GRAY_BLOCK pixels at a time in buffers on the stack, which stay
+ * in the cache, so no color planes are needed. The gray values are the
+ * same as grayscaleRow gives.
+ *
+ * @param[in, out] rgb - the red, green, and blue values of the row
+ * @param[out] gray - the gray pixels of the row
+ * @param[in] cols - the number of pixels in the row
+ * @param[in] before - the table of the point operations applied before the
+ * conversion
+ * @param[in, out] max - an intiger to hold the maximum value of a pixel
+ * @param[in, out] min - an intiger to hold the minimum value of a pixel
+ *
+ * @returns none
+ *****************************************************************************/
+void grayscalePackedRow( pixel *rgb, pixel *gray, int cols,
+                         const pointTable &before, int &max, int &min )
+{
+    // variables
+    alignas( PLANE_ALIGN ) pixel red[GRAY_BLOCK];
+    alignas( PLANE_ALIGN ) pixel green[GRAY_BLOCK];
+    alignas( PLANE_ALIGN ) pixel blue[GRAY_BLOCK];
+    int j, count;
+
+    applyTable( before, rgb, (size_t) 3 * cols );
+    for( j = 0; j < cols; j += GRAY_BLOCK )
+    {
+        count = std::min( GRAY_BLOCK, cols - j );
+        deinterleaveRGB( rgb + (size_t) 3 * j, red, green, blue, count );
+        grayscaleRow( red, green, blue, gray + j, count, max, min );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function converts the image from color to grayscale a band of rows
+ * per task, keeping the maximum and minimum gray values of each band apart
+ * and merging them at the end. When a histogram is wanted each band also
+ * counts its gray rows into a histogram of its own while they are in the
+ * cache, and the histograms are merged the same way. The point operations
+ * coming before the conversion are applied to each row of the color planes
+ * just before it is converted.
+ *
+ * @param[in, out] specifications - the structure containing the content of
+ * the image which is modified
+ * @param[in] before - the table of the point operations applied before the
+ * conversion
+ * @param[in, out] max - an intiger to hold the maximum value of a pixel
+ * contained in the image
+ * @param[in, out] min - an intiger to hold the minimum value of a pixel
+ * contained in the image
+ * @param[in, out] counts - the histogram the gray pixels are added to, or
+ * nullptr
+ *
+ * @returns none
+ *****************************************************************************/
+static void grayscaleChain( image &specifications,
+                            const pointTable &before, int &max,
+                            int &min, histogram *counts )
 {
     // variables
-    int i, j, testValueRed, testValueGreen, testValueBlue;
-
-    // allocate new arrays to host temporary calculated values
-    allocArray( specifications.newred, specifications.rows,
-                specifications.cols );
-    allocArray( specifications.newgreen, specifications.rows,
-                specifications.cols );
-    allocArray( specifications.newblue, specifications.rows,
-                specifications.cols );
-
-    // smooth each pixel utilizing the provided algorithm
-    for( i = 0; i < specifications.rows; i++ )
+    int bands = rowBands( specifications.rows ), band;
+    vector<int> bandMax( bands, max ), bandMin( bands, min );
+    vector<histogram> bandCounts( counts != nullptr ? bands : 0 );
+
+    // allocate a gray plane for gray scaling
+    allocArray( specifications.gray, specifications.rows,
+                specifications.stride );
+
+    // grayscale each band of rows, keeping the extremes of each band apart
+    parallelRows( specifications.rows, [&]( int band, int first, int last )
     {
-        for( j = 0; j < specifications.cols; j++ )
+        int i;
+
+        for( i = first; i < last; i++ )
         {
-            // ensure the pixel is not a border pixel
-            if( i != 0 && j != 0 && i != ( specifications.rows - 1 ) &&
-                j != ( specifications.cols - 1 ) )
-            {
-                // use test values to set temporary values in the new array
-                testValueRed = ( specifications.red[i + 1][j - 1] +
-                                 specifications.red[i + 1][j] +
-                                 specifications.red[i + 1][j + 1] +
-                                 specifications.red[i][j - 1] +
-                                 specifications.red[i][j] +
-                                 specifications.red[i][j + 1] +
-                                 specifications.red[i - 1][j - 1] +
-                                 specifications.red[i - 1][j] +
-                                 specifications.red[i - 1][j + 1] ) / 9;
-                testValueGreen = ( specifications.green[i + 1][j - 1] +
-                                   specifications.green[i + 1][j] +
-                                   specifications.green[i + 1][j + 1] +
-                                   specifications.green[i][j - 1] +
-                                   specifications.green[i][j] +
-                                   specifications.green[i][j + 1] +
-                                   specifications.green[i - 1][j - 1] +
-                                   specifications.green[i - 1][j] +
-                                   specifications.green[i - 1][j + 1] ) / 9;
-                testValueBlue = ( specifications.blue[i + 1][j - 1] +
-                                  specifications.blue[i + 1][j] +
-                                  specifications.blue[i + 1][j + 1] +
-                                  specifications.blue[i][j - 1] +
-                                  specifications.blue[i][j] +
-                                  specifications.blue[i][j + 1] +
-                                  specifications.blue[i - 1][j - 1] +
-                                  specifications.blue[i - 1][j] +
-                                  specifications.blue[i - 1][j + 1] ) / 9;
-
-                // boundry checking
-                checkBoundry( specifications.newred, specifications.newgreen,
-                              specifications.newblue, testValueRed,
-                              testValueGreen, testValueBlue, i, j );
-            }
-            else
+            applyTable( before, planeRow( specifications.red,
+                                          specifications.stride, i ),
+                        specifications.cols );
+            applyTable( before, planeRow( specifications.green,
+                                          specifications.stride, i ),
+                        specifications.cols );
+            applyTable( before, planeRow( specifications.blue,
+                                          specifications.stride, i ),
+                        specifications.cols );
+            grayscaleRow( planeRow( specifications.red, specifications.stride,
+                                    i ),
+                          planeRow( specifications.green,
+                                    specifications.stride, i ),
+                          planeRow( specifications.blue,
+                                    specifications.stride, i ),
+                          planeRow( specifications.gray,
+                                    specifications.stride, i ),
+                          specifications.cols, bandMax[band],
+                          bandMin[band] );
+            if( counts != nullptr )
             {
-                // set the border pixels to zero
-                specifications.newred[i][j] = 0;
-                specifications.newgreen[i][j] = 0;
-                specifications.newblue[i][j] = 0;
+                countGrayRow( planeRow( specifications.gray,
+                                        specifications.stride, i ),
+                              specifications.cols, bandCounts[band] );
             }
         }
-    }
-
-    // use algorithm swap to remove excess memory
-    swap( specifications.red, specifications.newred );
-    swap( specifications.green, specifications.newgreen );
-    swap( specifications.blue, specifications.newblue );
+    } );
 
-    // free the excess memory from the temporary arrays utilized
-    free2d( specifications.newred, specifications.rows );
-    free2d( specifications.newgreen, specifications.rows );
-    free2d( specifications.newblue, specifications.rows );
+    // merge the extremes and histograms of the bands
+    for( band = 0; band < bands; band++ )
+    {
+        max = std::max( max, bandMax[band] );
+        min = std::min( min, bandMin[band] );
+        if( counts != nullptr )
+        {
+            mergeHistograms( *counts, bandCounts[band] );
+        }
+    }
 }
 
 /** ***************************************************************************
@@ -316,8 +725,7 @@ void smooth( image &specifications )
  * This function converts the image from color to grayscale by calculating
  * a given value for each pixel, and appending the value to the gray-scaled
  * array. The gray scaled array is then output to the respective image type
- * P2 (Ascii) or P5 (Binary). This function walks through each value in each
- * row utilizing a nested for-loop.
+ * P2 (Ascii) or P5 (Binary).
  *
  * @param[in, out] specifications - the structure containing the content of
  * the image which is modified
@@ -331,44 +739,43 @@ void smooth( image &specifications )
 // converts the image to grayscale from the r, g, and b in each pixel
 void grayscale( image &specifications, int &max, int &min )
 {
-    // variables
-    int i, j;
-    double testValue;
+    grayscaleChain( specifications, identityTable( ), max, min, nullptr );
+}
 
-    // allocate a gray array for gray scaling
-    allocArray( specifications.gray, specifications.rows,
-                specifications.cols );
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function counts the gray values of an image that already has its
+ * gray plane, a band of rows per task, each band counting into a histogram
+ * of its own before they are merged.
+ *
+ * @param[in] specifications - the structure containing the gray plane
+ * @param[in, out] counts - the histogram the gray pixels are added to
+ *
+ * @returns none
+ *****************************************************************************/
+static void countGrayPlane( const image &specifications, histogram &counts )
+{
+    // variables
+    int bands = rowBands( specifications.rows ), band;
+    vector<histogram> bandCounts( bands );
 
-    // grayscale each pixel and append it to the two dimensional gray array
-    for( i = 0; i < specifications.rows; i++ )
+    parallelRows( specifications.rows, [&]( int band, int first, int last )
     {
-        for( j = 0; j < specifications.cols; j++ )
-        {
-            // algorithm for grayscaling
-            testValue = specifications.red[i][j] * .3 +
-                specifications.green[i][j] * .6 +
-                specifications.blue[i][j] * .1;
-
-            // boundry checking
-            if( testValue > 255 )
-            {
-                specifications.gray[i][j] = 255;
-            }
-            else
-            {
-                specifications.gray[i][j] = (int) ( testValue + .5 );
-            }
+        int i;
 
-            // set max and min values for contrast function
-            if( specifications.gray[i][j] > max )
-            {
-                max = specifications.gray[i][j];
-            }
-            if( specifications.gray[i][j] < min )
-            {
-                min = specifications.gray[i][j];
-            }
+        for( i = first; i < last; i++ )
+        {
+            countGrayRow( planeRow( specifications.gray,
+                                    specifications.stride, i ),
+                          specifications.cols, bandCounts[band] );
         }
+    } );
+
+    for( band = 0; band < bands; band++ )
+    {
+        mergeHistograms( counts, bandCounts[band] );
     }
 }
 
@@ -376,49 +783,165 @@ void grayscale( image &specifications, int &max, int &min )
  * @author Cameron Custer
  *
  * @par Description:
- * This functions grayscales the image using the function listed for
- * grayscaling and then contrasts the image by scaling the grayscaled image
- * using a given value which is based on the minimum and maximum pixel values
- * found in each array in the grayscale fucntion. This function walks through
- * each value in each row utilizing a nested for-loop.
+ * This function grayscales the image, applying the point operations coming
+ * before it to each row on the way and building the histogram of the gray
+ * values as it goes, then derives the table of a tone operation from the
+ * histogram and applies it to the gray plane a band of rows per task. An
+ * image decoded straight to gray had the point operations applied as it
+ * was read, so only its histogram is built.
+ * Contrast stretches the values between its clipping percentiles to 0 to
+ * 255 and equalize flattens the histogram.
  *
  * @param[in, out] specifications - the structure containing the content of
  * the image which is modified
+ * @param[in] before - the table of the point operations applied before
+ * grayscaling
+ * @param[in] step - the tone operation, contrast or equalize
  *
  * @returns none
  *****************************************************************************/
-void contrast( image &specifications )
+static void toneChain( image &specifications, const pointTable &before,
+                       const operationStep &step )
 {
     // variables
     int max = 0;
     int min = 255;
-    int i, j;
-    double scale, testValue;
+    histogram counts;
+    pointTable tone;
 
-    // grayscale the image before contrasting
-    grayscale( specifications, max, min );
+    // grayscale the image before changing its tones
+    if( specifications.gray == nullptr )
+    {
+        grayscaleChain( specifications, before, max, min, &counts );
+    }
+    else
+    {
+        countGrayPlane( specifications, counts );
+    }
 
-    // determine the scale value based on the maximum and minimum values
-    // determined for each pixel in the grayscale operation
-    scale = 255.0 / ( max - min );
+    // apply the table derived from the histogram to the gray plane, a band
+    // of rows per task
+    tone = step.op == Equalize ? equalizeTable( counts ) :
+        stretchTable( counts, step.value );
+    parallelRows( specifications.rows, [&]( int band, int first, int last )
+    {
+        applyTable( tone, planeRow( specifications.gray,
+                                    specifications.stride, first ),
+                    (size_t) ( last - first ) * specifications.stride );
+    } );
+}
 
-    // contrast each pixel in the gray array based on the scale
-    for( i = 0; i < specifications.rows; i++ )
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This functions grayscales the image using the function listed for
+ * grayscaling and then contrasts the image by stretching the gray values
+ * between the minimum and maximum to 0 to 255. A percent of the darkest and
+ * brightest pixels may be clipped first, so a few outliers do not limit the
+ * stretch.
+ *
+ * @param[in, out] specifications - the structure containing the content of
+ * the image which is modified
+ * @param[in] percent - the percent of the pixels clipped at each end
+ *
+ * @returns none
+ *****************************************************************************/
+void contrast( image &specifications, int percent )
+{
+    toneChain( specifications, identityTable( ), { Contrast, percent } );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function grayscales the image and then equalizes its histogram, so
+ * the gray values are spread evenly over 0 to 255.
+ *
+ * @param[in, out] specifications - the structure containing the content of
+ * the image which is modified
+ *
+ * @returns none
+ *****************************************************************************/
+void equalize( image &specifications )
+{
+    toneChain( specifications, identityTable( ), { Equalize, 0 } );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function performs a chain of operations on the image in order, fusing
+ * them so each pixel is loaded from memory as few times as possible. A run
+ * of point operations is composed into one table and applied in a single
+ * traversal. A stencil takes the table of the point operations before it as
+ * it reads its input and the one after it as it writes each row, and
+ * grayscale, contrast, and equalize take the table before them as they read
+ * each row. Those three may only end a chain. An image read straight into
+ * its gray plane has already had the point operations and the conversion
+ * to gray done, leaving contrast and equalize only their tables to apply.
+ *
+ * @param[in, out] specifications - the structure containing the content of
+ * the image which is modified
+ * @param[in] steps - the operations to perform, in order
+ *
+ * @returns none
+ *****************************************************************************/
+void applyOperations( image &specifications,
+                      const vector<operationStep> &steps )
+{
+    // variables
+    size_t i = 0, j;
+    int max = 0, min = 255;
+    pointTable before, after;
+
+    while( i < steps.size( ) )
     {
-        for( j = 0; j < specifications.cols; j++ )
+        // compose the point operations in front of the next operation
+        before = identityTable( );
+        for( ; i < steps.size( ) && pointOperation( steps[i] ); i++ )
         {
-            // algorithm
-            testValue = scale * ( specifications.gray[i][j] - min );
+            before = composeTables( before, stepTable( steps[i] ) );
+        }
+        if( i == steps.size( ) )
+        {
+            applyPointTable( specifications, before );
+            break;
+        }
 
-            // boundry checking
-            if( testValue > 255.0 )
+        if( steps[i].op == Sharpen || steps[i].op == Smooth )
+        {
+            // the stencil also takes the point operations after it
+            after = identityTable( );
+            for( j = i + 1; j < steps.size( ) && pointOperation( steps[j] );
+                 j++ )
             {
-                specifications.gray[i][j] = 255;
+                after = composeTables( after, stepTable( steps[j] ) );
             }
-            else
+            applyStencil( specifications,
+                          steps[i].op == Smooth ? steps[i].value : 1,
+                          stencilFor( steps[i].op ), before, after );
+            i = j;
+        }
+        else if( steps[i].op == Grayscale )
+        {
+            if( specifications.gray == nullptr )
             {
-                specifications.gray[i][j] = (int) testValue;
+                grayscaleChain( specifications, before, max, min, nullptr );
             }
+            i++;
+        }
+        else if( steps[i].op == Contrast || steps[i].op == Equalize )
+        {
+            toneChain( specifications, before, steps[i] );
+            i++;
+        }
+        else
+        {
+            applyPointTable( specifications, before );
+            i++;
         }
     }
 }
@@ -18,10 +18,18 @@
  * from the command line.
  *
  * The operations which can be utilized on the image include: negate,
- * brighten, sharpen, smooth, grayscale, and contrast. The operations are
- * performed by reading ascii or binary values for the red, green, and blue
- * colors in the file into two dimensional arrays. One array for the red
- * values, one for the green values, and one for the blue values.
+ * brighten, sharpen, smooth, grayscale, contrast, and equalize. The
+ * operations are performed by reading ascii or binary values for the red,
+ * green, and blue colors in the file into contiguous, aligned planes. One
+ * plane for the red values, one for the green values, and one for the blue
+ * values. When the output is gray and the operations before the one making
+ * it gray are only negate and brighten, the pixels are converted to gray as
+ * they are read and only a gray plane is allocated.
+ *
+ * Several operations may be given, and they are performed in the order
+ * given. Operations on single samples next to each other, or following a
+ * sharpen or smooth, are fused so each block of the image is passed over
+ * once.
  *
  * The image is then output to an output file after the operation, if required
  * is performed. The data can then be read as an image or viewed as raw text.
@@ -32,17 +40,40 @@
  * @section compile_section Compiling and Usage
  *
  * @par Compiling Instructions:
- *      None
+ *      make builds image_operations along with the libimageops.a and
+ *      libimageops.so libraries holding everything but the command line.
+ *      A program using the library includes netPBM.h and calls
+ *      processImage with buffers it owns; parseOperations reads a chain
+ *      written as on the command line.
  *
  * @par Usage
    @verbatim
-   C:\> image_operations [option] -o[ab] basename image.ppm
+   C:\> image_operations [-j threads] [--border mode] [--pool-stats] [--stream] [--stats[=json]] [--stats-file file] [--batch] [--io mode] [option ...] -o[ab] basename image.ppm
    -n - negate
    -b - brighten
    -p - sharpen
-   -s - smooth
+   -s - smooth [radius]
    -g - grayscale
-   -c - contrast
+   -c - contrast [percent]
+   -e - equalize
+   options are performed in the order given; -g, -c, or -e must come last
+   -j - the number of threads, one per core by default
+   --border - zero, clamp, reflect, or wrap edges for sharpen and smooth
+   --pool-stats - report plane allocations on standard error
+   --stream - hold only the rows the operation needs in memory
+   --stats - report the time of each stage, as JSON with --stats=json
+   --stats-file - the file receiving the report, standard error by default
+   --batch - basename is a directory and image.ppm a manifest, directory,
+             or pattern naming the images to handle
+   --io - uring, thread, or sync: how a batch reads and writes its files,
+          in the background through io_uring or helper threads, or in place
+
+   C:\> image_operations [-j threads] [--border mode] [--stats] --frames [option ...] -o[ab] < frames > frames
+   --frames - read P3 or P6 frames one after another from standard input
+              and write the results to standard output
+
+   C:\> image_operations [-j threads] [--border mode] [--stats] --serve socket
+   --serve - answer requests sent by image_client over a Unix socket
    @endverbatim
  *
  * @section todo_bugs_modification_section Todo, Bugs, and Modifications
@@ -52,7 +83,7 @@
  *****************************************************************************/
 
 #define _CRT_SECURE_NO_WARNINGS
-#include "netPBM.h"
+#include "imageProgram.h"
 using namespace std;
 
 /** ***************************************************************************
@@ -66,7 +97,11 @@ using namespace std;
  * message is output and program exits. The data is read as specified by a
  * function refrenced in main based on the command line arguments which are
  * verified. The data is then modified if necessary and output to the output
- * file. The files are closed and the and the program ends.
+ * file. The files are closed and the and the program ends. With --batch the
+ * images named by a manifest, directory, or pattern are handled instead,
+ * several at once, with --frames a stream of images is passed from standard
+ * input to standard output, and with --serve the program answers requests
+ * on a Unix socket until it is stopped.
  *
  * @param[in] argc - an intiger containing the number of command line
  * arguments provided
@@ -74,56 +109,181 @@ using namespace std;
  * provided
  *
  * @returns 0 exits with code 0 after the program has run, and exit value of a
- * 1 indicates a program failure.
+ * 1 indicates a program failure or an image of a batch that failed.
  *****************************************************************************/
 int main( int argc, char *argv[] )
 {
     // variables
+    runOptions options;
     image specifications;
-    operation operationValue;
+    vector<operationStep> steps;
     ifstream imageFile;
-    ofstream writeFile;
-    bool grayCheck;
-    string outFileName;
-
-    //check command line arguments
-    checkCMD( specifications, argc, argv, grayCheck, outFileName );
+    ofstream writeFile, statsFile;
+    bool grayCheck, asciiCheck, streamed = false;
+    string outFileName, error;
+    runStats stats;
+    int failures = 0;
 
-    imageFile.open( argv[argc - 1], ios::in | ios::binary );
+    // select the widest kernels the processor supports
+    initKernels( );
 
-    // make sure the file is open
-    if( !imageFile.is_open( ) )
+    // remove the global options and check command line arguments, a server
+    // taking its images from its requests instead
+    parseOptions( argc, argv, options );
+    specifications.border = options.border;
+    if( !options.serverPath.empty( ) )
     {
-        cout << "Unable to open: " << argv[argc - 1] << endl;
-        exit( 0 );
+        if( argc != 1 )
+        {
+            usageStatement( );
+        }
+        return serveSocket( options.serverPath, options );
+    }
+    if( options.frames )
+    {
+        checkFramesCMD( argc, argv, steps, grayCheck, asciiCheck );
+    }
+    else
+    {
+        checkCMD( specifications, argc, argv, grayCheck, asciiCheck,
+                  outFileName );
     }
 
-    writeFile.open( outFileName, ios::out | ios::trunc | ios::binary );
-
-    // make sure the file is open
-    if( !writeFile.is_open( ) )
+    // hand each image of a batch to the thread pool, pass frames through the
+    // pipeline, otherwise handle the single image named
+    if( options.batch )
+    {
+        TIME_STAGE( stats.total );
+        failures = processBatch( argv[argc - 1], argv[argc - 2],
+                                 options, operationList( argc, argv ),
+                                 grayCheck, asciiCheck, stats );
+    }
+    else if( options.frames )
     {
-        cout << "Unable to open: " << argv[argc - 2] << endl;
-        exit( 0 );
+        TIME_STAGE( stats.total );
+        failures = processFrames( options, steps, grayCheck,
+                                  asciiCheck, stats );
     }
+    else
+    {
+        TIME_STAGE( stats.total );
+
+        {
+            TIME_STAGE( stats.open );
 
-    // read in the header and determine the filetype of the imagefile
-    readImageHeader( imageFile, specifications );
+            // map the image into memory unless it is streamed, falling back
+            // to reading it as a stream
+            if( options.streaming || !mapImage( argv[argc - 1],
+                                                specifications ) )
+            {
+                imageFile.open( argv[argc - 1], ios::in | ios::binary );
 
-    // evaluate the operation type
-    operationValue = operationType( specifications, argc, argv );
+                // make sure the file is open
+                if( !imageFile.is_open( ) )
+                {
+                    cout << "Unable to open: " << argv[argc - 1] << endl;
+                    exit( 0 );
+                }
 
-    // read the data
-    read( imageFile, specifications, argc, argv );
+                // read in the header and determine the filetype of the
+                // imagefile
+                readImageHeader( imageFile, specifications );
+            }
 
-    // operate on the data
-    performOperation( specifications, operationValue, argc, argv );
+            writeFile.open( outFileName, ios::out | ios::trunc |
+                            ios::binary );
 
-    // write the data
-    write( writeFile, specifications, grayCheck, argc, argv );
+            // make sure the file is open
+            if( !writeFile.is_open( ) )
+            {
+                cout << "Unable to open: " << argv[argc - 2] << endl;
+                exit( 0 );
+            }
+        }
+
+        // evaluate the chain of operations
+        steps = operationList( argc, argv );
+
+        // pass the rows straight through when streaming, otherwise read the
+        // whole image, operate on it, and write it
+        if( options.streaming )
+        {
+            TIME_STAGE( stats.stream );
+            streamed = streamImage( imageFile, writeFile, specifications,
+                                    steps, grayCheck, asciiCheck, error );
+        }
+
+        // invalid data found while streaming leaves part of an output,
+        // which is removed
+        if( !error.empty( ) )
+        {
+            cout << "Unable to read image: " << error << endl;
+            writeFile.close( );
+            remove( outFileName.c_str( ) );
+            exit( 1 );
+        }
+        if( !streamed )
+        {
+            // read the data
+            {
+                TIME_STAGE( stats.read );
+                if( !read( imageFile, specifications, steps, error ) )
+                {
+                    cout << "Unable to read image: " << error << endl;
+                    writeFile.close( );
+                    remove( outFileName.c_str( ) );
+                    exit( 1 );
+                }
+            }
+
+            // operate on the data
+            {
+                TIME_STAGE( stats.operate );
+                performOperation( specifications, steps );
+            }
+
+            // write the data
+            {
+                TIME_STAGE( stats.write );
+                write( writeFile, specifications, grayCheck, asciiCheck );
+                writeFile.flush( );
+            }
+        }
+    }
+
+    // report how the pool of planes was used
+    if( options.poolReport )
+    {
+        reportPlanePool( cerr );
+    }
+
+    // report the time of each stage and the data handled
+    if( options.statsReport != NoStats )
+    {
+        if( !options.batch && !options.frames )
+        {
+            stats.images = 1;
+            stats.bytesWritten = max<streamoff>( writeFile.tellp( ), 0 );
+            countImage( stats, specifications, argv[argc - 1] );
+        }
+        finishStats( stats );
+        if( !options.statsPath.empty( ) )
+        {
+            statsFile.open( options.statsPath,
+                            ios::out | ios::trunc );
+            if( !statsFile.is_open( ) )
+            {
+                cout << "Unable to open: " << options.statsPath
+                    << endl;
+            }
+        }
+        reportStats( statsFile.is_open( ) ? statsFile : cerr, stats,
+                     options.statsReport );
+    }
 
     // close the files and exit the program
+    unmapImage( specifications );
     imageFile.close( );
     writeFile.close( );
-    return 0;
+    return failures > 0 ? 1 : 0;
 }
@@ -0,0 +1,89 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains functions which map the input image into memory
+******************************************************************************/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "netPBM.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function maps the input image file into memory and parses the image
+ * header in place. The mapping is private, so operations may modify the
+ * pixel bytes directly without changing the file. The kernel is advised
+ * that the file will be read sequentially. If the file can not be opened or
+ * mapped, for example a pipe or an empty file, nothing is changed and the
+ * caller should read the image through a stream instead.
+ *
+ * @param[in] path - the path of the input image file
+ * @param[in, out] specifications - the structure receiving the mapping and
+ * the content of the image header
+ *
+ * @returns true - the image was mapped and the header was read
+ * @returns false - the image could not be mapped
+ *****************************************************************************/
+bool mapImage( const char *path, image &specifications )
+{
+    int fd;
+    struct stat status;
+    void *mapping;
+
+    fd = open( path, O_RDONLY );
+    if( fd < 0 )
+    {
+        return false;
+    }
+
+    // only regular, non empty files can be mapped
+    if( fstat( fd, &status ) != 0 || !S_ISREG( status.st_mode ) ||
+        status.st_size == 0 )
+    {
+        close( fd );
+        return false;
+    }
+
+    mapping = mmap( nullptr, status.st_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if( mapping == MAP_FAILED )
+    {
+        return false;
+    }
+    madvise( mapping, status.st_size, MADV_SEQUENTIAL );
+
+    specifications.mapping = (pixel *) mapping;
+    specifications.mappingSize = status.st_size;
+    specifications.bodyOffset = readImageHeader( specifications.mapping,
+                                                 specifications.mappingSize,
+                                                 specifications );
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function releases the mapping of the input image file, if there is
+ * one, along with the packed view into it.
+ *
+ * @param[in, out] specifications - the structure holding the mapping
+ *
+ * @returns none
+ *****************************************************************************/
+void unmapImage( image &specifications )
+{
+    if( specifications.mapping != nullptr )
+    {
+        munmap( specifications.mapping, specifications.mappingSize );
+    }
+    specifications.mapping = nullptr;
+    specifications.mappingSize = 0;
+    specifications.packed = nullptr;
+}
@@ -4,76 +4,249 @@
 * @brief contains functions which allocate dynamic memory and clear the memory
 ******************************************************************************/
 
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include "netPBM.h"
 using namespace std;
 
+/** ***************************************************************************
+ * @brief the most released planes kept for reuse; when more are released
+ * the one released longest ago is given back to the system.
+ *****************************************************************************/
+static const size_t POOL_BLOCKS = 16;
+
+/** ***************************************************************************
+ * @brief the most times larger than a request a released plane may be and
+ * still be reused for it, so a small image does not hold on to a plane
+ * left by a large one.
+ *****************************************************************************/
+static const size_t POOL_SLACK = 2;
+
+/** ***************************************************************************
+ * @brief the pool of planes shared by every image the program handles.
+ * Released planes are kept and handed out again by allocArray, so repeated
+ * operations and images of similar sizes do not go back to the system for
+ * memory.
+ *****************************************************************************/
+struct planePool
+{
+    mutex lock; /*!< guards the fields below */
+    unordered_map<pixel *, size_t> sizes; /*!< the size in bytes of every
+                                          plane allocated, by address */
+    vector<pixel *> released; /*!< the planes waiting to be reused */
+    size_t bytesInUse = 0; /*!< the bytes of the planes handed out */
+    poolStats stats; /*!< the counts reported by planePoolStats */
+};
+
+/** ***************************************************************************
+ * @brief the pool used by the program. It is never destroyed, so planes may
+ * be released while the program exits.
+ *****************************************************************************/
+static planePool &pool = *new planePool;
+
 /** ***************************************************************************
  * @author Cameron Custer
  *
  * @par Description:
- * This function dynamically allocates a 2 dimensional array for a set of
- * pixel (unsigned character) values to occupy, based on a given number of
- * rows of columns. The function checks for enough memory to allocate the
- * array, and if the memory
- * is not avaliable outputs an error message and exits if not enough memory is
- * avaliable.
- *
- * @param[in, out] color - the pixel (unsigned char) set to dynamically
- * allocate a 2 dimensional array for
- * @param[in] rows - an intiger representing the number of rows in the array
- * @param[in] cols - an intiger representing the number of columns in the
- * array
+ * This function computes the row stride of a plane holding a given number of
+ * columns. The stride is rounded up to a multiple of PLANE_ALIGN so that
+ * every row of a plane begins on an aligned address.
+ *
+ * @param[in] cols - an intiger representing the number of columns in a row
+ *
+ * @returns the number of bytes from the start of one row to the next
+ *****************************************************************************/
+int planeStride( int cols )
+{
+    return ( cols + PLANE_ALIGN - 1 ) / PLANE_ALIGN * PLANE_ALIGN;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function hands out a single contiguous plane for a set of pixel
+ * (unsigned character) values to occupy, based on a given number of rows
+ * and the row stride. The smallest released plane which is large enough,
+ * and no more than POOL_SLACK times larger, is reused when there is one;
+ * otherwise a new plane aligned to PLANE_ALIGN bytes is allocated, after
+ * freeing the released plane too large for the request that was released
+ * longest ago, if any, so planes left by a large image do not outlive it
+ * in a run of smaller ones. The contents of the plane are not cleared.
+ * The function checks for enough memory to allocate the plane, and if the
+ * memory is not avaliable outputs an error message and exits.
+ *
+ * @param[in, out] color - the pixel (unsigned char) plane to dynamically
+ * allocate
+ * @param[in] rows - an intiger representing the number of rows in the plane
+ * @param[in] stride - an intiger representing the number of bytes in each
+ * row of the plane, a multiple of PLANE_ALIGN
  *
  * @returns none
  *****************************************************************************/
-void allocArray( pixel **&color, int rows, int cols )
+void allocArray( pixel *&color, int rows, int stride )
 {
-    int i, j;
-    // dynamically allocate an array and ensure the storage is avaliable
-    color = new ( nothrow ) pixel * [rows];
-    if( color == nullptr )
+    // variables
+    size_t bytes = (size_t) rows * stride, k, best, oversized;
+    lock_guard<mutex> guard( pool.lock );
+
+    // aligned_alloc requires a non zero multiple of the alignment
+    if( bytes == 0 )
     {
-        usageStatement( );
+        bytes = PLANE_ALIGN;
     }
 
-    // dynamically allocate an array for each column in each row and ensure
-    // the storage is avaiable if it is not avaible free the memory and exit
-    for( i = 0; i < rows; i++ )
+    // look for the smallest released plane which is large enough but not
+    // too large, and the one released longest ago among those too large
+    best = oversized = pool.released.size( );
+    for( k = 0; k < pool.released.size( ); k++ )
     {
-        color[i] = new ( nothrow ) pixel[cols];
-        if( color[i] == nullptr )
+        if( oversized == pool.released.size( ) &&
+            pool.sizes[pool.released[k]] > bytes * POOL_SLACK )
+        {
+            oversized = k;
+        }
+        if( pool.sizes[pool.released[k]] >= bytes &&
+            pool.sizes[pool.released[k]] <= bytes * POOL_SLACK &&
+            ( best == pool.released.size( ) ||
+              pool.sizes[pool.released[k]] <
+              pool.sizes[pool.released[best]] ) )
         {
-            for( j = 0; j < i; j++ )
-            {
-                delete[] color[j];
-            }
-            delete[] color;
+            best = k;
+        }
+    }
 
-            usageStatement( );
+    if( best < pool.released.size( ) )
+    {
+        color = pool.released[best];
+        pool.released.erase( pool.released.begin( ) + best );
+        pool.stats.reuses++;
+    }
+    else
+    {
+        // new memory is needed, so a plane too large for the requests now
+        // being made is given back first
+        if( oversized < pool.released.size( ) )
+        {
+            pool.sizes.erase( pool.released[oversized] );
+            free( pool.released[oversized] );
+            pool.released.erase( pool.released.begin( ) + oversized );
         }
+
+        // dynamically allocate the plane and ensure the storage is avaliable
+        color = (pixel *) aligned_alloc( PLANE_ALIGN, bytes );
+        if( color == nullptr )
+        {
+            cout << "Unable to allocate " << bytes << " bytes" << endl;
+            exit( 1 );
+        }
+        pool.sizes[color] = bytes;
+        pool.stats.allocations++;
+        pool.stats.bytesAllocated += bytes;
     }
+
+    pool.bytesInUse += pool.sizes[color];
+    pool.stats.peakBytes = max( pool.stats.peakBytes, pool.bytesInUse );
 }
 
 /** ***************************************************************************
  * @author Cameron Custer
  *
  * @par Description:
- * This function frees the memory from a dynamically allocated 2 dimensional
- * array by freeing the space in every column of every row. This function uses
- * a nested for loop.
+ * This function gives a plane back to the pool so a later call to allocArray
+ * can reuse it, and resets the pointer so the plane can not be released
+ * twice. When the pool already holds as many planes as it keeps, the one
+ * released longest ago is freed, so planes left by a large image that
+ * later requests are too small to reuse do not stay in the pool for good.
+ *
+ * @param[in, out] color - the pixel (unsigned char) plane to clear
  *
- * @param[in] color - the pixel (unsigned char) 2 dimensional array to clear
- * @param[in] rows - an intiger representing the number of rows in the array
+ * @returns none
+ *****************************************************************************/
+void free2d( pixel *&color )
+{
+    // variables
+    lock_guard<mutex> guard( pool.lock );
+
+    if( color == nullptr )
+    {
+        return;
+    }
+    pool.bytesInUse -= pool.sizes[color];
+    pool.released.push_back( color );
+    pool.stats.releases++;
+    color = nullptr;
+
+    // the planes are kept in the order they were released, so once the pool
+    // is full the first has waited longest
+    if( pool.released.size( ) > POOL_BLOCKS )
+    {
+        pool.sizes.erase( pool.released.front( ) );
+        free( pool.released.front( ) );
+        pool.released.erase( pool.released.begin( ) );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function frees the data of every plane waiting in the pool. Planes
+ * still handed out are not affected.
  *
  * @returns none
  *****************************************************************************/
-void free2d( pixel **&color, int rows )
+void trimPlanes( )
 {
-    int i;
-    // free the data allocated for the 2 dimensional arrays of pixels
-    for( i = 0; i < rows; i++ )
+    // variables
+    lock_guard<mutex> guard( pool.lock );
+
+    for( pixel *color : pool.released )
     {
-        delete[] color[i];
+        pool.sizes.erase( color );
+        free( color );
     }
-    delete[] color;
+    pool.released.clear( );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function returns the counts kept by the pool of planes: how many
+ * planes were allocated from the system and how many bytes they hold, how
+ * many requests were met with a released plane, how many planes were
+ * released, and the most bytes handed out at once.
+ *
+ * @returns the counts of the pool
+ *****************************************************************************/
+poolStats planePoolStats( )
+{
+    // variables
+    lock_guard<mutex> guard( pool.lock );
+
+    return pool.stats;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function outputs the counts kept by the pool of planes on one line.
+ *
+ * @param[in, out] out - the stream receiving the counts
+ *
+ * @returns none
+ *****************************************************************************/
+void reportPlanePool( ostream &out )
+{
+    // variables
+    poolStats stats = planePoolStats( );
+
+    out << "planes: " << stats.allocations << " allocated ("
+        << stats.bytesAllocated << " bytes), " << stats.reuses
+        << " reused, " << stats.releases << " released, peak "
+        << stats.peakBytes << " bytes" << endl;
 }
@@ -0,0 +1,208 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the functions which build point operations as lookup
+* tables, compose them, and apply them to runs of samples
+******************************************************************************/
+
+#include <vector>
+#include "netPBM.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function builds the table which leaves every sample as it is.
+ *
+ * @returns the identity table
+ *****************************************************************************/
+pointTable identityTable( )
+{
+    // variables
+    pointTable table;
+    int v;
+
+    for( v = 0; v < 256; v++ )
+    {
+        table.map[v] = v;
+    }
+    return table;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function builds the table of a single point operation. Negate
+ * subtracts the sample from 255 and brighten adds the value of the step,
+ * limiting the result to between 0 and 255. The value is first limited to
+ * between -255 and 255, which changes nothing about the result but keeps
+ * the brighten kernels from negating a value that does not fit in an int.
+ * Any other operation, and a brighten by zero, gives the identity table.
+ *
+ * @param[in] step - the operation to build the table of
+ *
+ * @returns the table of the operation
+ *****************************************************************************/
+pointTable stepTable( const operationStep &step )
+{
+    // variables
+    pointTable table = identityTable( );
+    int v, value = max( -255, min( 255, step.value ) );
+
+    if( step.op == Negate || ( step.op == Brighten && value != 0 ) )
+    {
+        for( v = 0; v < 256; v++ )
+        {
+            table.map[v] = step.op == Negate ? 255 - v :
+                max( 0, min( 255, v + value ) );
+        }
+        table.step = step;
+        table.step.value = step.op == Brighten ? value : 0;
+        table.identity = false;
+    }
+    return table;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function builds the table which contrasts gray samples by stretching
+ * the values between the minimum and maximum of the image to the range 0 to
+ * 255. A sample is scaled by 255 / ( max - min ) after the minimum is taken
+ * away and the result is truncated, as the contrast operation has always
+ * done. Values outside the range, which the image does not hold, are
+ * limited to 0 and 255. When every gray sample has the same value the image
+ * becomes black.
+ *
+ * @param[in] max - the maximum gray value of the image
+ * @param[in] min - the minimum gray value of the image
+ *
+ * @returns the contrast table
+ *****************************************************************************/
+pointTable contrastTable( int max, int min )
+{
+    // variables
+    pointTable table;
+    double scale, testValue;
+    int v;
+
+    // determine the scale value based on the maximum and minimum values
+    scale = max > min ? 255.0 / ( max - min ) : 0.0;
+
+    for( v = 0; v < 256; v++ )
+    {
+        testValue = scale * ( v - min );
+
+        // boundry checking
+        if( testValue > 255.0 )
+        {
+            table.map[v] = 255;
+        }
+        else if( testValue < 0.0 )
+        {
+            table.map[v] = 0;
+        }
+        else
+        {
+            table.map[v] = (int) testValue;
+        }
+    }
+    table.identity = false;
+    return table;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function composes two tables into one which gives the same result as
+ * applying the first and then the second. Composing with the identity table
+ * keeps the other table, along with the kernel it can run with.
+ *
+ * @param[in] first - the table applied first
+ * @param[in] second - the table applied to the result of the first
+ *
+ * @returns the composed table
+ *****************************************************************************/
+pointTable composeTables( const pointTable &first, const pointTable &second )
+{
+    // variables
+    pointTable table;
+    int v;
+
+    if( first.identity )
+    {
+        return second;
+    }
+    if( second.identity )
+    {
+        return first;
+    }
+
+    for( v = 0; v < 256; v++ )
+    {
+        table.map[v] = second.map[first.map[v]];
+    }
+    table.identity = false;
+    return table;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function composes a chain of point operations into a single table,
+ * so the whole chain is applied with one lookup per sample.
+ *
+ * @param[in] chain - the point operations, in the order they are applied
+ *
+ * @returns the table of the chain
+ *****************************************************************************/
+pointTable chainTable( const vector<operationStep> &chain )
+{
+    // variables
+    pointTable table = identityTable( );
+
+    for( const operationStep &step : chain )
+    {
+        table = composeTables( table, stepTable( step ) );
+    }
+    return table;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function applies a table to a run of samples in place. A table made
+ * from a single negate or brighten runs with that kernel, the identity
+ * table does nothing, and any other table runs with the lookup kernel.
+ *
+ * @param[in] table - the table to apply
+ * @param[in, out] samples - the samples to change in place
+ * @param[in] count - the number of samples
+ *
+ * @returns none
+ *****************************************************************************/
+void applyTable( const pointTable &table, pixel *samples, size_t count )
+{
+    if( table.identity )
+    {
+        return;
+    }
+    if( table.step.op == Negate )
+    {
+        kernels.negate( samples, count );
+    }
+    else if( table.step.op == Brighten )
+    {
+        kernels.brighten( samples, count, table.step.value );
+    }
+    else
+    {
+        kernels.lookup( samples, count, table.map );
+    }
+}
@@ -0,0 +1,495 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the streaming pipeline which passes the rows of an image
+* from the input file through an operation to the output file
+******************************************************************************/
+
+#include <vector>
+#include "netPBM.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @brief the number of bytes read from the input file and buffered for the
+ * output file at a time.
+ *****************************************************************************/
+static const size_t STREAM_BLOCK = 1 << 20;
+
+/** ***************************************************************************
+ * @brief the input side of the pipeline, producing one row at a time.
+ *****************************************************************************/
+struct rowSource
+{
+    ifstream *file = nullptr; /*!< the input image file, positioned in the
+                              pixel data */
+    const image *specifications = nullptr; /*!< the header of the input
+                                           image */
+    bool ascii = false; /*!< true for P3 pixel data, false for P6 */
+    vector<pixel> buffer; /*!< the bytes read but not yet decoded */
+    size_t pos = 0; /*!< the first byte of the buffer not yet decoded */
+    size_t fill = 0; /*!< one past the last byte read into the buffer */
+    bool final = false; /*!< true once the file has no more bytes */
+};
+
+/** ***************************************************************************
+ * @brief the rows of the input kept for a stencil. Each row is stored twice,
+ * in slot row % height and in slot row % height + height, so the height
+ * rows ending at the newest are always contiguous in each plane.
+ *****************************************************************************/
+struct rowWindow
+{
+    int height = 1; /*!< the number of rows the stencil reads */
+    int stride = 0; /*!< the number of bytes between rows of the planes */
+    pixel *planes[3] = { nullptr, nullptr, nullptr }; /*!< the red, green,
+                                                      and blue rows */
+};
+
+/** ***************************************************************************
+ * @brief the output side of the pipeline, collecting rows into large writes.
+ *****************************************************************************/
+struct rowSink
+{
+    ofstream *file = nullptr; /*!< the output image file */
+    bool ascii = false; /*!< true to write Ascii text, false for binary
+                        bytes */
+    vector<char> buffer; /*!< the bytes waiting to be written */
+    size_t fill = 0; /*!< the number of bytes waiting in the buffer */
+};
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads the next row of the image into a row of each color
+ * plane. Binary rows are read and deinterleaved. Ascii rows are decoded
+ * once the buffer holds all of their samples, more of the file being read
+ * as needed. The row view given to decodeAscii has a stride of zero, so
+ * every row of the image lands in the same row buffers while errors still
+ * name the sample of the whole image. If the data is invalid or ends early
+ * the problem is described in the error.
+ *
+ * @param[in, out] source - the input side of the pipeline
+ * @param[in] row - the index of the row in the image
+ * @param[out] red - the row receiving the red samples
+ * @param[out] green - the row receiving the green samples
+ * @param[out] blue - the row receiving the blue samples
+ * @param[out] error - a description of the problem when the row is invalid
+ *
+ * @returns true - the row was read
+ * @returns false - the row is invalid
+ *****************************************************************************/
+static bool readStreamRow( rowSource &source, int row, pixel *red,
+                           pixel *green, pixel *blue, string &error )
+{
+    // variables
+    int cols = source.specifications->cols;
+    size_t count = (size_t) 3 * cols;
+    const pixel *stop;
+    image rowView;
+
+    if( !source.ascii )
+    {
+        source.file->read( (char *) source.buffer.data( ), count );
+        if( (size_t) source.file->gcount( ) < count )
+        {
+            error = "the image data ends after " +
+                to_string( row * count + source.file->gcount( ) ) + " of " +
+                to_string( count * source.specifications->rows ) + " bytes";
+            return false;
+        }
+        deinterleaveRGB( source.buffer.data( ), red, green, blue, cols );
+        return true;
+    }
+
+    // read until the buffer holds every sample of the row
+    while( ( stop = findAsciiSamples( source.buffer.data( ) + source.pos,
+                                      source.buffer.data( ) + source.fill,
+                                      count, source.final ) ) == nullptr &&
+           !source.final )
+    {
+        // move the bytes not yet decoded to the front and read behind them
+        move( source.buffer.begin( ) + source.pos,
+              source.buffer.begin( ) + source.fill, source.buffer.begin( ) );
+        source.fill -= source.pos;
+        source.pos = 0;
+        if( source.fill == source.buffer.size( ) )
+        {
+            source.buffer.resize( 2 * source.buffer.size( ) );
+        }
+        source.file->read( (char *) source.buffer.data( ) + source.fill,
+                           source.buffer.size( ) - source.fill );
+        source.fill += source.file->gcount( );
+        source.final = source.file->eof( );
+    }
+
+    // a short or invalid row is reported by decodeAscii
+    if( stop == nullptr )
+    {
+        stop = source.buffer.data( ) + source.fill;
+    }
+    rowView.rows = source.specifications->rows;
+    rowView.cols = cols;
+    rowView.red = red;
+    rowView.green = green;
+    rowView.blue = blue;
+    if( !decodeAscii( source.buffer.data( ) + source.pos, stop,
+                      (size_t) row * count, count,
+                      sampleLimit( *source.specifications ), rowView,
+                      error ) )
+    {
+        return false;
+    }
+    source.pos = stop - source.buffer.data( );
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function writes everything waiting in the buffer of the output side
+ * of the pipeline to the output file.
+ *
+ * @param[in, out] sink - the output side of the pipeline
+ *
+ * @returns none
+ *****************************************************************************/
+static void flushStreamRows( rowSink &sink )
+{
+    sink.file->write( sink.buffer.data( ), sink.fill );
+    sink.fill = 0;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function adds a row of the output image to the buffer of the output
+ * side of the pipeline, writing the buffer first if the row does not fit.
+ * The gray row is written when there is one, the color rows otherwise.
+ *
+ * @param[in, out] sink - the output side of the pipeline
+ * @param[in] red - the red samples of the row
+ * @param[in] green - the green samples of the row
+ * @param[in] blue - the blue samples of the row
+ * @param[in] gray - the gray samples of the row, or nullptr
+ * @param[in] cols - the number of pixels in the row
+ *
+ * @returns none
+ *****************************************************************************/
+static void writeStreamRow( rowSink &sink, const pixel *red,
+                            const pixel *green, const pixel *blue,
+                            const pixel *gray, int cols )
+{
+    // variables
+    size_t need = (size_t) ( sink.ascii ? 4 : 1 ) *
+        ( gray != nullptr ? 1 : 3 ) * cols;
+    char *out;
+
+    if( sink.fill + need > sink.buffer.size( ) )
+    {
+        flushStreamRows( sink );
+    }
+    out = sink.buffer.data( ) + sink.fill;
+
+    if( sink.ascii && gray != nullptr )
+    {
+        sink.fill = formatAscii( gray, cols, out ) - sink.buffer.data( );
+    }
+    else if( sink.ascii )
+    {
+        sink.fill = formatAscii( red, green, blue, cols, out ) -
+            sink.buffer.data( );
+    }
+    else if( gray != nullptr )
+    {
+        copy( gray, gray + cols, (pixel *) out );
+        sink.fill += cols;
+    }
+    else
+    {
+        interleaveRGB( red, green, blue, (pixel *) out, cols );
+        sink.fill += (size_t) 3 * cols;
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function passes every row of the image once through the chain of
+ * operations. The point operations before the stencil are applied to each
+ * row as it is read. Rows are kept in the window until the last row of the
+ * window around an output row has been read; the stencil then writes the
+ * output row, the point operations after it are applied, and the row is
+ * converted to gray when the output is grayscaled. Rows whose window runs
+ * past the image are set to zero before the point operations after the
+ * stencil. When there is no sink the gray rows are only counted, which
+ * gives contrast and equalize the histogram of the image; otherwise the
+ * table derived from it is applied and each row is written. Passing stops
+ * at the first row that can not be read.
+ *
+ * @param[in, out] source - the input side of the pipeline
+ * @param[in, out] window - the rows kept for the stencil
+ * @param[in, out] sink - the output side of the pipeline, or nullptr
+ * @param[in] rows - the number of rows in the image
+ * @param[in] cols - the number of columns in the image
+ * @param[in] before - the table of the point operations applied as each row
+ * is read
+ * @param[in] filter - the stencil, or nullptr
+ * @param[in] radius - the number of rows the stencil reaches on each side
+ * @param[in] after - the table of the point operations applied after the
+ * stencil
+ * @param[in] last - the operation ending the chain: Grayscale, Contrast,
+ * Equalize, or None for color output
+ * @param[out] out - a row of each color plane for the stencil output
+ * @param[out] gray - a row for the gray output
+ * @param[in, out] counts - the histogram of the gray rows counted
+ * @param[in] tone - the table applied to the gray rows written
+ * @param[out] error - a description of the problem when a row is invalid
+ *
+ * @returns true - every row was passed through
+ * @returns false - a row of the image is invalid
+ *****************************************************************************/
+static bool streamRows( rowSource &source, rowWindow &window, rowSink *sink,
+                        int rows, int cols,
+                        const pointTable &before, stencilFilter filter,
+                        int radius, const pointTable &after, operation last,
+                        pixel *out[3], pixel *gray, histogram &counts,
+                        const pointTable &tone, string &error )
+{
+    // variables
+    int row, next, k, rowMax = 0, rowMin = 255;
+    pixel *rgb[3];
+
+    // output a row once the last row of its window has been read, and the
+    // rows whose window runs past the image after the last read
+    for( row = 0, next = 0; next < rows; )
+    {
+        if( row < rows )
+        {
+            for( k = 0; k < 3; k++ )
+            {
+                rgb[k] = planeRow( window.planes[k], window.stride,
+                                   row % window.height );
+            }
+            if( !readStreamRow( source, row, rgb[0], rgb[1], rgb[2],
+                                error ) )
+            {
+                return false;
+            }
+            for( k = 0; k < 3; k++ )
+            {
+                applyTable( before, rgb[k], cols );
+                if( window.height > 1 )
+                {
+                    copy( rgb[k], rgb[k] + cols, rgb[k] +
+                          (size_t) window.height * window.stride );
+                }
+            }
+            row++;
+            if( next + radius >= row )
+            {
+                continue;
+            }
+        }
+
+        for( k = 0; k < 3; k++ )
+        {
+            if( filter == nullptr )
+            {
+                rgb[k] = planeRow( window.planes[k], window.stride, 0 );
+            }
+            // run the stencil on the window, zeroing the border pixels
+            else if( next < radius || next >= rows - radius ||
+                     cols <= 2 * radius )
+            {
+                fill( out[k], out[k] + cols, 0 );
+                rgb[k] = out[k];
+            }
+            else
+            {
+                fill( out[k], out[k] + radius, 0 );
+                fill( out[k] + cols - radius, out[k] + cols, 0 );
+                filter( planeRow( window.planes[k], window.stride,
+                                  ( next - radius ) % window.height ),
+                        window.stride, out[k] + radius, window.stride,
+                        cols - 2 * radius, radius, 0, 1, nullptr );
+                rgb[k] = out[k];
+            }
+            applyTable( after, rgb[k], cols );
+        }
+
+        if( last == None )
+        {
+            writeStreamRow( *sink, rgb[0], rgb[1], rgb[2], nullptr, cols );
+        }
+        else if( sink == nullptr )
+        {
+            grayscaleRow( rgb[0], rgb[1], rgb[2], gray, cols, rowMax,
+                          rowMin );
+            countGrayRow( gray, cols, counts );
+        }
+        else
+        {
+            grayscaleRow( rgb[0], rgb[1], rgb[2], gray, cols, rowMax,
+                          rowMin );
+            applyTable( tone, gray, cols );
+            writeStreamRow( *sink, rgb[0], rgb[1], rgb[2], gray, cols );
+        }
+        next++;
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads, operates on, and writes an image one row at a time,
+ * so only the rows the operations need are held in memory instead of the
+ * whole image. The chain may hold point operations, at most one stencil
+ * with point operations on either side, and may end with grayscale or
+ * contrast or equalize. Without a stencil one row is kept; sharpen and
+ * smooth keep the window of 2 * radius + 1 rows around the row they output,
+ * and a row is written as soon as the last row of its window is read.
+ * Contrast and equalize need the histogram of the whole image before any
+ * row is written, so the pixel data is passed through twice: once to count
+ * the gray values and once to output the rows.
+ * The output is the same as reading the whole image.
+ *
+ * If the pixel data is invalid the problem is described in the error and
+ * the output holds only the rows written before it. The image can not be
+ * streamed, and nothing is read or written, when the chain holds more than
+ * one stencil, when a stencil uses a border mode
+ * other than zero, when contrast or equalize is given an input which can not
+ * be read twice, or when the input is not a P3 or P6 image. The caller
+ * should then read the whole image instead.
+ *
+ * @param[in, out] imageFile - the input image file, positioned after the
+ * image header
+ * @param[in, out] writeFile - the output image file
+ * @param[in, out] specifications - the structure containing the image
+ * header, given the encoder type of the output
+ * @param[in] steps - the operations performed on each row, in order
+ * @param[in] grayCheck - a boolean specifying wether the output image is
+ * grayscaled
+ * @param[in] asciiCheck - a boolean specifying wether the output image is
+ * written as Ascii text or binary bytes
+ * @param[out] error - a description of the problem when the pixel data is
+ * invalid, left empty when the image can not be streamed
+ *
+ * @returns true - the image was streamed to the output file
+ * @returns false - the image can not be streamed, or its pixel data is
+ * invalid
+ *****************************************************************************/
+bool streamImage( ifstream &imageFile, ofstream &writeFile,
+                  image &specifications, const vector<operationStep> &steps,
+                  bool grayCheck, bool asciiCheck, string &error )
+{
+    // variables
+    int cols = specifications.cols, radius = 0, percent = 0;
+    int k;
+    size_t i = 0;
+    stencilFilter filter = nullptr;
+    operation last = None;
+    pointTable before = identityTable( ), after = identityTable( );
+    pointTable tone = identityTable( );
+    histogram counts;
+    streampos body = imageFile.tellg( );
+    rowSource source;
+    rowWindow window;
+    rowSink sink;
+    pixel *out[3] = { nullptr, nullptr, nullptr }, *gray = nullptr;
+    bool passed = true;
+
+    // split the chain into the tables of the point operations before and
+    // after the stencil and the operation ending it
+    for( ; i < steps.size( ) && ( steps[i].op == Negate ||
+                                  steps[i].op == Brighten ); i++ )
+    {
+        before = composeTables( before, stepTable( steps[i] ) );
+    }
+    if( i < steps.size( ) && ( filter = stencilFor( steps[i].op ) ) )
+    {
+        radius = steps[i].op == Smooth ? steps[i].value : 1;
+        for( i++; i < steps.size( ) && ( steps[i].op == Negate ||
+                                         steps[i].op == Brighten ); i++ )
+        {
+            after = composeTables( after, stepTable( steps[i] ) );
+        }
+    }
+    if( i < steps.size( ) && grayOperation( steps[i] ) )
+    {
+        last = steps[i].op;
+        percent = steps[i++].value;
+    }
+
+    if( i < steps.size( ) ||
+        ( specifications.encType != "P3" && specifications.encType != "P6" ) ||
+        ( filter != nullptr && specifications.border != Zero ) ||
+        ( ( last == Contrast || last == Equalize ) &&
+          body == streampos( -1 ) ) )
+    {
+        return false;
+    }
+
+    // set up the input side, the window of rows, and the output side
+    source.file = &imageFile;
+    source.specifications = &specifications;
+    source.ascii = specifications.encType == "P3";
+    source.buffer.resize( max<size_t>( STREAM_BLOCK, (size_t) 3 * cols ) );
+    window.height = 2 * radius + 1;
+    window.stride = planeStride( cols );
+    for( k = 0; k < 3; k++ )
+    {
+        allocArray( window.planes[k], 2 * window.height, window.stride );
+        allocArray( out[k], 1, window.stride );
+    }
+    allocArray( gray, 1, window.stride );
+    sink.file = &writeFile;
+    sink.buffer.resize( max<size_t>( STREAM_BLOCK, (size_t) 12 * cols ) );
+
+    // contrast and equalize count the gray values of the image first, then
+    // start over
+    if( last == Contrast || last == Equalize )
+    {
+        passed = streamRows( source, window, nullptr, specifications.rows,
+                             cols, before, filter, radius, after, last, out,
+                             gray, counts, tone, error );
+        tone = last == Equalize ? equalizeTable( counts ) :
+            stretchTable( counts, percent );
+        imageFile.clear( );
+        imageFile.seekg( body );
+        source.pos = source.fill = 0;
+        source.final = false;
+    }
+
+    // set the encoder type of the output and write its header
+    if( asciiCheck )
+    {
+        specifications.encType = grayCheck ? "P2" : "P3";
+    }
+    else
+    {
+        specifications.encType = grayCheck ? "P5" : "P6";
+    }
+    sink.ascii = asciiCheck;
+    if( passed )
+    {
+        writeImageHeader( writeFile, specifications );
+        passed = streamRows( source, window, &sink, specifications.rows,
+                             cols, before, filter, radius, after, last, out,
+                             gray, counts, tone, error );
+        flushStreamRows( sink );
+    }
+
+    // free the rows held by the pipeline
+    for( k = 0; k < 3; k++ )
+    {
+        free2d( window.planes[k] );
+        free2d( out[k] );
+    }
+    free2d( gray );
+    return passed;
+}
@@ -0,0 +1,150 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the functions which gather and report the statistics of a
+* run of image_operations, part of it but not the library
+******************************************************************************/
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "imageProgram.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function adds the data of an image handled by the run to its
+ * statistics: its pixels, and the bytes of the input file when it was
+ * mapped or is a regular file. The times of the stages and the bytes
+ * written are gathered by the caller.
+ *
+ * @param[in, out] stats - the statistics of the run
+ * @param[in] specifications - the image handled
+ * @param[in] path - the path of the input image file
+ *
+ * @returns none
+ *****************************************************************************/
+void countImage( runStats &stats, const image &specifications,
+                 const char *path )
+{
+    struct stat status;
+
+    stats.pixels += (size_t) specifications.rows * specifications.cols;
+    if( specifications.mapping != nullptr )
+    {
+        stats.bytesRead += specifications.mappingSize;
+    }
+    else if( stat( path, &status ) == 0 && S_ISREG( status.st_mode ) )
+    {
+        stats.bytesRead += status.st_size;
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function adds the times and counts of part of a run, such as one
+ * image of a batch, to the statistics of the whole run. The times of the
+ * stages of images handled at once add up, so they may exceed the time of
+ * the whole run.
+ *
+ * @param[in, out] total - the statistics of the run
+ * @param[in] part - the statistics of the part
+ *
+ * @returns none
+ *****************************************************************************/
+void mergeStats( runStats &total, const runStats &part )
+{
+    total.open += part.open;
+    total.read += part.read;
+    total.operate += part.operate;
+    total.write += part.write;
+    total.stream += part.stream;
+    total.bytesRead += part.bytesRead;
+    total.bytesWritten += part.bytesWritten;
+    total.pixels += part.pixels;
+    total.images += part.images;
+    total.failures += part.failures;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function fills in the statistics known once the run is done: the
+ * counts of the pool of planes and the peak resident memory of the
+ * process.
+ *
+ * @param[in, out] stats - the statistics of the run
+ *
+ * @returns none
+ *****************************************************************************/
+void finishStats( runStats &stats )
+{
+    struct rusage usage;
+
+    stats.planes = planePoolStats( );
+    if( getrusage( RUSAGE_SELF, &usage ) == 0 )
+    {
+        stats.peakRss = usage.ru_maxrss;
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function outputs the statistics of a run, either one statistic per
+ * line or as a single JSON object. Times are in seconds and the
+ * throughput is the pixels of the image over the whole run.
+ *
+ * @param[in, out] out - the stream receiving the statistics
+ * @param[in] stats - the statistics of the run
+ * @param[in] format - TextStats or JsonStats
+ *
+ * @returns none
+ *****************************************************************************/
+void reportStats( ostream &out, const runStats &stats, statsFormat format )
+{
+    double rate = stats.total > 0 ? stats.pixels / stats.total / 1e6 : 0;
+    streamsize precision = out.precision( 6 );
+
+    if( format == JsonStats )
+    {
+        out << "{\"open_s\": " << stats.open << ", \"read_s\": "
+            << stats.read << ", \"operate_s\": " << stats.operate
+            << ", \"write_s\": " << stats.write << ", \"stream_s\": "
+            << stats.stream << ", \"total_s\": " << stats.total
+            << ", \"images\": " << stats.images << ", \"failures\": "
+            << stats.failures << ", \"bytes_read\": " << stats.bytesRead
+            << ", \"bytes_written\": " << stats.bytesWritten
+            << ", \"pixels\": " << stats.pixels << ", \"mp_per_s\": "
+            << rate << ", \"plane_allocations\": "
+            << stats.planes.allocations << ", \"plane_reuses\": "
+            << stats.planes.reuses << ", \"plane_peak_bytes\": "
+            << stats.planes.peakBytes << ", \"peak_rss_kb\": "
+            << stats.peakRss << "}" << endl;
+    }
+    else
+    {
+        out << "open:          " << stats.open << " s" << endl
+            << "read:          " << stats.read << " s" << endl
+            << "operate:       " << stats.operate << " s" << endl
+            << "write:         " << stats.write << " s" << endl
+            << "stream:        " << stats.stream << " s" << endl
+            << "total:         " << stats.total << " s" << endl
+            << "images:        " << stats.images << ", " << stats.failures
+            << " failed" << endl
+            << "bytes read:    " << stats.bytesRead << endl
+            << "bytes written: " << stats.bytesWritten << endl
+            << "pixels:        " << stats.pixels << " (" << rate
+            << " MP/s)" << endl
+            << "allocations:   " << stats.planes.allocations << " planes, "
+            << stats.planes.reuses << " reused, peak "
+            << stats.planes.peakBytes << " bytes" << endl
+            << "peak rss:      " << stats.peakRss << " KB" << endl;
+    }
+    out.precision( precision );
+}
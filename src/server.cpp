@@ -0,0 +1,687 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the server mode of image_operations, which handles
+* requests sent over a Unix socket, part of it but not the library
+******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <poll.h>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "imageProgram.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @brief the number of the latest request latencies kept for the
+ * percentiles.
+ *****************************************************************************/
+static const size_t LATENCY_SAMPLES = 4096;
+
+/** ***************************************************************************
+ * @brief the most bytes of pixels accepted in a single request.
+ *****************************************************************************/
+static const size_t PAYLOAD_LIMIT = (size_t) 1 << 31;
+
+/** ***************************************************************************
+ * @brief the seconds a handler thread waits on a client that stops sending
+ * or reading in the middle of a request before closing the connection.
+ *****************************************************************************/
+static const int STALL_SECONDS = 30;
+
+/** ***************************************************************************
+ * @brief a connection accepted by the server. It is watched while idle and
+ * waits for a thread once a whole request line has arrived.
+ *****************************************************************************/
+struct clientConnection
+{
+    socketReader reader; /*!< the socket and the bytes received from it */
+    chrono::steady_clock::time_point arrived; /*!< when its request line
+                                              arrived */
+};
+
+/** ***************************************************************************
+ * @brief one request sent to the server, read from a line of text in the
+ * form of the command line of image_operations.
+ *****************************************************************************/
+struct serverRequest
+{
+    bool stats = false; /*!< true to ask for the statistics of the server */
+    bool pixels = false; /*!< true when the pixels follow the line, false
+                         when the request names files */
+    int rows = 0; /*!< the rows of the pixels that follow */
+    int cols = 0; /*!< the columns of the pixels that follow */
+    vector<string> operations; /*!< the options of the chain */
+    borderMode border = Zero; /*!< how sharpen and smooth treat the edges */
+    bool asciiCheck = false; /*!< true to write the output as Ascii text */
+    string output; /*!< the output basename of a request naming files */
+    string input; /*!< the input image of a request naming files */
+};
+
+/** ***************************************************************************
+ * @brief the state shared by the thread accepting connections and the
+ * threads handling them.
+ *****************************************************************************/
+struct serverState
+{
+    mutex lock; /*!< guards the fields below */
+    condition_variable ready; /*!< signals a connection is waiting */
+    deque<clientConnection> waiting; /*!< the connections with a request
+                                     line, not yet taken */
+    vector<clientConnection> idle; /*!< the connections handed back with no
+                                   request line, to be watched again */
+    int wake = -1; /*!< an eventfd telling the watching thread connections
+                   were handed back */
+    vector<int> open; /*!< the sockets of the connections being handled */
+    size_t peakDepth = 0; /*!< the most connections waiting at once */
+    size_t served = 0; /*!< the requests answered */
+    size_t failed = 0; /*!< the requests answered with an error */
+    vector<double> latencies; /*!< the latest request latencies, seconds */
+    size_t nextLatency = 0; /*!< the sample replaced by the next latency */
+    bool stopping = false; /*!< true once the server is shutting down */
+};
+
+/** ***************************************************************************
+ * @brief the server used by the program. It is never destroyed, so threads
+ * handling connections may still use it while the program exits.
+ *****************************************************************************/
+static serverState &server = *new serverState;
+
+/** ***************************************************************************
+ * @brief set by SIGINT and SIGTERM to shut the server down.
+ *****************************************************************************/
+static volatile sig_atomic_t stopRequested = 0;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function handles SIGINT and SIGTERM by asking the server to stop.
+ *
+ * @param[in] number - the signal received
+ *
+ * @returns none
+ *****************************************************************************/
+static void requestStop( int number )
+{
+    stopRequested = 1;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function reads a request from a line of text. The line is
+ * "stats", asking for the statistics of the server, or options as on the
+ * command line of image_operations: an optional --border mode, the
+ * operations, and either -o[ab] basename image.ppm, naming the files to
+ * read and write, or --pixels cols rows, saying that many rows of
+ * interleaved red, green, and blue bytes follow the line.
+ *
+ * @param[in] line - the line of text
+ * @param[out] request - the request
+ * @param[out] error - a description of the problem when the line is
+ * invalid
+ *
+ * @returns true - the request was read
+ * @returns false - the line is not a request
+ *****************************************************************************/
+static bool parseRequest( const string &line, serverRequest &request,
+                          string &error )
+{
+    istringstream words( line );
+    vector<string> tokens;
+    string token;
+    size_t first = 0, last;
+    long rows, cols;
+
+    while( words >> token )
+    {
+        tokens.push_back( token );
+    }
+    if( tokens.size( ) == 1 && tokens[0] == "stats" )
+    {
+        request.stats = true;
+        return true;
+    }
+
+    // the border mode comes before the operations
+    while( first < tokens.size( ) && ( tokens[first] == "--border" ||
+           tokens[first].compare( 0, 9, "--border=" ) == 0 ) )
+    {
+        token = tokens[first] != "--border" ? tokens[first].substr( 9 ) :
+            first + 1 < tokens.size( ) ? tokens[++first] : "";
+        first++;
+        if( token == "zero" )
+        {
+            request.border = Zero;
+        }
+        else if( token == "clamp" )
+        {
+            request.border = Clamp;
+        }
+        else if( token == "reflect" )
+        {
+            request.border = Reflect;
+        }
+        else if( token == "wrap" )
+        {
+            request.border = Wrap;
+        }
+        else
+        {
+            error = "the border mode " + token + " is not zero, clamp, "
+                "reflect, or wrap";
+            return false;
+        }
+    }
+
+    // the request ends with the pixels or the files
+    last = tokens.size( );
+    if( last >= first + 3 && tokens[last - 3] == "--pixels" )
+    {
+        rows = strtol( tokens[last - 1].c_str( ), nullptr, 10 );
+        cols = strtol( tokens[last - 2].c_str( ), nullptr, 10 );
+        if( rows <= 0 || cols <= 0 || rows > INT_MAX || cols > INT_MAX ||
+            (size_t) rows * cols > PAYLOAD_LIMIT / 3 )
+        {
+            error = "the size of the pixels is invalid";
+            return false;
+        }
+        request.pixels = true;
+        request.rows = (int) rows;
+        request.cols = (int) cols;
+    }
+    else if( last >= first + 3 && ( tokens[last - 3] == "-oa" ||
+                                     tokens[last - 3] == "-ob" ) )
+    {
+        request.asciiCheck = tokens[last - 3] == "-oa";
+        request.output = tokens[last - 2];
+        request.input = tokens[last - 1];
+    }
+    else
+    {
+        error = "the request must end with -o[ab] basename image.ppm or "
+            "--pixels cols rows";
+        return false;
+    }
+    request.operations.assign( tokens.begin( ) + first,
+                               tokens.begin( ) + last - 3 );
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function records the latency of a request answered by the server.
+ *
+ * @param[in] seconds - the time from the request arriving to its answer
+ * @param[in] answered - false if the request was answered with an error
+ *
+ * @returns none
+ *****************************************************************************/
+static void recordLatency( double seconds, bool answered )
+{
+    lock_guard<mutex> guard( server.lock );
+
+    server.served++;
+    if( !answered )
+    {
+        server.failed++;
+    }
+    if( server.latencies.size( ) < LATENCY_SAMPLES )
+    {
+        server.latencies.push_back( seconds );
+    }
+    else
+    {
+        server.latencies[server.nextLatency] = seconds;
+    }
+    server.nextLatency = ( server.nextLatency + 1 ) % LATENCY_SAMPLES;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function describes the state of the server as a JSON object: the
+ * connections waiting for a thread and the most that ever waited, the
+ * connections being handled, the requests answered and failed, and the
+ * 50th, 90th, and 99th percentile and longest latencies of the latest
+ * LATENCY_SAMPLES requests in milliseconds.
+ *
+ * @returns the statistics of the server
+ *****************************************************************************/
+static string serverReport( )
+{
+    ostringstream out;
+    vector<double> sorted;
+    double p50 = 0, p90 = 0, p99 = 0, worst = 0;
+    lock_guard<mutex> guard( server.lock );
+
+    sorted = server.latencies;
+    sort( sorted.begin( ), sorted.end( ) );
+    if( !sorted.empty( ) )
+    {
+        p50 = sorted[( sorted.size( ) - 1 ) * 50 / 100] * 1e3;
+        p90 = sorted[( sorted.size( ) - 1 ) * 90 / 100] * 1e3;
+        p99 = sorted[( sorted.size( ) - 1 ) * 99 / 100] * 1e3;
+        worst = sorted.back( ) * 1e3;
+    }
+
+    out << "{\"queue_depth\": " << server.waiting.size( )
+        << ", \"peak_queue_depth\": " << server.peakDepth
+        << ", \"active\": " << server.open.size( )
+        << ", \"served\": " << server.served << ", \"failed\": "
+        << server.failed << ", \"latency_ms\": {\"p50\": " << p50
+        << ", \"p90\": " << p90 << ", \"p99\": " << p99 << ", \"max\": "
+        << worst << "}}";
+    return out.str( );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function answers one request. The statistics of the server are
+ * sent back as text. Pixels sent with the request are operated on with
+ * processImage, in buffers kept by the thread between requests, and sent
+ * back, one byte per pixel for a chain ending in gray and three otherwise.
+ * A request naming files is handled with processImageFile and nothing but
+ * the answer is sent back. An answer is a line "OK bytes [channels]"
+ * followed by that many bytes, or a line "ERROR" followed by the problem.
+ *
+ * @param[in, out] reader - the socket and the bytes received from it
+ * @param[in] line - the line of the request
+ * @param[in] options - the structure holding the defaults of the server
+ * @param[out] answered - false if the request was answered with an error
+ *
+ * @returns true - the connection may carry another request
+ * @returns false - the connection failed, the line was not a request, or
+ * the pixels of the request could not be received, and it must be closed
+ *****************************************************************************/
+static bool answerRequest( socketReader &reader, const string &line,
+                           const runOptions &options, bool &answered )
+{
+    // variables
+    static thread_local vector<pixel> inputScratch, outputScratch;
+    vector<pixel> &input = inputScratch, &output = outputScratch;
+    serverRequest request;
+    vector<operationStep> steps;
+    imageBuffer source, result;
+    runOptions settings;
+    runStats stats;
+    string error, reply;
+    bool gray, parsed;
+
+    request.border = options.border;
+    answered = parsed = parseRequest( line, request, error );
+
+    // the pixels are received even if the chain is invalid, so the next
+    // request starts in the right place
+    if( answered && request.pixels )
+    {
+        input.resize( (size_t) 3 * request.rows * request.cols );
+        if( !readSocketBytes( reader, input.data( ), input.size( ) ) )
+        {
+            return false;
+        }
+    }
+    if( answered && request.stats )
+    {
+        reply = serverReport( );
+        reply = "OK " + to_string( reply.size( ) ) + "\n" + reply;
+        return sendAll( reader.fd, reply.data( ), reply.size( ) );
+    }
+    answered = answered &&
+        parseOperations( request.operations, steps, error );
+    gray = !steps.empty( ) && grayOperation( steps.back( ) );
+
+    if( answered && request.pixels )
+    {
+        source.data = input.data( );
+        source.rows = result.rows = request.rows;
+        source.cols = result.cols = request.cols;
+        source.stride = (size_t) 3 * request.cols;
+        result.channels = gray ? 1 : 3;
+        result.stride = (size_t) result.channels * request.cols;
+        output.resize( result.stride * request.rows );
+        result.data = output.data( );
+        answered = processImage( source, result, steps, request.border,
+                                 error );
+        if( answered )
+        {
+            reply = "OK " + to_string( output.size( ) ) + " " +
+                to_string( result.channels ) + "\n";
+            return sendAll( reader.fd, reply.data( ), reply.size( ) ) &&
+                sendAll( reader.fd, output.data( ), output.size( ) );
+        }
+    }
+    else if( answered )
+    {
+        settings.border = request.border;
+        answered = processImageFile( request.input, request.output,
+                                     settings, steps, gray,
+                                     request.asciiCheck, stats, error );
+        if( answered )
+        {
+            reply = "OK 0\n";
+            return sendAll( reader.fd, reply.data( ), reply.size( ) );
+        }
+    }
+
+    // a line that is not a request may have had pixels after it, so the
+    // connection can not go on
+    reply = "ERROR " + error + "\n";
+    return sendAll( reader.fd, reply.data( ), reply.size( ) ) && parsed;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function answers the request lines already received on a
+ * connection, one after another, and returns as soon as no whole line is
+ * left, so an idle client never holds a thread. The latency of the first
+ * request counts from when its line arrived, so it includes the time spent
+ * waiting for a thread; that of the others sent along with it counts from
+ * when the one before was answered.
+ *
+ * @param[in, out] connection - the connection to serve
+ * @param[in] options - the structure holding the defaults of the server
+ *
+ * @returns true - the connection is idle and may carry more requests
+ * @returns false - the connection failed or must be closed
+ *****************************************************************************/
+static bool serveConnection( clientConnection &connection,
+                             const runOptions &options )
+{
+    chrono::steady_clock::time_point start = connection.arrived;
+    string line;
+    bool answered;
+
+    while( socketLineReady( connection.reader ) )
+    {
+        readSocketLine( connection.reader, line );
+        if( !answerRequest( connection.reader, line, options, answered ) )
+        {
+            return false;
+        }
+        recordLatency( chrono::duration<double>(
+            chrono::steady_clock::now( ) - start ).count( ), answered );
+        start = chrono::steady_clock::now( );
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function is the loop run by each thread handling connections. It
+ * takes the connection that has waited longest and answers the requests
+ * it holds. A connection left idle is handed back to be watched, and one
+ * that failed, or any once the server is stopping, is closed. The loop
+ * runs until the server stops and no connections are left waiting.
+ *
+ * @param[in] options - the structure holding the defaults of the server
+ *
+ * @returns none
+ *****************************************************************************/
+static void handleConnections( const runOptions &options )
+{
+    clientConnection connection;
+    unique_lock<mutex> guard( server.lock );
+    bool open;
+
+    while( true )
+    {
+        server.ready.wait( guard, [] { return server.stopping ||
+                                          !server.waiting.empty( ); } );
+        if( server.waiting.empty( ) )
+        {
+            return;
+        }
+        connection = move( server.waiting.front( ) );
+        server.waiting.pop_front( );
+        server.open.push_back( connection.reader.fd );
+        guard.unlock( );
+
+        open = serveConnection( connection, options );
+
+        guard.lock( );
+        server.open.erase( find( server.open.begin( ), server.open.end( ),
+                                 connection.reader.fd ) );
+        if( !open || server.stopping )
+        {
+            close( connection.reader.fd );
+            continue;
+        }
+        server.idle.push_back( move( connection ) );
+        eventfd_write( server.wake, 1 );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function accepts a connection waiting on the listening socket and
+ * adds it to those watched. A client that stalls in the middle of a
+ * request is dropped after STALL_SECONDS rather than holding a thread.
+ *
+ * @param[in] fd - the listening socket
+ * @param[in, out] watched - the idle connections
+ *
+ * @returns none
+ *****************************************************************************/
+static void acceptConnection( int fd, vector<clientConnection> &watched )
+{
+    clientConnection connection;
+    timeval stall = { STALL_SECONDS, 0 };
+
+    connection.reader.fd = accept4( fd, nullptr, nullptr, SOCK_CLOEXEC );
+    if( connection.reader.fd < 0 )
+    {
+        return;
+    }
+    setsockopt( connection.reader.fd, SOL_SOCKET, SO_RCVTIMEO, &stall,
+                sizeof( stall ) );
+    setsockopt( connection.reader.fd, SOL_SOCKET, SO_SNDTIMEO, &stall,
+                sizeof( stall ) );
+    watched.push_back( move( connection ) );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function receives the bytes that have arrived on the idle
+ * connections poll reported readable. A connection holding a whole
+ * request line is queued for a thread, one the client closed is closed,
+ * and the rest stay watched.
+ *
+ * @param[in, out] watched - the idle connections
+ * @param[in] polled - the result of poll for each idle connection, in the
+ * same order
+ *
+ * @returns none
+ *****************************************************************************/
+static void receiveRequests( vector<clientConnection> &watched,
+                             const pollfd *polled )
+{
+    vector<clientConnection> still;
+    size_t k, count = watched.size( );
+
+    for( k = 0; k < count; k++ )
+    {
+        if( polled[k].revents == 0 )
+        {
+            still.push_back( move( watched[k] ) );
+        }
+        else if( !receiveSocketBytes( watched[k].reader ) )
+        {
+            close( watched[k].reader.fd );
+        }
+        else if( !socketLineReady( watched[k].reader ) )
+        {
+            still.push_back( move( watched[k] ) );
+        }
+        else
+        {
+            watched[k].arrived = chrono::steady_clock::now( );
+            lock_guard<mutex> guard( server.lock );
+            server.waiting.push_back( move( watched[k] ) );
+            server.peakDepth = max( server.peakDepth,
+                                    server.waiting.size( ) );
+            server.ready.notify_one( );
+        }
+    }
+    watched.swap( still );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function runs image_operations as a server listening on a Unix
+ * socket, so each image costs a request instead of starting the program.
+ * This thread watches the idle connections with poll, and once a whole
+ * request line arrives on one it is queued and served by one of as many
+ * threads as the thread pool has, each request's operations running on the
+ * shared pool with planes from the shared pool of planes. A stale socket
+ * left at the path is replaced. The server runs until SIGINT or SIGTERM;
+ * it then stops accepting, lets the requests being handled finish, removes
+ * the socket, and reports its statistics on standard error when --stats
+ * was given.
+ *
+ * @param[in] path - the path of the socket
+ * @param[in] options - the structure holding the defaults of the server
+ *
+ * @returns 0 once the server stops, 1 if the socket could not be created
+ *****************************************************************************/
+int serveSocket( const string &path, const runOptions &options )
+{
+    // variables
+    sockaddr_un address;
+    struct stat status;
+    vector<pollfd> polled;
+    vector<clientConnection> watched;
+    vector<thread> handlers;
+    eventfd_t handedBack;
+    size_t k;
+    int fd;
+
+    fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    server.wake = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+    if( !socketAddress( path, address ) || fd < 0 || server.wake < 0 )
+    {
+        cout << "Unable to create socket: " << path << endl;
+        return 1;
+    }
+    if( lstat( path.c_str( ), &status ) == 0 && S_ISSOCK( status.st_mode ) )
+    {
+        unlink( path.c_str( ) );
+    }
+    if( bind( fd, (sockaddr *) &address, sizeof( address ) ) != 0 ||
+        listen( fd, SOMAXCONN ) != 0 )
+    {
+        cout << "Unable to listen on: " << path << endl;
+        close( fd );
+        return 1;
+    }
+
+    signal( SIGINT, requestStop );
+    signal( SIGTERM, requestStop );
+    signal( SIGPIPE, SIG_IGN );
+    for( k = 0; k < workerCount( ); k++ )
+    {
+        handlers.emplace_back( handleConnections, cref( options ) );
+    }
+
+    // watch the idle connections, the listening socket, and the
+    // connections handed back until asked to stop, checking for the request
+    // to stop a few times a second
+    while( !stopRequested )
+    {
+        polled.resize( watched.size( ) + 2 );
+        for( k = 0; k < watched.size( ); k++ )
+        {
+            polled[k] = { watched[k].reader.fd, POLLIN, 0 };
+        }
+        polled[k] = { fd, POLLIN, 0 };
+        polled[k + 1] = { server.wake, POLLIN, 0 };
+        if( poll( polled.data( ), polled.size( ), 200 ) <= 0 )
+        {
+            continue;
+        }
+
+        receiveRequests( watched, polled.data( ) );
+        if( polled[k].revents != 0 )
+        {
+            acceptConnection( fd, watched );
+        }
+        if( polled[k + 1].revents != 0 )
+        {
+            eventfd_read( server.wake, &handedBack );
+            lock_guard<mutex> guard( server.lock );
+            move( server.idle.begin( ), server.idle.end( ),
+                  back_inserter( watched ) );
+            server.idle.clear( );
+        }
+    }
+    close( fd );
+    unlink( path.c_str( ) );
+    for( clientConnection &connection : watched )
+    {
+        close( connection.reader.fd );
+    }
+
+    // stop reading from the clients so the threads finish once the requests
+    // in hand are answered
+    {
+        lock_guard<mutex> guard( server.lock );
+        server.stopping = true;
+        for( int client : server.open )
+        {
+            shutdown( client, SHUT_RD );
+        }
+        for( clientConnection &queued : server.waiting )
+        {
+            close( queued.reader.fd );
+        }
+        for( clientConnection &handed : server.idle )
+        {
+            close( handed.reader.fd );
+        }
+        server.waiting.clear( );
+        server.idle.clear( );
+        server.ready.notify_all( );
+    }
+    for( thread &handler : handlers )
+    {
+        handler.join( );
+    }
+    close( server.wake );
+
+    if( options.statsReport != NoStats )
+    {
+        cerr << serverReport( ) << endl;
+    }
+    return 0;
+}
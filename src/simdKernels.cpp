@@ -0,0 +1,1056 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the vectorized kernels which move pixels between the
+* interleaved file layout and the color planes, and which map samples on
+* their own
+******************************************************************************/
+
+#include <immintrin.h>
+#include "netPBM.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @brief shuffle masks gathering one color from each 16 byte third of 16
+ * interleaved pixels, indexed by color then by third.
+ *****************************************************************************/
+static pixel deinterleaveMasks[3][3][16];
+
+/** ***************************************************************************
+ * @brief shuffle masks placing one color of 16 pixels into each 16 byte
+ * third of their interleaved bytes, indexed by color then by third.
+ *****************************************************************************/
+static pixel interleaveMasks[3][3][16];
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function is the scalar reference for deinterleaving. It splits
+ * interleaved red, green, blue triples into the three color rows one pixel
+ * at a time.
+ *
+ * @param[in] source - the interleaved pixel bytes
+ * @param[out] red - the row receiving the red values
+ * @param[out] green - the row receiving the green values
+ * @param[out] blue - the row receiving the blue values
+ * @param[in] count - the number of pixels to deinterleave
+ *
+ * @returns none
+ *****************************************************************************/
+static void deinterleaveScalar( const pixel *source, pixel *red,
+                                pixel *green, pixel *blue, int count )
+{
+    int j;
+
+    for( j = 0; j < count; j++ )
+    {
+        red[j] = source[3 * j];
+        green[j] = source[3 * j + 1];
+        blue[j] = source[3 * j + 2];
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function deinterleaves 16 pixels per iteration with SSSE3 byte
+ * shuffles. Each color is gathered from the three 16 byte loads and merged
+ * with a bitwise or. The remaining pixels are handled by the scalar kernel.
+ *
+ * @param[in] source - the interleaved pixel bytes
+ * @param[out] red - the row receiving the red values
+ * @param[out] green - the row receiving the green values
+ * @param[out] blue - the row receiving the blue values
+ * @param[in] count - the number of pixels to deinterleave
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "ssse3" ) ) )
+static void deinterleaveSsse3( const pixel *source, pixel *red,
+                               pixel *green, pixel *blue, int count )
+{
+    int j, color;
+    __m128i a, b, c, result;
+    __m128i masks[3][3];
+    pixel *rows[3] = { red, green, blue };
+
+    for( color = 0; color < 3; color++ )
+    {
+        masks[color][0] = _mm_loadu_si128(
+            (const __m128i *) deinterleaveMasks[color][0] );
+        masks[color][1] = _mm_loadu_si128(
+            (const __m128i *) deinterleaveMasks[color][1] );
+        masks[color][2] = _mm_loadu_si128(
+            (const __m128i *) deinterleaveMasks[color][2] );
+    }
+
+    for( j = 0; j + 16 <= count; j += 16 )
+    {
+        a = _mm_loadu_si128( (const __m128i *) ( source + 3 * j ) );
+        b = _mm_loadu_si128( (const __m128i *) ( source + 3 * j + 16 ) );
+        c = _mm_loadu_si128( (const __m128i *) ( source + 3 * j + 32 ) );
+        for( color = 0; color < 3; color++ )
+        {
+            result = _mm_or_si128(
+                _mm_or_si128( _mm_shuffle_epi8( a, masks[color][0] ),
+                              _mm_shuffle_epi8( b, masks[color][1] ) ),
+                _mm_shuffle_epi8( c, masks[color][2] ) );
+            _mm_storeu_si128( (__m128i *) ( rows[color] + j ), result );
+        }
+    }
+
+    deinterleaveScalar( source + 3 * j, red + j, green + j, blue + j,
+                        count - j );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function deinterleaves 32 pixels per iteration with AVX2. Since the
+ * AVX2 byte shuffle works within each 128 bit lane, the low lane is loaded
+ * with the first 16 pixels and the high lane with the next 16 pixels, which
+ * lets the SSSE3 masks be reused in both lanes. The remaining pixels are
+ * handled by the SSSE3 kernel.
+ *
+ * @param[in] source - the interleaved pixel bytes
+ * @param[out] red - the row receiving the red values
+ * @param[out] green - the row receiving the green values
+ * @param[out] blue - the row receiving the blue values
+ * @param[in] count - the number of pixels to deinterleave
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "avx2" ) ) )
+static void deinterleaveAvx2( const pixel *source, pixel *red,
+                              pixel *green, pixel *blue, int count )
+{
+    int j, color;
+    __m256i a, b, c, result;
+    __m256i masks[3][3];
+    pixel *rows[3] = { red, green, blue };
+
+    for( color = 0; color < 3; color++ )
+    {
+        masks[color][0] = _mm256_broadcastsi128_si256( _mm_loadu_si128(
+            (const __m128i *) deinterleaveMasks[color][0] ) );
+        masks[color][1] = _mm256_broadcastsi128_si256( _mm_loadu_si128(
+            (const __m128i *) deinterleaveMasks[color][1] ) );
+        masks[color][2] = _mm256_broadcastsi128_si256( _mm_loadu_si128(
+            (const __m128i *) deinterleaveMasks[color][2] ) );
+    }
+
+    for( j = 0; j + 32 <= count; j += 32 )
+    {
+        a = _mm256_loadu2_m128i(
+            (const __m128i *) ( source + 3 * j + 48 ),
+            (const __m128i *) ( source + 3 * j ) );
+        b = _mm256_loadu2_m128i(
+            (const __m128i *) ( source + 3 * j + 64 ),
+            (const __m128i *) ( source + 3 * j + 16 ) );
+        c = _mm256_loadu2_m128i(
+            (const __m128i *) ( source + 3 * j + 80 ),
+            (const __m128i *) ( source + 3 * j + 32 ) );
+        for( color = 0; color < 3; color++ )
+        {
+            result = _mm256_or_si256(
+                _mm256_or_si256( _mm256_shuffle_epi8( a, masks[color][0] ),
+                                 _mm256_shuffle_epi8( b, masks[color][1] ) ),
+                _mm256_shuffle_epi8( c, masks[color][2] ) );
+            _mm256_storeu_si256( (__m256i *) ( rows[color] + j ), result );
+        }
+    }
+
+    deinterleaveSsse3( source + 3 * j, red + j, green + j, blue + j,
+                       count - j );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function splits a run of interleaved red, green, blue triples into
+ * the three color rows with the kernel selected by initKernels.
+ *
+ * @param[in] source - the interleaved pixel bytes
+ * @param[out] red - the row receiving the red values
+ * @param[out] green - the row receiving the green values
+ * @param[out] blue - the row receiving the blue values
+ * @param[in] count - the number of pixels to deinterleave
+ *
+ * @returns none
+ *****************************************************************************/
+void deinterleaveRGB( const pixel *source, pixel *red, pixel *green,
+                      pixel *blue, int count )
+{
+    kernels.deinterleave( source, red, green, blue, count );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function is the scalar reference for interleaving. It merges the
+ * three color rows into red, green, blue triples one pixel at a time.
+ *
+ * @param[in] red - the row of red values
+ * @param[in] green - the row of green values
+ * @param[in] blue - the row of blue values
+ * @param[out] dest - the interleaved pixel bytes
+ * @param[in] count - the number of pixels to interleave
+ *
+ * @returns none
+ *****************************************************************************/
+static void interleaveScalar( const pixel *red, const pixel *green,
+                              const pixel *blue, pixel *dest, int count )
+{
+    int j;
+
+    for( j = 0; j < count; j++ )
+    {
+        dest[3 * j] = red[j];
+        dest[3 * j + 1] = green[j];
+        dest[3 * j + 2] = blue[j];
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function interleaves 16 pixels per iteration with SSSE3 byte
+ * shuffles. Each 16 byte third of the output gathers its bytes from the
+ * three colors and merges them with a bitwise or. The remaining pixels are
+ * handled by the scalar kernel.
+ *
+ * @param[in] red - the row of red values
+ * @param[in] green - the row of green values
+ * @param[in] blue - the row of blue values
+ * @param[out] dest - the interleaved pixel bytes
+ * @param[in] count - the number of pixels to interleave
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "ssse3" ) ) )
+static void interleaveSsse3( const pixel *red, const pixel *green,
+                             const pixel *blue, pixel *dest, int count )
+{
+    int j, third;
+    __m128i r, g, b, result;
+    __m128i masks[3][3];
+
+    for( third = 0; third < 3; third++ )
+    {
+        masks[0][third] = _mm_loadu_si128(
+            (const __m128i *) interleaveMasks[0][third] );
+        masks[1][third] = _mm_loadu_si128(
+            (const __m128i *) interleaveMasks[1][third] );
+        masks[2][third] = _mm_loadu_si128(
+            (const __m128i *) interleaveMasks[2][third] );
+    }
+
+    for( j = 0; j + 16 <= count; j += 16 )
+    {
+        r = _mm_loadu_si128( (const __m128i *) ( red + j ) );
+        g = _mm_loadu_si128( (const __m128i *) ( green + j ) );
+        b = _mm_loadu_si128( (const __m128i *) ( blue + j ) );
+        for( third = 0; third < 3; third++ )
+        {
+            result = _mm_or_si128(
+                _mm_or_si128( _mm_shuffle_epi8( r, masks[0][third] ),
+                              _mm_shuffle_epi8( g, masks[1][third] ) ),
+                _mm_shuffle_epi8( b, masks[2][third] ) );
+            _mm_storeu_si128( (__m128i *) ( dest + 3 * j + 16 * third ),
+                              result );
+        }
+    }
+
+    interleaveScalar( red + j, green + j, blue + j, dest + 3 * j,
+                      count - j );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function interleaves 32 pixels per iteration with AVX2. The low lane
+ * of each color holds the first 16 pixels and the high lane the next 16, so
+ * the SSSE3 masks produce the bytes of the first 16 pixels in the low lanes
+ * and those of the next 16 pixels in the high lanes, which are stored 48
+ * bytes apart. The remaining pixels are handled by the SSSE3 kernel.
+ *
+ * @param[in] red - the row of red values
+ * @param[in] green - the row of green values
+ * @param[in] blue - the row of blue values
+ * @param[out] dest - the interleaved pixel bytes
+ * @param[in] count - the number of pixels to interleave
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "avx2" ) ) )
+static void interleaveAvx2( const pixel *red, const pixel *green,
+                            const pixel *blue, pixel *dest, int count )
+{
+    int j, third;
+    __m256i r, g, b, result;
+    __m256i masks[3][3];
+
+    for( third = 0; third < 3; third++ )
+    {
+        masks[0][third] = _mm256_broadcastsi128_si256( _mm_loadu_si128(
+            (const __m128i *) interleaveMasks[0][third] ) );
+        masks[1][third] = _mm256_broadcastsi128_si256( _mm_loadu_si128(
+            (const __m128i *) interleaveMasks[1][third] ) );
+        masks[2][third] = _mm256_broadcastsi128_si256( _mm_loadu_si128(
+            (const __m128i *) interleaveMasks[2][third] ) );
+    }
+
+    for( j = 0; j + 32 <= count; j += 32 )
+    {
+        r = _mm256_loadu_si256( (const __m256i *) ( red + j ) );
+        g = _mm256_loadu_si256( (const __m256i *) ( green + j ) );
+        b = _mm256_loadu_si256( (const __m256i *) ( blue + j ) );
+        for( third = 0; third < 3; third++ )
+        {
+            result = _mm256_or_si256(
+                _mm256_or_si256( _mm256_shuffle_epi8( r, masks[0][third] ),
+                                 _mm256_shuffle_epi8( g, masks[1][third] ) ),
+                _mm256_shuffle_epi8( b, masks[2][third] ) );
+            _mm256_storeu2_m128i(
+                (__m128i *) ( dest + 3 * j + 48 + 16 * third ),
+                (__m128i *) ( dest + 3 * j + 16 * third ), result );
+        }
+    }
+
+    interleaveSsse3( red + j, green + j, blue + j, dest + 3 * j, count - j );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function merges the three color rows into a run of interleaved red,
+ * green, blue triples with the kernel selected by initKernels.
+ *
+ * @param[in] red - the row of red values
+ * @param[in] green - the row of green values
+ * @param[in] blue - the row of blue values
+ * @param[out] dest - the interleaved pixel bytes
+ * @param[in] count - the number of pixels to interleave
+ *
+ * @returns none
+ *****************************************************************************/
+void interleaveRGB( const pixel *red, const pixel *green, const pixel *blue,
+                    pixel *dest, int count )
+{
+    kernels.interleave( red, green, blue, dest, count );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function is the scalar reference for negating. It subtracts each
+ * sample from 255.
+ *
+ * @param[in, out] samples - the samples to negate
+ * @param[in] count - the number of samples
+ *
+ * @returns none
+ *****************************************************************************/
+static void negateScalar( pixel *samples, size_t count )
+{
+    size_t k;
+
+    for( k = 0; k < count; k++ )
+    {
+        samples[k] = 255 - samples[k];
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function negates 16 samples per iteration with SSE2 by subtracting
+ * them from 255 with a saturating byte subtract, which can never saturate.
+ * The remaining samples are handled by the scalar kernel.
+ *
+ * @param[in, out] samples - the samples to negate
+ * @param[in] count - the number of samples
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "sse2" ) ) )
+static void negateSse2( pixel *samples, size_t count )
+{
+    size_t k;
+    __m128i full = _mm_set1_epi8( (char) 255 );
+
+    for( k = 0; k + 16 <= count; k += 16 )
+    {
+        _mm_storeu_si128( (__m128i *) ( samples + k ), _mm_subs_epu8( full,
+            _mm_loadu_si128( (const __m128i *) ( samples + k ) ) ) );
+    }
+
+    negateScalar( samples + k, count - k );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function negates 32 samples per iteration with AVX2. The remaining
+ * samples are handled by the SSE2 kernel.
+ *
+ * @param[in, out] samples - the samples to negate
+ * @param[in] count - the number of samples
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "avx2" ) ) )
+static void negateAvx2( pixel *samples, size_t count )
+{
+    size_t k;
+    __m256i full = _mm256_set1_epi8( (char) 255 );
+
+    for( k = 0; k + 32 <= count; k += 32 )
+    {
+        _mm256_storeu_si256( (__m256i *) ( samples + k ), _mm256_subs_epu8(
+            full, _mm256_loadu_si256( (const __m256i *) ( samples + k ) ) ) );
+    }
+
+    negateSse2( samples + k, count - k );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function negates 64 samples per iteration with AVX-512. The last
+ * partial vector is handled with a masked load and store, so there is no
+ * scalar remainder.
+ *
+ * @param[in, out] samples - the samples to negate
+ * @param[in] count - the number of samples
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "avx512f,avx512bw,bmi2" ) ) )
+static void negateAvx512( pixel *samples, size_t count )
+{
+    size_t k;
+    __mmask64 tail;
+    __m512i full = _mm512_set1_epi8( (char) 255 );
+
+    for( k = 0; k + 64 <= count; k += 64 )
+    {
+        _mm512_storeu_si512( samples + k, _mm512_subs_epu8( full,
+            _mm512_loadu_si512( samples + k ) ) );
+    }
+
+    if( k < count )
+    {
+        tail = _bzhi_u64( ~0ull, count - k );
+        _mm512_mask_storeu_epi8( samples + k, tail, _mm512_subs_epu8( full,
+            _mm512_maskz_loadu_epi8( tail, samples + k ) ) );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function is the scalar reference for brightening. It adds the value
+ * to each sample and limits the result to between 0 and 255.
+ *
+ * @param[in, out] samples - the samples to brighten
+ * @param[in] count - the number of samples
+ * @param[in] value - the amount to add, which may be negative
+ *
+ * @returns none
+ *****************************************************************************/
+static void brightenScalar( pixel *samples, size_t count, int value )
+{
+    size_t k;
+
+    for( k = 0; k < count; k++ )
+    {
+        samples[k] = max( 0, min( 255, samples[k] + value ) );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function brightens 16 samples per iteration with SSE2. Saturating
+ * byte arithmetic does the limiting: a positive value is added with a
+ * saturating add and a negative value subtracted with a saturating
+ * subtract. Since a sample can only move by 255, the value is limited to
+ * between -255 and 255 first. The remaining samples are handled by the
+ * scalar kernel.
+ *
+ * @param[in, out] samples - the samples to brighten
+ * @param[in] count - the number of samples
+ * @param[in] value - the amount to add, which may be negative
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "sse2" ) ) )
+static void brightenSse2( pixel *samples, size_t count, int value )
+{
+    size_t k;
+    __m128i data;
+    __m128i add = _mm_set1_epi8( (char) max( 0, min( 255, value ) ) );
+    __m128i sub = _mm_set1_epi8( (char) max( 0, min( 255, -value ) ) );
+
+    for( k = 0; k + 16 <= count; k += 16 )
+    {
+        data = _mm_loadu_si128( (const __m128i *) ( samples + k ) );
+        data = _mm_subs_epu8( _mm_adds_epu8( data, add ), sub );
+        _mm_storeu_si128( (__m128i *) ( samples + k ), data );
+    }
+
+    brightenScalar( samples + k, count - k, value );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function brightens 32 samples per iteration with AVX2 saturating byte
+ * arithmetic. The remaining samples are handled by the SSE2 kernel.
+ *
+ * @param[in, out] samples - the samples to brighten
+ * @param[in] count - the number of samples
+ * @param[in] value - the amount to add, which may be negative
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "avx2" ) ) )
+static void brightenAvx2( pixel *samples, size_t count, int value )
+{
+    size_t k;
+    __m256i data;
+    __m256i add = _mm256_set1_epi8( (char) max( 0, min( 255, value ) ) );
+    __m256i sub = _mm256_set1_epi8( (char) max( 0, min( 255, -value ) ) );
+
+    for( k = 0; k + 32 <= count; k += 32 )
+    {
+        data = _mm256_loadu_si256( (const __m256i *) ( samples + k ) );
+        data = _mm256_subs_epu8( _mm256_adds_epu8( data, add ), sub );
+        _mm256_storeu_si256( (__m256i *) ( samples + k ), data );
+    }
+
+    brightenSse2( samples + k, count - k, value );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function brightens 64 samples per iteration with AVX-512 saturating
+ * byte arithmetic. The last partial vector is handled with a masked load
+ * and store.
+ *
+ * @param[in, out] samples - the samples to brighten
+ * @param[in] count - the number of samples
+ * @param[in] value - the amount to add, which may be negative
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "avx512f,avx512bw,bmi2" ) ) )
+static void brightenAvx512( pixel *samples, size_t count, int value )
+{
+    size_t k;
+    __mmask64 tail;
+    __m512i add = _mm512_set1_epi8( (char) max( 0, min( 255, value ) ) );
+    __m512i sub = _mm512_set1_epi8( (char) max( 0, min( 255, -value ) ) );
+
+    for( k = 0; k + 64 <= count; k += 64 )
+    {
+        _mm512_storeu_si512( samples + k, _mm512_subs_epu8( _mm512_adds_epu8(
+            _mm512_loadu_si512( samples + k ), add ), sub ) );
+    }
+
+    if( k < count )
+    {
+        tail = _bzhi_u64( ~0ull, count - k );
+        _mm512_mask_storeu_epi8( samples + k, tail, _mm512_subs_epu8(
+            _mm512_adds_epu8( _mm512_maskz_loadu_epi8( tail, samples + k ),
+                              add ), sub ) );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function is the scalar reference for table lookups. It replaces each
+ * sample with the entry of the table it indexes.
+ *
+ * @param[in, out] samples - the samples to map
+ * @param[in] count - the number of samples
+ * @param[in] table - the 256 entry table giving the output for each value
+ *
+ * @returns none
+ *****************************************************************************/
+static void lookupScalar( pixel *samples, size_t count, const pixel *table )
+{
+    size_t k;
+
+    for( k = 0; k < count; k++ )
+    {
+        samples[k] = table[samples[k]];
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function splits a 256 entry table into the 16 byte rows used by the
+ * byte shuffle lookups. Row h covers the values 16h to 16h + 15 and holds
+ * the difference, as an exclusive or, from row h - 1, except for the first
+ * row of each half of the table, which holds its entries as they are. The
+ * exclusive or of rows 0 to h of a half then gives the entries of row h.
+ *
+ * @param[in] table - the 256 entry table
+ * @param[out] rows - the 16 rows of differences
+ *
+ * @returns none
+ *****************************************************************************/
+static void lookupRows( const pixel *table, pixel rows[16][16] )
+{
+    int h, k;
+
+    for( h = 0; h < 16; h++ )
+    {
+        for( k = 0; k < 16; k++ )
+        {
+            rows[h][k] = table[16 * h + k] ^
+                ( h % 8 == 0 ? 0 : table[16 * h + k - 16] );
+        }
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function looks up 16 samples per iteration with SSSE3 byte shuffles.
+ * A shuffle only indexes 16 bytes and writes zero where the index has its
+ * top bit set, so each half of the table is walked a row at a time: the
+ * index starts as the sample and drops by 16 per row with a signed
+ * saturating subtract. A sample below 128 indexes rows 0 through sample /
+ * 16 of the low half and is negative, giving zero, for the rest, so the
+ * exclusive or of the shuffled difference rows is its entry. The high half
+ * is walked the same way with the top bit of the sample flipped, and each
+ * sample gets nothing from the half it does not belong to. The remaining
+ * samples are handled by the scalar kernel.
+ *
+ * @param[in, out] samples - the samples to map
+ * @param[in] count - the number of samples
+ * @param[in] table - the 256 entry table giving the output for each value
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "ssse3" ) ) )
+static void lookupSsse3( pixel *samples, size_t count, const pixel *table )
+{
+    size_t k;
+    int h;
+    pixel rowBytes[16][16];
+    __m128i rows[16], low, high, result;
+    __m128i step = _mm_set1_epi8( 16 ), flip = _mm_set1_epi8( (char) 0x80 );
+
+    lookupRows( table, rowBytes );
+    for( h = 0; h < 16; h++ )
+    {
+        rows[h] = _mm_loadu_si128( (const __m128i *) rowBytes[h] );
+    }
+
+    for( k = 0; k + 16 <= count; k += 16 )
+    {
+        low = _mm_loadu_si128( (const __m128i *) ( samples + k ) );
+        high = _mm_xor_si128( low, flip );
+        result = _mm_xor_si128( _mm_shuffle_epi8( rows[0], low ),
+                                _mm_shuffle_epi8( rows[8], high ) );
+        for( h = 1; h < 8; h++ )
+        {
+            low = _mm_subs_epi8( low, step );
+            high = _mm_subs_epi8( high, step );
+            result = _mm_xor_si128( result, _mm_xor_si128(
+                _mm_shuffle_epi8( rows[h], low ),
+                _mm_shuffle_epi8( rows[h + 8], high ) ) );
+        }
+        _mm_storeu_si128( (__m128i *) ( samples + k ), result );
+    }
+
+    lookupScalar( samples + k, count - k, table );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function looks up 32 samples per iteration with the AVX2 byte
+ * shuffle, walking the rows of the table as the SSSE3 kernel does with each
+ * row copied into both 128 bit lanes. The remaining samples are handled by
+ * the SSSE3 kernel.
+ *
+ * @param[in, out] samples - the samples to map
+ * @param[in] count - the number of samples
+ * @param[in] table - the 256 entry table giving the output for each value
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "avx2" ) ) )
+static void lookupAvx2( pixel *samples, size_t count, const pixel *table )
+{
+    size_t k;
+    int h;
+    pixel rowBytes[16][16];
+    __m256i rows[16], low, high, result;
+    __m256i step = _mm256_set1_epi8( 16 );
+    __m256i flip = _mm256_set1_epi8( (char) 0x80 );
+
+    lookupRows( table, rowBytes );
+    for( h = 0; h < 16; h++ )
+    {
+        rows[h] = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128( (const __m128i *) rowBytes[h] ) );
+    }
+
+    for( k = 0; k + 32 <= count; k += 32 )
+    {
+        low = _mm256_loadu_si256( (const __m256i *) ( samples + k ) );
+        high = _mm256_xor_si256( low, flip );
+        result = _mm256_xor_si256( _mm256_shuffle_epi8( rows[0], low ),
+                                   _mm256_shuffle_epi8( rows[8], high ) );
+        for( h = 1; h < 8; h++ )
+        {
+            low = _mm256_subs_epi8( low, step );
+            high = _mm256_subs_epi8( high, step );
+            result = _mm256_xor_si256( result, _mm256_xor_si256(
+                _mm256_shuffle_epi8( rows[h], low ),
+                _mm256_shuffle_epi8( rows[h + 8], high ) ) );
+        }
+        _mm256_storeu_si256( (__m256i *) ( samples + k ), result );
+    }
+
+    lookupSsse3( samples + k, count - k, table );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function looks up 64 samples per iteration with the AVX-512 VBMI
+ * two table byte permute, which indexes 128 bytes held in two registers by
+ * the low seven bits of each sample. One permute covers each half of the
+ * table and the top bit of the sample picks between them. The last partial
+ * vector is handled with a masked load and store.
+ *
+ * @param[in, out] samples - the samples to map
+ * @param[in] count - the number of samples
+ * @param[in] table - the 256 entry table giving the output for each value
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "avx512f,avx512bw,avx512vbmi,bmi2" ) ) )
+static void lookupAvx512Vbmi( pixel *samples, size_t count,
+                              const pixel *table )
+{
+    size_t k;
+    __mmask64 tail;
+    __m512i data;
+    __m512i quarter0 = _mm512_loadu_si512( table );
+    __m512i quarter1 = _mm512_loadu_si512( table + 64 );
+    __m512i quarter2 = _mm512_loadu_si512( table + 128 );
+    __m512i quarter3 = _mm512_loadu_si512( table + 192 );
+
+    for( k = 0; k < count; k += 64 )
+    {
+        tail = count - k >= 64 ? ~0ull : _bzhi_u64( ~0ull, count - k );
+        data = _mm512_maskz_loadu_epi8( tail, samples + k );
+        data = _mm512_mask_blend_epi8( _mm512_movepi8_mask( data ),
+            _mm512_permutex2var_epi8( quarter0, data, quarter1 ),
+            _mm512_permutex2var_epi8( quarter2, data, quarter3 ) );
+        _mm512_mask_storeu_epi8( samples + k, tail, data );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function is the scalar reference for grayscaling. It weights the
+ * red, green, and blue values by .3, .6, and .1 in double precision, rounds
+ * to the nearest value, and limits the result to 255. The vector kernels
+ * must give exactly the same values. The maximum and minimum gray values
+ * are merged into the ones given.
+ *
+ * @param[in] red - the red pixels of the row
+ * @param[in] green - the green pixels of the row
+ * @param[in] blue - the blue pixels of the row
+ * @param[out] gray - the gray pixels of the row
+ * @param[in] count - the number of pixels in the row
+ * @param[in, out] max - the maximum gray value seen
+ * @param[in, out] min - the minimum gray value seen
+ *
+ * @returns none
+ *****************************************************************************/
+static void grayscaleScalar( const pixel *red, const pixel *green,
+                             const pixel *blue, pixel *gray, int count,
+                             int &max, int &min )
+{
+    int j;
+    double testValue;
+
+    for( j = 0; j < count; j++ )
+    {
+        testValue = red[j] * .3 + green[j] * .6 + blue[j] * .1;
+        gray[j] = testValue > 255 ? 255 : (int) ( testValue + .5 );
+        max = std::max<int>( max, gray[j] );
+        min = std::min<int>( min, gray[j] );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function grayscales four pixels with AVX2 doubles, evaluating the
+ * weighted sum in the same order as the scalar reference so every rounding
+ * is the same, and returns the gray values as 32 bit integers.
+ *
+ * @param[in] red - four red values as 32 bit integers
+ * @param[in] green - four green values as 32 bit integers
+ * @param[in] blue - four blue values as 32 bit integers
+ *
+ * @returns the four gray values, limited to 255
+ *****************************************************************************/
+__attribute__( ( target( "avx2" ) ) )
+static __m128i exactGrayAvx2( __m128i red, __m128i green, __m128i blue )
+{
+    __m256d sum;
+
+    sum = _mm256_add_pd(
+        _mm256_add_pd(
+            _mm256_mul_pd( _mm256_cvtepi32_pd( red ), _mm256_set1_pd( .3 ) ),
+            _mm256_mul_pd( _mm256_cvtepi32_pd( green ),
+                           _mm256_set1_pd( .6 ) ) ),
+        _mm256_mul_pd( _mm256_cvtepi32_pd( blue ), _mm256_set1_pd( .1 ) ) );
+    return _mm_min_epi32( _mm256_cvttpd_epi32(
+        _mm256_add_pd( sum, _mm256_set1_pd( .5 ) ) ), _mm_set1_epi32( 255 ) );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function grayscales 16 pixels per iteration with AVX2 fixed point
+ * arithmetic. With s = 3 * red + 6 * green + blue the gray value is s / 10
+ * rounded, which is ( s + 5 ) * 6554 >> 16 in 16 bit lanes. That matches the
+ * double precision reference everywhere except where s / 10 ends in exactly
+ * one half: the weights .3, .6, and .1 are not exact in binary, so the
+ * reference rounds some of those halves down depending on the individual
+ * colors. A group of pixels holding such a half is recomputed with AVX2
+ * doubles in the order the reference uses. The maximum and minimum are kept
+ * with vector byte min and max and reduced at the end. The remaining pixels
+ * are handled by the scalar kernel.
+ *
+ * @param[in] red - the red pixels of the row
+ * @param[in] green - the green pixels of the row
+ * @param[in] blue - the blue pixels of the row
+ * @param[out] gray - the gray pixels of the row
+ * @param[in] count - the number of pixels in the row
+ * @param[in, out] max - the maximum gray value seen
+ * @param[in, out] min - the minimum gray value seen
+ *
+ * @returns none
+ *****************************************************************************/
+__attribute__( ( target( "avx2" ) ) )
+static void grayscaleAvx2( const pixel *red, const pixel *green,
+                           const pixel *blue, pixel *gray, int count,
+                           int &max, int &min )
+{
+    int j, k;
+    pixel extremes[32];
+    __m256i r, g, b, sum, value, halves;
+    __m256i wide[3];
+    __m128i quarters[4], out;
+    __m128i high = _mm_set1_epi8( 0 );
+    __m128i low = _mm_set1_epi8( (char) 255 );
+
+    for( j = 0; j + 16 <= count; j += 16 )
+    {
+        r = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128( (const __m128i *) ( red + j ) ) );
+        g = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128( (const __m128i *) ( green + j ) ) );
+        b = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128( (const __m128i *) ( blue + j ) ) );
+
+        // s + 5, rounded down after dividing by 10
+        sum = _mm256_add_epi16(
+            _mm256_add_epi16( _mm256_mullo_epi16( r, _mm256_set1_epi16( 3 ) ),
+                              _mm256_mullo_epi16( g, _mm256_set1_epi16( 6 ) ) ),
+            _mm256_add_epi16( b, _mm256_set1_epi16( 5 ) ) );
+        value = _mm256_mulhi_epu16( sum, _mm256_set1_epi16( 6554 ) );
+
+        // recompute the group in double precision if it holds a half
+        halves = _mm256_cmpeq_epi16(
+            _mm256_mullo_epi16( value, _mm256_set1_epi16( 10 ) ), sum );
+        if( !_mm256_testz_si256( halves, halves ) )
+        {
+            for( k = 0; k < 2; k++ )
+            {
+                wide[0] = _mm256_cvtepu16_epi32( k == 0 ?
+                    _mm256_castsi256_si128( r ) :
+                    _mm256_extracti128_si256( r, 1 ) );
+                wide[1] = _mm256_cvtepu16_epi32( k == 0 ?
+                    _mm256_castsi256_si128( g ) :
+                    _mm256_extracti128_si256( g, 1 ) );
+                wide[2] = _mm256_cvtepu16_epi32( k == 0 ?
+                    _mm256_castsi256_si128( b ) :
+                    _mm256_extracti128_si256( b, 1 ) );
+                quarters[2 * k] = exactGrayAvx2(
+                    _mm256_castsi256_si128( wide[0] ),
+                    _mm256_castsi256_si128( wide[1] ),
+                    _mm256_castsi256_si128( wide[2] ) );
+                quarters[2 * k + 1] = exactGrayAvx2(
+                    _mm256_extracti128_si256( wide[0], 1 ),
+                    _mm256_extracti128_si256( wide[1], 1 ),
+                    _mm256_extracti128_si256( wide[2], 1 ) );
+            }
+            value = _mm256_set_m128i(
+                _mm_packus_epi32( quarters[2], quarters[3] ),
+                _mm_packus_epi32( quarters[0], quarters[1] ) );
+        }
+
+        out = _mm_packus_epi16( _mm256_castsi256_si128( value ),
+                                _mm256_extracti128_si256( value, 1 ) );
+        _mm_storeu_si128( (__m128i *) ( gray + j ), out );
+        high = _mm_max_epu8( high, out );
+        low = _mm_min_epu8( low, out );
+    }
+
+    // reduce the extremes of the lanes
+    _mm_storeu_si128( (__m128i *) extremes, high );
+    _mm_storeu_si128( (__m128i *) ( extremes + 16 ), low );
+    for( k = 0; k < 16; k++ )
+    {
+        max = std::max<int>( max, extremes[k] );
+        min = std::min<int>( min, extremes[k + 16] );
+    }
+
+    grayscaleScalar( red + j, green + j, blue + j, gray + j, count - j, max,
+                     min );
+}
+
+/** ***************************************************************************
+ * @brief the kernels in use, starting with the scalar references until
+ * initKernels registers the vector variants.
+ *****************************************************************************/
+kernelTable kernels = { deinterleaveScalar, interleaveScalar, negateScalar,
+                        brightenScalar, lookupScalar, grayscaleScalar };
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function checks with cpuid whether the processor, and the operating
+ * system, support an instruction set.
+ *
+ * @param[in] required - the instruction set to check
+ *
+ * @returns true if kernels built for the instruction set can run
+ *****************************************************************************/
+bool cpuSupports( instructionSet required )
+{
+    switch( required )
+    {
+        case Scalar:
+            return true;
+        case Sse2:
+            return __builtin_cpu_supports( "sse2" );
+        case Ssse3:
+            return __builtin_cpu_supports( "ssse3" );
+        case Avx2:
+            return __builtin_cpu_supports( "avx2" );
+        case Avx512:
+            return __builtin_cpu_supports( "avx512f" ) &&
+                __builtin_cpu_supports( "avx512bw" ) &&
+                __builtin_cpu_supports( "bmi2" );
+        case Avx512Vbmi:
+            return cpuSupports( Avx512 ) &&
+                __builtin_cpu_supports( "avx512vbmi" );
+    }
+    return false;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function builds the shuffle masks used by the interleave kernels and
+ * registers every vector variant in this file with the kernel table, from
+ * the narrowest instruction set to the widest, so the widest one the
+ * processor supports ends up in use. It is called once at startup; calling
+ * it again does nothing.
+ *
+ * The deinterleave masks gather one color from each third of 16 pixels:
+ * pixel k of a color c lives at byte 3k + c, so the mask for a given third
+ * selects that byte when it falls inside the third and writes a zero (0x80)
+ * otherwise. The interleave masks do the reverse: byte b of the 48 output
+ * bytes is color b % 3 of pixel b / 3.
+ *
+ * @returns none
+ *****************************************************************************/
+void initKernels( )
+{
+    static bool initialized = false;
+    int color, third, k, byte;
+
+    if( initialized )
+    {
+        return;
+    }
+    initialized = true;
+
+    for( color = 0; color < 3; color++ )
+    {
+        for( third = 0; third < 3; third++ )
+        {
+            for( k = 0; k < 16; k++ )
+            {
+                byte = 3 * k + color;
+                deinterleaveMasks[color][third][k] =
+                    byte / 16 == third ? byte % 16 : 0x80;
+                byte = 16 * third + k;
+                interleaveMasks[color][third][k] =
+                    byte % 3 == color ? byte / 3 : 0x80;
+            }
+        }
+    }
+
+    registerKernel( kernels.deinterleave, Ssse3, deinterleaveSsse3 );
+    registerKernel( kernels.deinterleave, Avx2, deinterleaveAvx2 );
+    registerKernel( kernels.interleave, Ssse3, interleaveSsse3 );
+    registerKernel( kernels.interleave, Avx2, interleaveAvx2 );
+    registerKernel( kernels.negate, Sse2, negateSse2 );
+    registerKernel( kernels.negate, Avx2, negateAvx2 );
+    registerKernel( kernels.negate, Avx512, negateAvx512 );
+    registerKernel( kernels.brighten, Sse2, brightenSse2 );
+    registerKernel( kernels.brighten, Avx2, brightenAvx2 );
+    registerKernel( kernels.brighten, Avx512, brightenAvx512 );
+    registerKernel( kernels.lookup, Ssse3, lookupSsse3 );
+    registerKernel( kernels.lookup, Avx2, lookupAvx2 );
+    registerKernel( kernels.lookup, Avx512Vbmi, lookupAvx512Vbmi );
+    registerKernel( kernels.grayscale, Avx2, grayscaleAvx2 );
+}
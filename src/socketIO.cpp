@@ -0,0 +1,230 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the functions which pass requests and replies over the
+* Unix socket between the image_operations server and image_client
+******************************************************************************/
+
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "imageProgram.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @brief the most bytes received from a socket with each call to recv.
+ *****************************************************************************/
+static const size_t SOCKET_BLOCK = 1 << 16;
+
+/** ***************************************************************************
+ * @brief the longest line of text accepted from a socket.
+ *****************************************************************************/
+static const size_t LINE_LIMIT = 1 << 16;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function fills in the address of a Unix socket from its path.
+ *
+ * @param[in] path - the path of the socket
+ * @param[out] address - the address of the socket
+ *
+ * @returns true - the address was filled in
+ * @returns false - the path is empty or too long for a socket address
+ *****************************************************************************/
+bool socketAddress( const string &path, sockaddr_un &address )
+{
+    memset( &address, 0, sizeof( address ) );
+    address.sun_family = AF_UNIX;
+    if( path.empty( ) || path.size( ) >= sizeof( address.sun_path ) )
+    {
+        return false;
+    }
+    memcpy( address.sun_path, path.c_str( ), path.size( ) + 1 );
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function sends all of a block of bytes over a socket, calling send
+ * as many times as it takes. A peer that has gone away is reported as a
+ * failure rather than raising SIGPIPE.
+ *
+ * @param[in] fd - the socket
+ * @param[in] data - the bytes to send
+ * @param[in] size - the number of bytes
+ *
+ * @returns true - every byte was sent
+ * @returns false - the socket failed or was closed
+ *****************************************************************************/
+bool sendAll( int fd, const void *data, size_t size )
+{
+    const char *next = (const char *) data;
+    ssize_t sent;
+
+    while( size > 0 )
+    {
+        sent = send( fd, next, size, MSG_NOSIGNAL );
+        if( sent <= 0 )
+        {
+            return false;
+        }
+        next += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function receives more bytes from the socket of a reader, moving
+ * the bytes not yet used to the front of its buffer first.
+ *
+ * @param[in, out] reader - the socket and the bytes received from it
+ *
+ * @returns true - more bytes were received
+ * @returns false - the socket failed or was closed
+ *****************************************************************************/
+static bool fillSocketReader( socketReader &reader )
+{
+    ssize_t received;
+
+    if( reader.pos > 0 )
+    {
+        memmove( reader.buffer.data( ), reader.buffer.data( ) + reader.pos,
+                 reader.fill - reader.pos );
+        reader.fill -= reader.pos;
+        reader.pos = 0;
+    }
+    if( reader.buffer.size( ) < reader.fill + SOCKET_BLOCK )
+    {
+        reader.buffer.resize( reader.fill + SOCKET_BLOCK );
+    }
+    received = recv( reader.fd, reader.buffer.data( ) + reader.fill,
+                     SOCKET_BLOCK, 0 );
+    if( received <= 0 )
+    {
+        return false;
+    }
+    reader.fill += received;
+    return true;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function receives a line of text ending in a newline from a socket.
+ * The newline, and a carriage return before it, are not kept.
+ *
+ * @param[in, out] reader - the socket and the bytes received from it
+ * @param[out] line - the line received
+ *
+ * @returns true - a line was received
+ * @returns false - the socket failed or was closed first, or the line is
+ * longer than LINE_LIMIT
+ *****************************************************************************/
+bool readSocketLine( socketReader &reader, string &line )
+{
+    char *start, *end;
+
+    while( true )
+    {
+        start = reader.buffer.data( ) + reader.pos;
+        end = (char *) memchr( start, '\n', reader.fill - reader.pos );
+        if( end != nullptr )
+        {
+            line.assign( start, end - ( end > start && end[-1] == '\r' ) );
+            reader.pos = end + 1 - reader.buffer.data( );
+            return true;
+        }
+        if( reader.fill - reader.pos > LINE_LIMIT ||
+            !fillSocketReader( reader ) )
+        {
+            return false;
+        }
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function tells whether a whole line has been received from a socket
+ * and not yet read, so readSocketLine will return it without waiting.
+ *
+ * @param[in] reader - the socket and the bytes received from it
+ *
+ * @returns true - a line ending in a newline is waiting
+ * @returns false - at most part of a line has been received
+ *****************************************************************************/
+bool socketLineReady( const socketReader &reader )
+{
+    return memchr( reader.buffer.data( ) + reader.pos, '\n',
+                   reader.fill - reader.pos ) != nullptr;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function receives the bytes that have arrived on a socket with a
+ * single call to recv, for a socket that poll reported readable, so it
+ * does not wait.
+ *
+ * @param[in, out] reader - the socket and the bytes received from it
+ *
+ * @returns true - more bytes were received
+ * @returns false - the socket failed or was closed, or more than
+ * LINE_LIMIT bytes arrived without ending a line
+ *****************************************************************************/
+bool receiveSocketBytes( socketReader &reader )
+{
+    return fillSocketReader( reader ) &&
+        ( reader.fill - reader.pos <= LINE_LIMIT ||
+          socketLineReady( reader ) );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function receives a given number of bytes from a socket, first
+ * taking any already received with the line before them.
+ *
+ * @param[in, out] reader - the socket and the bytes received from it
+ * @param[out] data - where the bytes are placed
+ * @param[in] size - the number of bytes
+ *
+ * @returns true - every byte was received
+ * @returns false - the socket failed or was closed first
+ *****************************************************************************/
+bool readSocketBytes( socketReader &reader, pixel *data, size_t size )
+{
+    size_t count = min( size, reader.fill - reader.pos );
+    ssize_t received;
+
+    memcpy( data, reader.buffer.data( ) + reader.pos, count );
+    reader.pos += count;
+    data += count;
+    size -= count;
+
+    // large payloads go straight into place
+    while( size > 0 )
+    {
+        received = recv( reader.fd, data, size, 0 );
+        if( received <= 0 )
+        {
+            return false;
+        }
+        data += received;
+        size -= received;
+    }
+    return true;
+}
@@ -0,0 +1,243 @@
+/** ***************************************************************************
+* @file
+*
+* @brief contains the thread pool which runs operations on bands of rows
+******************************************************************************/
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "netPBM.h"
+using namespace std;
+
+/** ***************************************************************************
+ * @brief the state shared between the threads of the pool and the thread
+ * handing them work.
+ *****************************************************************************/
+struct threadPool
+{
+    size_t size = 0; /*!< the number of threads working on a task, the
+                     calling thread included, zero until chosen */
+    vector<thread> workers; /*!< the threads of the pool */
+    mutex submit; /*!< held by the thread running a task, so tasks started
+                  by different threads take turns */
+    mutex lock; /*!< guards the fields below */
+    condition_variable wake; /*!< signals the workers that a task is ready */
+    condition_variable done; /*!< signals the caller that a task finished */
+    const function<void( int )> *task = nullptr; /*!< the task being run */
+    int count = 0; /*!< the number of indices in the task */
+    atomic<int> next; /*!< the next index of the task to run */
+    int busy = 0; /*!< the number of workers still running the task */
+    unsigned generation = 0; /*!< incremented each time a task starts */
+};
+
+/** ***************************************************************************
+ * @brief the pool used by the program. It is never destroyed: the workers
+ * are still waiting on its condition variables when the program exits, and
+ * destroying a condition variable with waiters blocks forever.
+ *****************************************************************************/
+static threadPool &pool = *new threadPool;
+
+/** ***************************************************************************
+ * @brief true on the threads of the pool, so a task that starts another
+ * task runs it itself instead of waiting on the busy pool.
+ *****************************************************************************/
+static thread_local bool insidePool = false;
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function runs indices of the current task until none are left.
+ *
+ * @returns none
+ *****************************************************************************/
+static void runIndices( )
+{
+    int index;
+
+    while( ( index = pool.next.fetch_add( 1 ) ) < pool.count )
+    {
+        ( *pool.task )( index );
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function is the loop run by each thread of the pool. It sleeps until
+ * a new task starts, helps run it, and reports when it is done.
+ *
+ * @returns none
+ *****************************************************************************/
+static void workerLoop( )
+{
+    unsigned seen = 0;
+
+    insidePool = true;
+    while( true )
+    {
+        unique_lock<mutex> guard( pool.lock );
+        pool.wake.wait( guard, [&] { return pool.generation != seen; } );
+        seen = pool.generation;
+        guard.unlock( );
+
+        runIndices( );
+
+        guard.lock( );
+        if( --pool.busy == 0 )
+        {
+            pool.done.notify_one( );
+        }
+    }
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function sets how many threads work on each task, the calling thread
+ * included. It must be called before the first task is run; a count below
+ * one selects one thread per core.
+ *
+ * @param[in] count - the number of threads to use
+ *
+ * @returns none
+ *****************************************************************************/
+void setWorkerCount( int count )
+{
+    pool.size = count >= 1 ? count :
+        max( thread::hardware_concurrency( ), 1u );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function returns how many threads work on each task, one per core
+ * unless setWorkerCount chose otherwise.
+ *
+ * @returns the number of threads to use, at least one
+ *****************************************************************************/
+size_t workerCount( )
+{
+    if( pool.size == 0 )
+    {
+        setWorkerCount( 0 );
+    }
+    return pool.size;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function runs a task for every index from 0 to count - 1 on the
+ * threads of the pool and returns once all of them have finished. The
+ * calling thread runs indices too. The pool threads are started the first
+ * time they are needed. With a single thread, or when called from inside a
+ * task, the indices are run in order on the calling thread. Tasks started
+ * by several threads at once run one after another.
+ *
+ * @param[in] count - the number of indices
+ * @param[in] task - the work to do for one index
+ *
+ * @returns none
+ *****************************************************************************/
+void parallelFor( int count, const function<void( int index )> &task )
+{
+    int index;
+
+    if( count <= 0 )
+    {
+        return;
+    }
+    if( workerCount( ) == 1 || count == 1 || insidePool )
+    {
+        for( index = 0; index < count; index++ )
+        {
+            task( index );
+        }
+        return;
+    }
+
+    lock_guard<mutex> turn( pool.submit );
+    unique_lock<mutex> guard( pool.lock );
+    while( pool.workers.size( ) + 1 < workerCount( ) )
+    {
+        pool.workers.emplace_back( workerLoop );
+        pool.workers.back( ).detach( );
+    }
+
+    // publish the task and wake the workers
+    pool.task = &task;
+    pool.count = count;
+    pool.next = 0;
+    pool.busy = pool.workers.size( );
+    pool.generation++;
+    pool.wake.notify_all( );
+    guard.unlock( );
+
+    insidePool = true;
+    runIndices( );
+    insidePool = false;
+
+    // wait for the workers to finish their last indices
+    guard.lock( );
+    pool.done.wait( guard, [] { return pool.busy == 0; } );
+    pool.task = nullptr;
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function determines how many bands the rows of an image are split
+ * into. There are a few bands per thread so that threads finishing early
+ * can pick up more work, but never more bands than rows.
+ *
+ * @param[in] rows - the number of rows in the image
+ *
+ * @returns the number of bands
+ *****************************************************************************/
+int rowBands( int rows )
+{
+    if( workerCount( ) == 1 )
+    {
+        return 1;
+    }
+    return max( 1, min<int>( rows, 4 * workerCount( ) ) );
+}
+
+/** ***************************************************************************
+ * @author Cameron Custer
+ *
+ * @par Description:
+ * This function splits the rows of an image into bands and runs a task on
+ * each band on the threads of the pool. Band b covers the rows from
+ * rows * b / bands up to rows * ( b + 1 ) / bands. A stencil reads the halo
+ * rows just outside its band from the source plane, which no task writes,
+ * and writes only the rows of its own band, so every output row is computed
+ * exactly as it would be by a single thread.
+ *
+ * @param[in] rows - the number of rows in the image
+ * @param[in] task - the work to do for one band, given the band number, the
+ * first row, and one past the last row
+ *
+ * @returns none
+ *****************************************************************************/
+void parallelRows( int rows,
+                   const function<void( int band, int first, int last )>
+                   &task )
+{
+    int bands = rowBands( rows );
+
+    parallelFor( bands, [&]( int band )
+    {
+        task( band, (int) ( (long long) rows * band / bands ),
+              (int) ( (long long) rows * ( band + 1 ) / bands ) );
+    } );
+}